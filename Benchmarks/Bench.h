@@ -0,0 +1,38 @@
+// Andrew Meckling
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+// Wall clock stopwatch for the benchmarks.
+class BenchTimer
+{
+    std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+public:
+
+    void restart()
+    {
+        _start = std::chrono::steady_clock::now();
+    }
+
+    // Returns the milliseconds since construction or the last restart().
+    double ms() const
+    {
+        return std::chrono::duration< double, std::milli >(
+            std::chrono::steady_clock::now() - _start ).count();
+    }
+};
+
+// Prints one line of results: what was measured, the time per iteration
+// and a checksum so the work cannot be optimized away.
+inline void bench_report( const char* name, double msPerIter, const char* unit, long long checksum )
+{
+    printf( "%-40s %10.3f ms/%s  (%lld)\n", name, msPerIter, unit, checksum );
+}
+
+// Each benchmark prints its own results.
+void bench_quad_tree();
+void bench_local_quad_tree();
+void bench_concurrent_queue();
+void bench_bitset_allocator();
@@ -0,0 +1,90 @@
+// Andrew Meckling
+
+#include "Bench.h"
+#include "Allocators.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const size_t ARENA = 4 << 20;
+    const size_t ALIGN = 16;
+    const int OPS = 200000;
+
+    using Bitset = BitsetAllocator< ARENA, ALIGN >;
+
+    // Frees a live block and allocates another of 1 to 64 bytes in its
+    // place, OPS times, so the allocator stays as full as it started. The
+    // block is the newest one, or a random one if scattered, which leaves
+    // holes all through the allocator. The checksum counts the allocations
+    // which failed.
+    template< typename Allocator >
+    void churn( const char* name, Allocator& alloc, std::vector< Blk >& live, bool scattered )
+    {
+        std::mt19937 rng( 1 );
+        long long failed = 0;
+
+        BenchTimer timer;
+        for ( int i = 0; i < OPS; ++i )
+        {
+            Blk& blk = live[ scattered ? rng() % live.size() : live.size() - 1 ];
+            alloc.deallocate( blk );
+            blk = alloc.allocate( 1 + rng() % 64 );
+            failed += blk.ptr == nullptr;
+        }
+        bench_report( name, timer.ms() / (OPS / 1e6), "M ops", failed );
+
+        for ( Blk& blk : live )
+            alloc.deallocate( blk );
+    }
+
+    // Allocates blocks of 1 to 64 bytes until bytes are in use.
+    template< typename Allocator >
+    std::vector< Blk > fill( Allocator& alloc, size_t bytes )
+    {
+        std::mt19937 rng( 2 );
+        std::vector< Blk > live;
+        for ( size_t used = 0; used < bytes; )
+        {
+            live.push_back( alloc.allocate( 1 + rng() % 64 ) );
+            used += round_to_alignment( live.back().size, ALIGN );
+        }
+        return live;
+    }
+}
+
+// Alloc / free pairs against a nearly empty allocator, where the first
+// words of the bitset have room, and a ~90% full one. When the full part
+// is packed the summary bitmap lets the scan skip it 64 words at a time;
+// when it is riddled with holes every word must be looked at. Mallocator
+// is the baseline.
+void bench_bitset_allocator()
+{
+    auto pBitset = std::make_unique< Bitset >();
+    Mallocator mallocator;
+
+    struct Case
+    {
+        const char* bitsetName;
+        const char* mallocName;
+        size_t bytes;
+        bool scattered;
+    };
+
+    static const Case CASES[] = {
+        { "BitsetAllocator empty", "Mallocator empty", 64 * ALIGN, true },
+        { "BitsetAllocator 90% full, packed", "Mallocator 90% full, packed", ARENA * 9 / 10, false },
+        { "BitsetAllocator 90% full, scattered", "Mallocator 90% full, scattered", ARENA * 9 / 10, true },
+    };
+
+    for ( const Case& c : CASES )
+    {
+        std::vector< Blk > live = fill( *pBitset, c.bytes );
+        churn( c.bitsetName, *pBitset, live, c.scattered );
+
+        live = fill( mallocator, c.bytes );
+        churn( c.mallocName, mallocator, live, c.scattered );
+    }
+}
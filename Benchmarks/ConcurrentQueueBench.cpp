@@ -0,0 +1,91 @@
+// Andrew Meckling
+
+#include "Bench.h"
+#include "ConcurrentQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const uint64_t ITEMS = 4000000;
+    const size_t CAPACITY = 1024;
+
+    // Moves ITEMS items from producers to consumers, batch at a time (or
+    // with tryPush / tryPop if batch is 1), and reports the time per
+    // million items. The checksum is the sum of the items popped.
+    template< typename Queue >
+    void run( const char* name, int producers, int consumers, size_t batch )
+    {
+        auto pQueue = std::make_unique< Queue >();
+        std::atomic< uint64_t > remaining { ITEMS };
+        std::atomic< uint64_t > sum { 0 };
+        std::vector< std::thread > threads;
+
+        BenchTimer timer;
+        for ( int p = 0; p < producers; ++p )
+        {
+            threads.emplace_back( [&, p]
+            {
+                std::vector< uint64_t > items( batch );
+                uint64_t end = ITEMS * (p + 1) / producers;
+                for ( uint64_t n = ITEMS * p / producers; n < end; )
+                {
+                    size_t count = size_t( std::min< uint64_t >( batch, end - n ) );
+                    for ( size_t i = 0; i < count; ++i )
+                        items[ i ] = n + i;
+
+                    size_t pushed = batch == 1
+                        ? size_t( pQueue->tryPush( items[ 0 ] ) )
+                        : pQueue->pushN( items.data(), count );
+                    n += pushed;
+                    if ( pushed == 0 )
+                        std::this_thread::yield();
+                }
+            } );
+        }
+        for ( int c = 0; c < consumers; ++c )
+        {
+            threads.emplace_back( [&]
+            {
+                std::vector< uint64_t > items( batch );
+                uint64_t total = 0;
+                while ( remaining.load( std::memory_order_relaxed ) > 0 )
+                {
+                    size_t popped = batch == 1
+                        ? size_t( pQueue->tryPop( items[ 0 ] ) )
+                        : pQueue->popN( items.data(), batch );
+                    for ( size_t i = 0; i < popped; ++i )
+                        total += items[ i ];
+
+                    remaining.fetch_sub( popped, std::memory_order_relaxed );
+                    if ( popped == 0 )
+                        std::this_thread::yield();
+                }
+                sum += total;
+            } );
+        }
+        for ( std::thread& thread : threads )
+            thread.join();
+
+        bench_report( name, timer.ms() / (ITEMS / 1e6), "M items", (long long) sum.load() );
+    }
+}
+
+// Items handed from producer to consumer threads through the queues,
+// singly and in batches, with one and with several threads on each side.
+void bench_concurrent_queue()
+{
+    using Spsc = SpscQueue< uint64_t, CAPACITY >;
+    using Mpmc = MpmcQueue< uint64_t, CAPACITY >;
+
+    run< Spsc >( "SpscQueue 1 -> 1", 1, 1, 1 );
+    run< Spsc >( "SpscQueue 1 -> 1, batches of 32", 1, 1, 32 );
+    run< Mpmc >( "MpmcQueue 1 -> 1", 1, 1, 1 );
+    run< Mpmc >( "MpmcQueue 1 -> 1, batches of 32", 1, 1, 32 );
+    run< Mpmc >( "MpmcQueue 4 -> 4", 4, 4, 1 );
+    run< Mpmc >( "MpmcQueue 4 -> 4, batches of 32", 4, 4, 32 );
+}
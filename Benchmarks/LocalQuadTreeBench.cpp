@@ -0,0 +1,66 @@
+// Andrew Meckling
+
+#include "Bench.h"
+#include "LocalQuadTree.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// The workload of bench_quad_tree for LocalQuadTree: 100k points bouncing
+// around a large world, moved every frame and the tree rebuilt from
+// scratch, followed by 1000 area queries. Compare the lines with those of
+// the QuadTree, which updates each object in place.
+void bench_local_quad_tree()
+{
+    const int OBJECTS = 100000;
+    const int QUERIES = 1000;
+    const int FRAMES = 30;
+    const float WORLD = 5000;
+
+    std::mt19937 rng( 1 );
+    std::uniform_real_distribution< float > pos( -WORLD + 100, WORLD - 100 );
+    std::uniform_real_distribution< float > speed( -2, 2 );
+
+    LocalQuadTree< int > tree( glm::vec2( 0, 0 ), glm::vec2( WORLD, WORLD ) );
+    std::vector< glm::vec2 > velocities;
+    velocities.reserve( OBJECTS );
+
+    BenchTimer timer;
+    for ( int i = 0; i < OBJECTS; ++i )
+    {
+        tree.insert( glm::vec2( pos( rng ), pos( rng ) ), i );
+        velocities.push_back( { speed( rng ), speed( rng ) } );
+    }
+    tree.rebuild();
+    bench_report( "LocalQuadTree insert 100k", timer.ms(), "all", tree.size() );
+
+    double moveMs = 0;
+    double queryMs = 0;
+    long long found = 0;
+    int buffer[ 256 ];
+
+    for ( int frame = 0; frame < FRAMES; ++frame )
+    {
+        timer.restart();
+        tree.forEach( [&]( LocalQuadTreeData< int >& data )
+        {
+            glm::vec2& velocity = velocities[ data.load ];
+            data.pos += velocity;
+            if ( std::abs( data.pos.x ) > WORLD - 100 )
+                velocity.x = -velocity.x;
+            if ( std::abs( data.pos.y ) > WORLD - 100 )
+                velocity.y = -velocity.y;
+        } );
+        tree.rebuild();
+        moveMs += timer.ms();
+
+        timer.restart();
+        for ( int i = 0; i < QUERIES; ++i )
+            found += tree.query( AABB( pos( rng ), pos( rng ), 50, 50 ), buffer, 256 );
+        queryMs += timer.ms();
+    }
+
+    bench_report( "LocalQuadTree move 100k and rebuild", moveMs / FRAMES, "frame", tree.size() );
+    bench_report( "LocalQuadTree 1000 queries", queryMs / FRAMES, "frame", found );
+}
@@ -0,0 +1,65 @@
+// Andrew Meckling
+
+#include "Bench.h"
+#include "QuadTree.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// 100k small objects bouncing around a large world, each moved every frame,
+// followed by 1000 area queries like those of AI and spell targeting.
+void bench_quad_tree()
+{
+    const int OBJECTS = 100000;
+    const int QUERIES = 1000;
+    const int FRAMES = 30;
+    const float WORLD = 5000;
+
+    std::mt19937 rng( 1 );
+    std::uniform_real_distribution< float > pos( -WORLD + 100, WORLD - 100 );
+    std::uniform_real_distribution< float > speed( -2, 2 );
+
+    QuadTree< int > tree( glm::vec2( 0, 0 ), glm::vec2( WORLD, WORLD ) );
+    std::vector< QuadTree< int >::Handle > handles;
+    std::vector< glm::vec2 > velocities;
+    handles.reserve( OBJECTS );
+    velocities.reserve( OBJECTS );
+
+    BenchTimer timer;
+    for ( int i = 0; i < OBJECTS; ++i )
+    {
+        handles.push_back( tree.insert( AABB( pos( rng ), pos( rng ), 1, 1 ), i ) );
+        velocities.push_back( { speed( rng ), speed( rng ) } );
+    }
+    bench_report( "QuadTree insert 100k", timer.ms(), "all", tree.size() );
+
+    double moveMs = 0;
+    double queryMs = 0;
+    long long found = 0;
+    QuadTree< int >::Handle buffer[ 256 ];
+
+    for ( int frame = 0; frame < FRAMES; ++frame )
+    {
+        timer.restart();
+        for ( int i = 0; i < OBJECTS; ++i )
+        {
+            AABB box = tree.get( handles[ i ] );
+            box.center += velocities[ i ];
+            if ( std::abs( box.center.x ) > WORLD - 100 )
+                velocities[ i ].x = -velocities[ i ].x;
+            if ( std::abs( box.center.y ) > WORLD - 100 )
+                velocities[ i ].y = -velocities[ i ].y;
+            tree.update( handles[ i ], box );
+        }
+        moveMs += timer.ms();
+
+        timer.restart();
+        for ( int i = 0; i < QUERIES; ++i )
+            found += tree.query( AABB( pos( rng ), pos( rng ), 50, 50 ), buffer, 256 );
+        queryMs += timer.ms();
+    }
+
+    bench_report( "QuadTree update 100k moving", moveMs / FRAMES, "frame", tree.size() );
+    bench_report( "QuadTree 1000 queries", queryMs / FRAMES, "frame", found );
+}
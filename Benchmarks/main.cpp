@@ -0,0 +1,35 @@
+// Andrew Meckling
+
+#include "Bench.h"
+
+#include <cstring>
+
+struct Benchmark
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+    { "quadtree", bench_quad_tree },
+    { "localquadtree", bench_local_quad_tree },
+    { "concurrentqueue", bench_concurrent_queue },
+    { "bitsetallocator", bench_bitset_allocator },
+};
+
+// Runs every benchmark, or only those named on the command line. Build in
+// Release; Debug timings mean little.
+int main( int argc, char* argv[] )
+{
+    for ( const Benchmark& bench : BENCHMARKS )
+    {
+        bool run = argc < 2;
+        for ( int i = 1; i < argc; ++i )
+            run |= strcmp( argv[ i ], bench.name ) == 0;
+
+        if ( run )
+            bench.run();
+    }
+
+    return 0;
+}
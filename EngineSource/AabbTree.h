@@ -0,0 +1,719 @@
+// Andrew Meckling
+#pragma once
+
+#include "Util.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Axis aligned box given by its corners. Boxes which touch overlap.
+struct AabbBox
+{
+    glm::vec2 lo;
+    glm::vec2 hi;
+
+    AabbBox() = default;
+
+    AabbBox( glm::vec2 lo, glm::vec2 hi )
+        : lo( lo )
+        , hi( hi )
+    {
+    }
+
+    explicit AabbBox( Rect rect )
+        : lo( rect.left(), rect.top() )
+        , hi( rect.right(), rect.bottom() )
+    {
+    }
+
+    Rect rect() const
+    {
+        return { lo.x, lo.y, hi.x - lo.x, hi.y - lo.y };
+    }
+
+    // Half the perimeter; the 2D stand-in for surface area in the cost
+    // of a tree.
+    float perimeter() const
+    {
+        return (hi.x - lo.x) + (hi.y - lo.y);
+    }
+
+    bool overlaps( const AabbBox& b ) const
+    {
+        return lo.x <= b.hi.x && b.lo.x <= hi.x
+            && lo.y <= b.hi.y && b.lo.y <= hi.y;
+    }
+
+    bool contains( const AabbBox& b ) const
+    {
+        return lo.x <= b.lo.x && lo.y <= b.lo.y
+            && b.hi.x <= hi.x && b.hi.y <= hi.y;
+    }
+
+    AabbBox expanded( glm::vec2 amount ) const
+    {
+        return { lo - amount, hi + amount };
+    }
+
+    friend AabbBox merge( const AabbBox& a, const AabbBox& b )
+    {
+        return { glm::min( a.lo, b.lo ), glm::max( a.hi, b.hi ) };
+    }
+};
+
+
+// Dynamic bounding volume tree for broadphase queries over objects of any
+// size which come, go and move, such as projectiles, spells and doors.
+// Leaves hold a fattened copy of each object's box, so an object can move a
+// little without the tree changing; move() only reinserts it once it
+// leaves its fat box. Inserts descend toward the sibling of least added
+// perimeter. Every node on the way back up is rotated as in an AVL tree when
+// one child is more than one level taller than the other, so the height
+// stays logarithmic even for stacks of identical boxes; otherwise it is
+// rotated when swapping a child with a shorter grandchild shrinks the tree.
+// Handles are leaf indices into a pooled node array and stay valid until
+// removed. Loads are usually an Eid, so entities can be found from hits.
+template< typename T = int >
+class AabbTree
+{
+public:
+
+    using ValueType = T;
+    using Handle = int;
+
+    static constexpr Handle NULL_HANDLE = -1;
+
+    // Distance the fat box of an object reaches past its box on every side.
+    static constexpr float DEFAULT_MARGIN = 2;
+
+    // How far ahead of a moving object its fat box reaches, as a multiple
+    // of the distance it moved.
+    static constexpr float DISPLACEMENT_FACTOR = 2;
+
+private:
+
+    static constexpr int NO_NODE = -1;
+
+    // Nodes a traversal keeps on the call stack before spilling to the
+    // heap; far more than a balanced tree needs.
+    static constexpr int STACK_SIZE = 256;
+
+    struct Node
+    {
+        AabbBox box;    // Fat box of a leaf; union of the children otherwise.
+        AabbBox tight;  // Box of the object, for leaves.
+        int     parent; // Also links the free list.
+        int     left;   // NO_NODE for a leaf.
+        int     right;
+        int     height; // 0 for a leaf; -1 while free.
+        T       load;
+
+        bool isLeaf() const
+        {
+            return left == NO_NODE;
+        }
+    };
+
+    // Nodes waiting to be visited by a traversal.
+    class NodeStack
+    {
+        int _fixed[ STACK_SIZE ];
+        std::vector< int > _spill;
+        int _depth = 0;
+
+    public:
+
+        bool empty() const
+        {
+            return _depth == 0;
+        }
+
+        void push( int node )
+        {
+            if ( _depth < STACK_SIZE )
+                _fixed[ _depth ] = node;
+            else
+                _spill.push_back( node );
+            ++_depth;
+        }
+
+        int pop()
+        {
+            if ( --_depth < STACK_SIZE )
+                return _fixed[ _depth ];
+
+            int node = _spill.back();
+            _spill.pop_back();
+            return node;
+        }
+    };
+
+    std::vector< Node > _nodes;
+    int _root = NO_NODE;
+    int _freeNode = NO_NODE;
+    int _size = 0;
+    float _margin;
+
+    int _allocate()
+    {
+        if ( _freeNode == NO_NODE )
+        {
+            _nodes.emplace_back();
+            _nodes.back().parent = NO_NODE;
+            _nodes.back().height = -1;
+            _freeNode = (int) _nodes.size() - 1;
+        }
+
+        int node = _freeNode;
+        _freeNode = _nodes[ node ].parent;
+        _nodes[ node ].parent = NO_NODE;
+        _nodes[ node ].left = NO_NODE;
+        _nodes[ node ].right = NO_NODE;
+        _nodes[ node ].height = 0;
+        return node;
+    }
+
+    void _free( int node )
+    {
+        _nodes[ node ].parent = _freeNode;
+        _nodes[ node ].height = -1;
+        _nodes[ node ].load = T();
+        _freeNode = node;
+    }
+
+    // Recomputes the box and height of an internal node from its children.
+    void _refit( int node )
+    {
+        Node& n = _nodes[ node ];
+        n.box = merge( _nodes[ n.left ].box, _nodes[ n.right ].box );
+        n.height = 1 + std::max( _nodes[ n.left ].height, _nodes[ n.right ].height );
+    }
+
+    // Puts child in place of node under node's parent.
+    void _replaceChild( int node, int child )
+    {
+        int parent = _nodes[ node ].parent;
+        _nodes[ child ].parent = parent;
+
+        if ( parent == NO_NODE )
+            _root = child;
+        else if ( _nodes[ parent ].left == node )
+            _nodes[ parent ].left = child;
+        else
+            _nodes[ parent ].right = child;
+    }
+
+    // Lifts the taller child of node above it if it is more than one level
+    // taller than the other child. node keeps the shorter child and the
+    // shorter of the lifted child's children. Returns the node now in
+    // node's place.
+    int _balance( int node )
+    {
+        Node& n = _nodes[ node ];
+        int balance = _nodes[ n.right ].height - _nodes[ n.left ].height;
+        if ( balance >= -1 && balance <= 1 )
+            return node;
+
+        bool liftRight = balance > 1;
+        int up = liftRight ? n.right : n.left;
+        Node& u = _nodes[ up ];
+
+        _replaceChild( node, up );
+
+        // up takes node in place of its shorter child, which node takes in
+        // place of up.
+        bool keepLeft = _nodes[ u.left ].height >= _nodes[ u.right ].height;
+        int down = keepLeft ? u.right : u.left;
+        (keepLeft ? u.right : u.left) = node;
+        n.parent = up;
+        (liftRight ? n.right : n.left) = down;
+        _nodes[ down ].parent = node;
+
+        _refit( node );
+        _refit( up );
+        return up;
+    }
+
+    // Swaps the child a of node with the grandchild g below its other child
+    // which makes the other child's box the smallest, if any does. Only
+    // grandchildren at least as tall as a are swapped, so no height grows.
+    bool _swapDown( int node, bool aIsLeft )
+    {
+        Node& n = _nodes[ node ];
+        int a = aIsLeft ? n.left : n.right;
+        int other = aIsLeft ? n.right : n.left;
+        Node& o = _nodes[ other ];
+        if ( o.isLeaf() )
+            return false;
+
+        int height = _nodes[ a ].height;
+        float base = o.box.perimeter();
+        float withF = _nodes[ o.left ].height >= height // a replaces o.left
+            ? merge( _nodes[ a ].box, _nodes[ o.right ].box ).perimeter() : base;
+        float withG = _nodes[ o.right ].height >= height // a replaces o.right
+            ? merge( _nodes[ a ].box, _nodes[ o.left ].box ).perimeter() : base;
+        if ( std::min( withF, withG ) >= base )
+            return false;
+
+        int g = withF <= withG ? o.left : o.right;
+        (withF <= withG ? o.left : o.right) = a;
+        _nodes[ a ].parent = other;
+        (aIsLeft ? n.left : n.right) = g;
+        _nodes[ g ].parent = node;
+
+        _refit( other );
+        return true;
+    }
+
+    // Rotates node if swapping one of its children with a grandchild on the
+    // other side shrinks the tree without making it taller, choosing the
+    // swap which saves the most.
+    void _rotate( int node )
+    {
+        Node& n = _nodes[ node ];
+        if ( n.isLeaf() )
+            return;
+
+        // Cost saved by moving each child down, as the shrinkage of the
+        // box of the other child.
+        auto saving = [&]( int a, int other )
+        {
+            const Node& o = _nodes[ other ];
+            if ( o.isLeaf() )
+                return 0.0f;
+            int height = _nodes[ a ].height;
+            float base = o.box.perimeter();
+            float best = base;
+            if ( _nodes[ o.left ].height >= height )
+                best = std::min( best, merge( _nodes[ a ].box, _nodes[ o.right ].box ).perimeter() );
+            if ( _nodes[ o.right ].height >= height )
+                best = std::min( best, merge( _nodes[ a ].box, _nodes[ o.left ].box ).perimeter() );
+            return base - best;
+        };
+
+        float left = saving( n.left, n.right );
+        float right = saving( n.right, n.left );
+        if ( left <= 0 && right <= 0 )
+            return;
+
+        if ( _swapDown( node, left >= right ) )
+            _refit( node );
+    }
+
+    // Refits, balances and rotates every node from node up to the root.
+    void _fixUpward( int node )
+    {
+        while ( node != NO_NODE )
+        {
+            _refit( node );
+            node = _balance( node );
+            _rotate( node );
+            node = _nodes[ node ].parent;
+        }
+    }
+
+    void _insertLeaf( int leaf )
+    {
+        if ( _root == NO_NODE )
+        {
+            _root = leaf;
+            _nodes[ leaf ].parent = NO_NODE;
+            return;
+        }
+
+        // Descend toward the child which the leaf would enlarge the least,
+        // or the shorter child when it would enlarge both alike, stopping
+        // where pairing it with the node itself is cheaper.
+        const AabbBox box = _nodes[ leaf ].box;
+        int node = _root;
+        while ( !_nodes[ node ].isLeaf() )
+        {
+            const Node& n = _nodes[ node ];
+            float area = n.box.perimeter();
+            float combined = merge( n.box, box ).perimeter();
+
+            float cost = 2 * combined;
+            float inheritance = 2 * (combined - area);
+
+            auto descentCost = [&]( int child )
+            {
+                const Node& c = _nodes[ child ];
+                float merged = merge( box, c.box ).perimeter();
+                return (c.isLeaf() ? merged : merged - c.box.perimeter()) + inheritance;
+            };
+
+            float costLeft = descentCost( n.left );
+            float costRight = descentCost( n.right );
+            if ( cost < costLeft && cost < costRight )
+                break;
+
+            if ( costLeft != costRight )
+                node = costLeft < costRight ? n.left : n.right;
+            else
+                node = _nodes[ n.left ].height <= _nodes[ n.right ].height ? n.left : n.right;
+        }
+
+        // Pair the leaf with node under a new parent.
+        int sibling = node;
+        int parent = _allocate();
+
+        _replaceChild( sibling, parent );
+        _nodes[ parent ].left = sibling;
+        _nodes[ parent ].right = leaf;
+        _nodes[ sibling ].parent = parent;
+        _nodes[ leaf ].parent = parent;
+
+        _fixUpward( parent );
+    }
+
+    void _removeLeaf( int leaf )
+    {
+        if ( leaf == _root )
+        {
+            _root = NO_NODE;
+            return;
+        }
+
+        int parent = _nodes[ leaf ].parent;
+        int grandParent = _nodes[ parent ].parent;
+        int sibling = _nodes[ parent ].left == leaf
+            ? _nodes[ parent ].right : _nodes[ parent ].left;
+
+        _replaceChild( parent, sibling );
+        _fixUpward( grandParent );
+
+        _free( parent );
+        _nodes[ leaf ].parent = NO_NODE;
+    }
+
+    AabbBox _fatten( const AabbBox& box, glm::vec2 displacement ) const
+    {
+        AabbBox fat = box.expanded( glm::vec2( _margin ) );
+        glm::vec2 ahead = displacement * DISPLACEMENT_FACTOR;
+        fat.lo += glm::min( ahead, glm::vec2( 0 ) );
+        fat.hi += glm::max( ahead, glm::vec2( 0 ) );
+        return fat;
+    }
+
+    // Calls func( a, b ) for each pair of leaves, one under a and one under
+    // b, whose objects overlap. Recurses no deeper than the tree is tall.
+    template< typename Func >
+    void _crossPairs( int a, int b, Func& func ) const
+    {
+        const Node& na = _nodes[ a ];
+        const Node& nb = _nodes[ b ];
+        if ( !na.box.overlaps( nb.box ) )
+            return;
+
+        if ( na.isLeaf() && nb.isLeaf() )
+        {
+            if ( na.tight.overlaps( nb.tight ) )
+                func( std::min( a, b ), std::max( a, b ) );
+        }
+        else if ( nb.isLeaf() || (!na.isLeaf() && na.height >= nb.height) )
+        {
+            _crossPairs( na.left, b, func );
+            _crossPairs( na.right, b, func );
+        }
+        else
+        {
+            _crossPairs( a, nb.left, func );
+            _crossPairs( a, nb.right, func );
+        }
+    }
+
+    template< typename Func >
+    void _selfPairs( int node, Func& func ) const
+    {
+        const Node& n = _nodes[ node ];
+        if ( n.isLeaf() )
+            return;
+
+        _selfPairs( n.left, func );
+        _selfPairs( n.right, func );
+        _crossPairs( n.left, n.right, func );
+    }
+
+    // Returns the fraction along from + t * delta, t in [0, maxT], at which
+    // the segment enters box; or a negative number if it misses.
+    static float _entry( const AabbBox& box, glm::vec2 from, glm::vec2 delta, float maxT )
+    {
+        float tMin = 0;
+        float tMax = maxT;
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( delta[ i ] == 0 )
+            {
+                if ( from[ i ] < box.lo[ i ] || from[ i ] > box.hi[ i ] )
+                    return -1;
+                continue;
+            }
+
+            float inv = 1 / delta[ i ];
+            float t0 = (box.lo[ i ] - from[ i ]) * inv;
+            float t1 = (box.hi[ i ] - from[ i ]) * inv;
+            if ( t0 > t1 )
+                std::swap( t0, t1 );
+
+            tMin = std::max( tMin, t0 );
+            tMax = std::min( tMax, t1 );
+            if ( tMin > tMax )
+                return -1;
+        }
+        return tMin;
+    }
+
+    // Sweeps a box of half size extent along the segment, calling
+    // func( handle, t ) for objects it hits in no particular order. func
+    // returns the new limit on t: t to keep only closer hits, maxT to go on,
+    // 0 to stop.
+    template< typename Func >
+    void _cast( glm::vec2 from, glm::vec2 delta, glm::vec2 extent, Func&& func ) const
+    {
+        if ( _root == NO_NODE )
+            return;
+
+        float maxT = 1;
+        NodeStack stack;
+        stack.push( _root );
+
+        while ( !stack.empty() )
+        {
+            int node = stack.pop();
+
+            const Node& n = _nodes[ node ];
+            if ( _entry( n.box.expanded( extent ), from, delta, maxT ) < 0 )
+                continue;
+
+            if ( n.isLeaf() )
+            {
+                float t = _entry( n.tight.expanded( extent ), from, delta, maxT );
+                if ( t >= 0 )
+                {
+                    maxT = std::min( maxT, (float) func( node, t ) );
+                    if ( maxT <= 0 )
+                        return;
+                }
+            }
+            else
+            {
+                stack.push( n.left );
+                stack.push( n.right );
+            }
+        }
+    }
+
+public:
+
+    explicit AabbTree( float margin = DEFAULT_MARGIN )
+        : _margin( margin )
+    {
+    }
+
+    // Returns the number of objects in the tree.
+    int size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    // Returns the height of the tree; 0 for a single object, -1 if empty.
+    int height() const
+    {
+        return _root == NO_NODE ? -1 : _nodes[ _root ].height;
+    }
+
+    // Returns the load of an object.
+    T& get( Handle h )
+    {
+        return _nodes[ h ].load;
+    }
+
+    const T& get( Handle h ) const
+    {
+        return _nodes[ h ].load;
+    }
+
+    // Returns the box of an object as last given.
+    Rect rect( Handle h ) const
+    {
+        return _nodes[ h ].tight.rect();
+    }
+
+    // Returns the fattened box the tree keeps for an object.
+    Rect fatRect( Handle h ) const
+    {
+        return _nodes[ h ].box.rect();
+    }
+
+    // Adds an object and returns its handle.
+    Handle insert( Rect rect, const T& load )
+    {
+        int leaf = _allocate();
+        Node& n = _nodes[ leaf ];
+        n.tight = AabbBox( rect );
+        n.box = _fatten( n.tight, { 0, 0 } );
+        n.load = load;
+
+        _insertLeaf( leaf );
+        ++_size;
+        return leaf;
+    }
+
+    // Removes an object. Its handle may be reused by a later insert.
+    void remove( Handle h )
+    {
+        _removeLeaf( h );
+        _free( h );
+        --_size;
+    }
+
+    // Gives an object a new box. displacement, the distance it moved, lets
+    // the fat box reach ahead of it. Returns true if the object left its
+    // fat box (or the fat box became much too big) and was reinserted.
+    bool move( Handle h, Rect rect, glm::vec2 displacement = { 0, 0 } )
+    {
+        Node& n = _nodes[ h ];
+        n.tight = AabbBox( rect );
+
+        AabbBox limit = n.tight.expanded( glm::vec2( 4 * _margin ) + glm::abs( displacement ) * DISPLACEMENT_FACTOR );
+        if ( n.box.contains( n.tight ) && limit.contains( n.box ) )
+            return false;
+
+        _removeLeaf( h );
+        _nodes[ h ].box = _fatten( _nodes[ h ].tight, displacement );
+        _insertLeaf( h );
+        return true;
+    }
+
+    // Removes every object.
+    void clear()
+    {
+        _nodes.clear();
+        _root = NO_NODE;
+        _freeNode = NO_NODE;
+        _size = 0;
+    }
+
+    // Calls func( handle ) for every object overlapping rect. Stops early
+    // if func returns false. func must not insert, remove or move objects.
+    template< typename Func >
+    void query( Rect rect, Func&& func ) const
+    {
+        if ( _root == NO_NODE )
+            return;
+
+        AabbBox box( rect );
+        NodeStack stack;
+        stack.push( _root );
+
+        while ( !stack.empty() )
+        {
+            const Node& n = _nodes[ stack.pop() ];
+            if ( !n.box.overlaps( box ) )
+                continue;
+
+            if ( n.isLeaf() )
+            {
+                if ( n.tight.overlaps( box ) && !func( Handle( &n - _nodes.data() ) ) )
+                    return;
+            }
+            else
+            {
+                stack.push( n.left );
+                stack.push( n.right );
+            }
+        }
+    }
+
+    // Writes the handles of up to capacity objects overlapping rect to
+    // out. Returns the number of objects found, which may be more than
+    // were written.
+    int query( Rect rect, Handle* out, int capacity ) const
+    {
+        int found = 0;
+        query( rect, [&]( Handle h )
+        {
+            if ( found++ < capacity )
+                out[ found - 1 ] = h;
+            return true;
+        } );
+        return found;
+    }
+
+    // Calls func( a, b ) once for every pair of objects whose boxes
+    // overlap, with a < b.
+    template< typename Func >
+    void eachPair( Func&& func ) const
+    {
+        if ( _root != NO_NODE )
+            _selfPairs( _root, func );
+    }
+
+    // Casts a ray from from to to, calling func( handle, t ) for objects it
+    // hits, where t in [0, 1] is how far along it enters them. func returns
+    // the new limit on t: t to only look for closer hits, 1 to find every
+    // hit, 0 to stop.
+    template< typename Func >
+    void raycast( glm::vec2 from, glm::vec2 to, Func&& func ) const
+    {
+        _cast( from, to - from, { 0, 0 }, func );
+    }
+
+    // Sweeps rect by delta, calling func( handle, t ) for objects it hits
+    // as raycast() does.
+    template< typename Func >
+    void sweep( Rect rect, glm::vec2 delta, Func&& func ) const
+    {
+        AabbBox box( rect );
+        _cast( (box.lo + box.hi) * 0.5f, delta, (box.hi - box.lo) * 0.5f, func );
+    }
+
+    // Returns the first object hit by a ray from from to to, setting *pT to
+    // how far along it was hit; or NULL_HANDLE.
+    Handle raycastFirst( glm::vec2 from, glm::vec2 to, float* pT = nullptr ) const
+    {
+        Handle hit = NULL_HANDLE;
+        float best = 1;
+        raycast( from, to, [&]( Handle h, float t )
+        {
+            if ( hit == NULL_HANDLE || t < best )
+            {
+                hit = h;
+                best = t;
+            }
+            return best;
+        } );
+
+        if ( pT && hit != NULL_HANDLE )
+            *pT = best;
+        return hit;
+    }
+
+    // Returns the first object hit by rect moving by delta, setting *pT to
+    // how far along it was hit; or NULL_HANDLE.
+    Handle sweepFirst( Rect rect, glm::vec2 delta, float* pT = nullptr ) const
+    {
+        Handle hit = NULL_HANDLE;
+        float best = 1;
+        sweep( rect, delta, [&]( Handle h, float t )
+        {
+            if ( hit == NULL_HANDLE || t < best )
+            {
+                hit = h;
+                best = t;
+            }
+            return best;
+        } );
+
+        if ( pT && hit != NULL_HANDLE )
+            *pT = best;
+        return hit;
+    }
+};
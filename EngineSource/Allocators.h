@@ -1,9 +1,14 @@
 // Andrew Meckling
 #pragma once
 
+#include "Bits.h"
 #include "Memory.h"
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
 
 // usage: ALLOC( <allocator>, <type> )
 //    or: ALLOC( <allocator>, <type> )( <direct-init> )
@@ -34,6 +39,123 @@ constexpr size_t round_to_alignment( size_t size, size_t align = sizeof( void* )
     return size % align ? size + align - size % align : size;
 }
 
+// Alignment guaranteed by malloc.
+constexpr size_t DEFAULT_ALIGNMENT = alignof( std::max_align_t );
+
+
+// Besides allocate, deallocate and owns, an allocator may implement:
+//     Blk  alignedAllocate( size_t size, size_t align );
+//     bool expand( Blk& blk, size_t delta );      // Grows blk in place.
+//     bool reallocate( Blk& blk, size_t size );   // Resizes blk, moving it if needed.
+// The allocator_* functions below call these when they exist and fall back
+// to the minimum interface otherwise, so composite allocators and containers
+// can use them with any allocator.
+
+namespace detail
+{
+    template< class A, typename = void >
+    struct has_aligned_allocate : std::false_type {};
+
+    template< class A >
+    struct has_aligned_allocate< A, std::void_t< decltype(
+        std::declval< A& >().alignedAllocate( size_t(), size_t() ) ) > > : std::true_type {};
+
+    template< class A, typename = void >
+    struct has_expand : std::false_type {};
+
+    template< class A >
+    struct has_expand< A, std::void_t< decltype(
+        std::declval< A& >().expand( std::declval< Blk& >(), size_t() ) ) > > : std::true_type {};
+
+    template< class A, typename = void >
+    struct has_reallocate : std::false_type {};
+
+    template< class A >
+    struct has_reallocate< A, std::void_t< decltype(
+        std::declval< A& >().reallocate( std::declval< Blk& >(), size_t() ) ) > > : std::true_type {};
+}
+
+// Allocates size bytes aligned to align (a power of 2). Allocators without
+// alignedAllocate can only satisfy alignments up to DEFAULT_ALIGNMENT.
+template< class Allocator >
+Blk allocator_aligned_allocate( Allocator& allocator, size_t size, size_t align )
+{
+    if constexpr ( detail::has_aligned_allocate< Allocator >::value )
+        return allocator.alignedAllocate( size, align );
+    else
+        return align <= DEFAULT_ALIGNMENT ? allocator.allocate( size ) : Blk { nullptr, 0 };
+}
+
+// Tries to grow blk by delta bytes without moving it. Returns true and
+// updates blk.size on success; leaves blk untouched on failure.
+template< class Allocator >
+bool allocator_expand( Allocator& allocator, Blk& blk, size_t delta )
+{
+    if ( delta == 0 )
+        return true;
+
+    if constexpr ( detail::has_expand< Allocator >::value )
+        return blk.ptr && allocator.expand( blk, delta );
+    else
+        return false;
+}
+
+// Resizes blk to size bytes, expanding or shrinking in place where the
+// allocator can, and otherwise allocating a new block, copying the bytes
+// across and deallocating the old block. Returns false (leaving blk
+// untouched) if memory could not be allocated. A null blk is allocated;
+// a size of 0 deallocates.
+template< class Allocator >
+bool allocator_reallocate( Allocator& allocator, Blk& blk, size_t size )
+{
+    if constexpr ( detail::has_reallocate< Allocator >::value )
+    {
+        return allocator.reallocate( blk, size );
+    }
+    else
+    {
+        if ( blk.size == size )
+            return true;
+
+        if ( size == 0 )
+        {
+            allocator.deallocate( blk );
+            blk = nullptr;
+            return true;
+        }
+
+        if ( blk.ptr && size > blk.size && allocator_expand( allocator, blk, size - blk.size ) )
+            return true;
+
+        Blk result = allocator.allocate( size );
+        if ( !result.ptr )
+            return false;
+
+        if ( blk.ptr )
+        {
+            std::memcpy( result.ptr, blk.ptr, std::min( blk.size, size ) );
+            allocator.deallocate( blk );
+        }
+        blk = result;
+        return true;
+    }
+}
+
+// Moves blk from one allocator to another. Returns false (leaving blk
+// untouched) if the destination could not allocate.
+template< class From, class To >
+bool allocator_move( From& from, To& to, Blk& blk, size_t size )
+{
+    Blk result = to.allocate( size );
+    if ( !result.ptr )
+        return false;
+
+    std::memcpy( result.ptr, blk.ptr, std::min( blk.size, size ) );
+    from.deallocate( blk );
+    blk = result;
+    return true;
+}
+
 
 // Default allocator in most cases. Calls malloc(size_t) and free(void*).
 class Mallocator
@@ -49,6 +171,45 @@ public:
     {
         free( blk.ptr );
     }
+
+    // Only alignments up to DEFAULT_ALIGNMENT are supported; see
+    // AlignedMallocator for anything larger.
+    Blk alignedAllocate( size_t size, size_t align )
+    {
+        return align <= DEFAULT_ALIGNMENT ? allocate( size ) : Blk { nullptr, 0 };
+    }
+
+    // Grows the block in place using _expand (MSVC) or the slack reported
+    // by malloc_usable_size (glibc).
+    bool expand( Blk& blk, size_t delta )
+    {
+    #ifdef _MSC_VER
+        if ( !_expand( blk.ptr, blk.size + delta ) )
+            return false;
+    #else
+        if ( malloc_usable_size( blk.ptr ) < blk.size + delta )
+            return false;
+    #endif
+        blk.size += delta;
+        return true;
+    }
+
+    bool reallocate( Blk& blk, size_t size )
+    {
+        if ( size == 0 )
+        {
+            deallocate( blk );
+            blk = nullptr;
+            return true;
+        }
+
+        void* ptr = realloc( blk.ptr, size );
+        if ( !ptr )
+            return false;
+
+        blk = { ptr, size };
+        return true;
+    }
 };
 
 constexpr bool operator ==( Mallocator, Mallocator )
@@ -56,6 +217,37 @@ constexpr bool operator ==( Mallocator, Mallocator )
     return true;
 }
 
+// Like Mallocator, but every block is aligned to at least Align bytes
+// and alignedAllocate supports any alignment.
+template< size_t Align = 16 >
+class AlignedMallocator
+{
+public:
+
+    static constexpr size_t ALIGNMENT = Align;
+
+    Blk allocate( size_t size )
+    {
+        return alignedAllocate( size, ALIGNMENT );
+    }
+
+    Blk alignedAllocate( size_t size, size_t align )
+    {
+        return { aligned_malloc( size, std::max( align, ALIGNMENT ) ), size };
+    }
+
+    void deallocate( Blk blk )
+    {
+        aligned_free( blk.ptr );
+    }
+};
+
+template< size_t A >
+constexpr bool operator ==( AlignedMallocator< A >, AlignedMallocator< A > )
+{
+    return true;
+}
+
 // So-called "null" allocator. Always fails to allocate memory.
 // Do not deallocate a Blk that wasn't returned by the associated
 // allocate function.
@@ -141,6 +333,21 @@ struct StaticAllocator
     {
         return sInstance.owns( p );
     }
+
+    Blk alignedAllocate( size_t n, size_t align )
+    {
+        return allocator_aligned_allocate( sInstance, n, align );
+    }
+
+    bool expand( Blk& b, size_t delta )
+    {
+        return allocator_expand( sInstance, b, delta );
+    }
+
+    bool reallocate( Blk& b, size_t n )
+    {
+        return allocator_reallocate( sInstance, b, n );
+    }
 };
 
 template< typename Allo, size_t I >
@@ -172,6 +379,21 @@ struct ThreadStaticAllocator
     {
         return sInstance.owns( p );
     }
+
+    Blk alignedAllocate( size_t n, size_t align )
+    {
+        return allocator_aligned_allocate( sInstance, n, align );
+    }
+
+    bool expand( Blk& b, size_t delta )
+    {
+        return allocator_expand( sInstance, b, delta );
+    }
+
+    bool reallocate( Blk& b, size_t n )
+    {
+        return allocator_reallocate( sInstance, b, n );
+    }
 };
 
 template< typename Allo, size_t I >
@@ -210,6 +432,41 @@ public:
     {
         return P::owns( p ) || F::owns( p );
     }
+
+    Blk alignedAllocate( size_t n, size_t align )
+    {
+        Blk r = allocator_aligned_allocate( _primary(), n, align );
+        if ( !r.ptr ) r = allocator_aligned_allocate( _fallback(), n, align );
+        return r;
+    }
+
+    bool expand( Blk& b, size_t delta )
+    {
+        return P::owns( b.ptr ) ? allocator_expand( _primary(), b, delta )
+            : allocator_expand( _fallback(), b, delta );
+    }
+
+    // Blocks owned by Primary move to Fallback if Primary cannot hold
+    // the new size.
+    bool reallocate( Blk& b, size_t n )
+    {
+        if ( !b.ptr )
+        {
+            b = n ? allocate( n ) : Blk( nullptr );
+            return b.ptr || n == 0;
+        }
+
+        if ( !P::owns( b.ptr ) )
+            return allocator_reallocate( _fallback(), b, n );
+
+        return allocator_reallocate( _primary(), b, n )
+            || allocator_move( _primary(), _fallback(), b, n );
+    }
+
+private:
+
+    P& _primary() { return *this; }
+    F& _fallback() { return *this; }
 };
 
 
@@ -243,6 +500,57 @@ public:
     {
         return S::owns( ptr ) || L::owns( ptr );
     }
+
+    Blk alignedAllocate( size_t size, size_t align )
+    {
+        return size <= THRESHOLD ? allocator_aligned_allocate( _smaller(), size, align )
+            : allocator_aligned_allocate( _larger(), size, align );
+    }
+
+    // Only succeeds if the block stays on the same side of the threshold.
+    bool expand( Blk& blk, size_t delta )
+    {
+        if ( blk.size > THRESHOLD )
+            return allocator_expand( _larger(), blk, delta );
+
+        return blk.size + delta <= THRESHOLD
+            && allocator_expand( _smaller(), blk, delta );
+    }
+
+    // Moves the block between the allocators if it crosses the threshold.
+    bool reallocate( Blk& blk, size_t size )
+    {
+        if ( !blk.ptr || size == 0 )
+            return _reallocateNull( blk, size );
+
+        bool wasSmall = blk.size <= THRESHOLD;
+        bool isSmall = size <= THRESHOLD;
+
+        if ( wasSmall == isSmall )
+            return wasSmall ? allocator_reallocate( _smaller(), blk, size )
+                : allocator_reallocate( _larger(), blk, size );
+
+        return wasSmall ? allocator_move( _smaller(), _larger(), blk, size )
+            : allocator_move( _larger(), _smaller(), blk, size );
+    }
+
+private:
+
+    S& _smaller() { return *this; }
+    L& _larger() { return *this; }
+
+    // Handles reallocating from or to nothing.
+    bool _reallocateNull( Blk& blk, size_t size )
+    {
+        if ( blk.ptr )
+        {
+            deallocate( blk );
+            blk = nullptr;
+            return true;
+        }
+        blk = size ? allocate( size ) : Blk( nullptr );
+        return blk.ptr || size == 0;
+    }
 };
 
 
@@ -283,8 +591,74 @@ public:
         return memory <= ptr && ptr < memory + SIZE;
     }
 
+    // Pads the top of the stack up to align before allocating. The padding
+    // is not reclaimed when the block is deallocated.
+    Blk alignedAllocate( size_t size, size_t align )
+    {
+        size_t offset = round_to_alignment( uintptr_t( ptr ), align ) - uintptr_t( ptr );
+        if ( offset > size_t( memory + SIZE - ptr ) )
+            return { nullptr, 0 };
+
+        byte* prev = ptr;
+        ptr += offset;
+        Blk result = allocate( size );
+        if ( !result.ptr )
+            ptr = prev;
+        return result;
+    }
+
+    // Succeeds if blk is the most recent allocation and there is room.
+    bool expand( Blk& blk, size_t delta )
+    {
+        if ( !_isTop( blk ) )
+            return false;
+
+        byte* top = (byte*) blk.ptr + _round_to_aligned( blk.size + delta );
+        if ( top > memory + SIZE )
+            return false;
+
+        ptr = top;
+        blk.size += delta;
+        return true;
+    }
+
+    // Resizes the most recent allocation in place; any other block is
+    // copied to the top of the stack.
+    bool reallocate( Blk& blk, size_t size )
+    {
+        if ( blk.ptr && _isTop( blk ) )
+        {
+            byte* top = (byte*) blk.ptr + _round_to_aligned( size );
+            if ( top > memory + SIZE )
+                return false;
+
+            ptr = top;
+            blk.size = size;
+            if ( size == 0 )
+                blk = nullptr;
+            return true;
+        }
+
+        Blk result = { nullptr, 0 };
+        if ( size > 0 && !(result = allocate( size )).ptr )
+            return false;
+
+        if ( blk.ptr )
+        {
+            std::memcpy( result.ptr, blk.ptr, std::min( blk.size, size ) );
+            deallocate( blk );
+        }
+        blk = result;
+        return true;
+    }
+
 private:
 
+    bool _isTop( const Blk& blk ) const
+    {
+        return (byte*) blk.ptr + _round_to_aligned( blk.size ) == ptr;
+    }
+
     static constexpr size_t _round_to_aligned( size_t size )
     {
         return round_to_alignment( size, ALIGNMENT );
@@ -295,6 +669,10 @@ private:
 // Allocates memory from this object to its users. Maps individual allocation
 // units of length Align to bits in a bitset. The overhead cost of this type
 // in bytes is (Bytes / Align / 8) or O(n/8).
+// The bitset is scanned a 64-bit word at a time with bit scan instructions.
+// A second level summary bitmap marks fully occupied words so that they are
+// skipped 64 at a time, which keeps allocation fast when the allocator is
+// nearly full.
 template< size_t Bytes, size_t Align = sizeof( void* ) >
 class BitsetAllocator
 {
@@ -308,26 +686,42 @@ public:
 
     static_assert( SIZE % ALIGNMENT == 0, "" );
 
-    Word bitset[ SIZE / ALIGNMENT / BITS_PER_WORD + 1 ] = { 0 };
-    byte memory[ SIZE ];
+    static constexpr size_t BLOCK_COUNT = SIZE / ALIGNMENT;
+    static constexpr size_t WORD_COUNT = (BLOCK_COUNT + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    static constexpr size_t SUMMARY_COUNT = (WORD_COUNT + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+    Word bitset[ WORD_COUNT ];     // One bit per allocation unit; set if in use.
+    Word summary[ SUMMARY_COUNT ]; // One bit per bitset word; set if the word is full.
+    alignas( ALIGNMENT ) byte memory[ SIZE ];
+
+    BitsetAllocator() noexcept
+        : bitset { 0 }
+        , summary { 0 }
+    {
+        // Bits past the end of memory are permanently in use.
+        if ( BLOCK_COUNT % BITS_PER_WORD )
+            _setWord( WORD_COUNT - 1, ~low_bits( BLOCK_COUNT % BITS_PER_WORD ) );
+
+        // Likewise for summary bits past the last word.
+        if ( WORD_COUNT % BITS_PER_WORD )
+            summary[ SUMMARY_COUNT - 1 ] |= ~low_bits( WORD_COUNT % BITS_PER_WORD );
+    }
 
     Blk allocate( size_t size ) noexcept
     {
-        size_t rounded_size = _round_to_aligned( size );
-        size_t bitlen = rounded_size / ALIGNMENT;
+        size_t bitlen = _round_to_aligned( size ) / ALIGNMENT;
+        if ( bitlen == 0 || bitlen > BLOCK_COUNT )
+            return { nullptr, size };
 
-        for ( size_t pos = 0; pos < SIZE - rounded_size; )
-        {
-            if ( _checkRange( pos, bitlen, false, &pos ) )
-            {
-                _setRange( pos, bitlen, true );
-                #ifdef _DEBUG
-                std::memset( memory + pos, 0xbb, size );
-                #endif
-                return { memory + pos, size };
-            }
-        }
-        return { nullptr, size };
+        size_t pos = _findFree( bitlen );
+        if ( pos == BLOCK_COUNT )
+            return { nullptr, size };
+
+        _setRange( pos, bitlen, true );
+        #ifdef _DEBUG
+        std::memset( memory + pos * ALIGNMENT, 0xbb, size );
+        #endif
+        return { memory + pos * ALIGNMENT, size };
     }
 
     void deallocate( Blk blk ) noexcept
@@ -339,9 +733,9 @@ public:
         #ifdef _DEBUG
         blk.set( 0xdd );
         #endif
-        size_t pos = (byte*) blk.ptr - memory;
+        size_t pos = ((byte*) blk.ptr - memory) / ALIGNMENT;
         size_t bitlen = _round_to_aligned( blk.size ) / ALIGNMENT;
-        //assert( _checkRange( pos, bitlen, true ) );
+        assert( _checkRange( pos, bitlen, true ) );
         _setRange( pos, bitlen, false );
     }
 
@@ -350,101 +744,462 @@ public:
         return memory <= ptr && ptr < memory + SIZE;
     }
 
-private:
+    // Over-allocates by align - ALIGNMENT bytes then releases the units
+    // before and after the aligned block.
+    Blk alignedAllocate( size_t size, size_t align ) noexcept
+    {
+        if ( align <= ALIGNMENT )
+            return allocate( size );
+
+        size_t slack = align / ALIGNMENT - 1;
+        size_t bitlen = _round_to_aligned( size ) / ALIGNMENT;
+        if ( bitlen == 0 || bitlen + slack > BLOCK_COUNT )
+            return { nullptr, size };
+
+        size_t pos = _findFree( bitlen + slack );
+        if ( pos == BLOCK_COUNT )
+            return { nullptr, size };
+
+        byte* first = memory + pos * ALIGNMENT;
+        size_t lead = (round_to_alignment( uintptr_t( first ), align ) - uintptr_t( first )) / ALIGNMENT;
+        _setRange( pos + lead, bitlen, true );
+        return { first + lead * ALIGNMENT, size };
+    }
 
-    // Sets a range in the bitset to bit.
-    void _setRange( size_t pos, size_t len, bool bit ) noexcept
+    // Succeeds if the units following blk are free.
+    bool expand( Blk& blk, size_t delta ) noexcept
     {
-        Word* pWord0 = &bitset[ pos / BITS_PER_WORD ];
-        size_t idx0 = pos % BITS_PER_WORD;
+        size_t end = _end( blk );
+        size_t newEnd = ((byte*) blk.ptr - memory + _round_to_aligned( blk.size + delta )) / ALIGNMENT;
 
-        Word* pWord1 = &bitset[ (pos + len) / BITS_PER_WORD ];
-        size_t idx1 = BITS_PER_WORD - (pos + len) % BITS_PER_WORD;
+        if ( newEnd > BLOCK_COUNT || !_checkRange( end, newEnd - end, false ) )
+            return false;
 
-        for ( Word* pWord = pWord0; pWord <= pWord1; ++pWord )
+        _setRange( end, newEnd - end, true );
+        blk.size += delta;
+        return true;
+    }
+
+    // Shrinks by releasing the tail units, grows in place where possible,
+    // and otherwise moves the block.
+    bool reallocate( Blk& blk, size_t size ) noexcept
+    {
+        if ( !blk.ptr || size == 0 )
+        {
+            deallocate( blk );
+            blk = size ? allocate( size ) : Blk( nullptr );
+            return blk.ptr || size == 0;
+        }
+
+        if ( size <= blk.size )
         {
-            Word mask = ~0;
+            size_t newEnd = ((byte*) blk.ptr - memory + _round_to_aligned( size )) / ALIGNMENT;
+            _setRange( newEnd, _end( blk ) - newEnd, false );
+            blk.size = size;
+            return true;
+        }
 
-            if ( pWord == pWord0 )
-                mask = mask >> idx0 << idx0;
+        if ( expand( blk, size - blk.size ) )
+            return true;
 
-            if ( pWord == pWord1 )
-                mask = mask << idx1 >> idx1;
+        Blk result = allocate( size );
+        if ( !result.ptr )
+            return false;
 
-            if ( bit )
-                *pWord |= mask;
-            else
-                *pWord &= ~mask;
-        }
+        std::memcpy( result.ptr, blk.ptr, blk.size );
+        deallocate( blk );
+        blk = result;
+        return true;
     }
 
-    // Returns true if all bits in the range in bitset are equal to bit.
-    // Otherwise, sets outpos to the index of the first failing bit and
-    // returns false.
-    bool _checkRange( size_t pos, size_t len, bool bit,
-                      size_t* outpos = nullptr ) const noexcept
+    // Returns the number of bytes currently allocated (rounded to ALIGNMENT).
+    size_t used() const noexcept
+    {
+        size_t bits = 0;
+        for ( Word word : bitset )
+            bits += popcount( word );
+        return (bits - (WORD_COUNT * BITS_PER_WORD - BLOCK_COUNT)) * ALIGNMENT;
+    }
+
+protected:
+
+    // Returns the index of the unit following blk.
+    size_t _end( const Blk& blk ) const noexcept
     {
-        const Word* pWord0 = &bitset[ pos / BITS_PER_WORD ];
-        size_t idx0 = pos % BITS_PER_WORD;
+        return ((byte*) blk.ptr - memory + _round_to_aligned( blk.size )) / ALIGNMENT;
+    }
 
-        const Word* pWord1 = &bitset[ (pos + len) / BITS_PER_WORD ];
-        size_t idx1 = BITS_PER_WORD - (pos + len) % BITS_PER_WORD;
+    // Sets a word in the bitset and updates its summary bit.
+    void _setWord( size_t idx, Word word ) noexcept
+    {
+        bitset[ idx ] = word;
 
-        for ( const Word* pWord = pWord0; pWord <= pWord1; ++pWord )
+        Word bit = Word( 1 ) << (idx % BITS_PER_WORD);
+        if ( word == ~Word( 0 ) )
+            summary[ idx / BITS_PER_WORD ] |= bit;
+        else
+            summary[ idx / BITS_PER_WORD ] &= ~bit;
+    }
+
+    // Returns the index of the first word at or after idx which is not
+    // full; or WORD_COUNT if there is none.
+    size_t _nextOpenWord( size_t idx ) const noexcept
+    {
+        if ( idx >= WORD_COUNT )
+            return WORD_COUNT;
+
+        size_t sidx = idx / BITS_PER_WORD;
+        Word open = ~summary[ sidx ] & ~low_bits( idx % BITS_PER_WORD );
+
+        while ( open == 0 )
         {
-            Word mask = ~0;
+            if ( ++sidx == SUMMARY_COUNT )
+                return WORD_COUNT;
+            open = ~summary[ sidx ];
+        }
+        return std::min( sidx * BITS_PER_WORD + count_trailing_zeros( open ), WORD_COUNT );
+    }
 
-            if ( pWord == pWord0 )
-                mask = mask >> idx0 << idx0;
+    // Returns the position of the first run of len clear bits; or
+    // BLOCK_COUNT if there is none.
+    size_t _findFree( size_t len ) const noexcept
+    {
+        size_t runStart = 0; // Start of the clear run reaching the end of the previous word.
+        size_t runLen = 0;   // Length of that run.
 
-            if ( pWord == pWord1 )
-                mask = mask << idx1 >> idx1;
+        for ( size_t idx = _nextOpenWord( 0 ); idx < WORD_COUNT; )
+        {
+            Word used = bitset[ idx ];
+            size_t base = idx * BITS_PER_WORD;
 
-            if ( (*pWord & mask) != (bit ? mask : 0) )
+            // Extend the run carried over from the previous word.
+            if ( runLen > 0 )
             {
-                if ( outpos != nullptr )
+                size_t head = count_trailing_zeros( used );
+                if ( runLen + head >= len )
+                    return runStart;
+                if ( head == BITS_PER_WORD )
                 {
-                    size_t offset = _skip( *pWord, mask, bit ) * ALIGNMENT;
-                    size_t chunk = (pWord - bitset) * BITS_PER_WORD;
-                    *outpos = _round_to_aligned( chunk + offset );
+                    runLen += BITS_PER_WORD;
+                    ++idx;
+                    continue;
                 }
-                return false;
             }
+
+            // Look for a run which fits inside this word.
+            if ( len <= BITS_PER_WORD )
+            {
+                Word runs = find_runs( ~used, unsigned( len ) );
+                if ( runs != 0 )
+                    return base + count_trailing_zeros( runs );
+            }
+
+            // Start a new run from the clear bits at the top of this word.
+            size_t tail = count_leading_zeros( used );
+            runStart = base + BITS_PER_WORD - tail;
+            runLen = tail;
+
+            size_t next = _nextOpenWord( idx + 1 );
+            if ( next != idx + 1 )
+                runLen = 0; // Skipped a full word; the run is broken.
+            idx = next;
+        }
+        return BLOCK_COUNT;
+    }
+
+    // Sets a range in the bitset to bit.
+    void _setRange( size_t pos, size_t len, bool bit ) noexcept
+    {
+        size_t end = pos + len;
+
+        while ( pos < end )
+        {
+            size_t idx = pos / BITS_PER_WORD;
+            size_t lo = pos % BITS_PER_WORD;
+            size_t hi = std::min( end - idx * BITS_PER_WORD, BITS_PER_WORD );
+            Word mask = low_bits( unsigned( hi ) ) & ~low_bits( unsigned( lo ) );
+
+            _setWord( idx, bit ? bitset[ idx ] | mask : bitset[ idx ] & ~mask );
+            pos = idx * BITS_PER_WORD + hi;
+        }
+    }
+
+    // Returns true if all bits in the range in bitset are equal to bit.
+    bool _checkRange( size_t pos, size_t len, bool bit ) const noexcept
+    {
+        size_t end = pos + len;
+
+        while ( pos < end )
+        {
+            size_t idx = pos / BITS_PER_WORD;
+            size_t lo = pos % BITS_PER_WORD;
+            size_t hi = std::min( end - idx * BITS_PER_WORD, BITS_PER_WORD );
+            Word mask = low_bits( unsigned( hi ) ) & ~low_bits( unsigned( lo ) );
+
+            if ( (bitset[ idx ] & mask) != (bit ? mask : 0) )
+                return false;
+            pos = idx * BITS_PER_WORD + hi;
         }
         return true;
     }
 
-    static size_t _skip( Word word, Word mask, bool bit )
+    static constexpr size_t _round_to_aligned( size_t size )
+    {
+        return round_to_alignment( size, ALIGNMENT );
+    }
+};
+
+
+// Serves allocations of MinSize to MaxSize bytes from a singly linked list
+// of free nodes, each MaxSize bytes long. When the list runs dry, a batch
+// of BatchCount nodes is allocated from Parent and threaded onto the list.
+// Requests outside of the size range fail, so this can be composed with
+// ThresholdAllocator or FallbackAllocator. Batches are returned to Parent
+// only when the allocator is destroyed.
+template< class Parent, size_t MinSize, size_t MaxSize, size_t BatchCount = 32 >
+class FreelistAllocator
+{
+public:
+
+    static_assert( MinSize <= MaxSize, "FreelistAllocator: MinSize must not exceed MaxSize" );
+    static_assert( BatchCount > 0, "FreelistAllocator: BatchCount must be positive" );
+
+    static constexpr size_t MIN_SIZE = MinSize;
+    static constexpr size_t MAX_SIZE = MaxSize;
+    static constexpr size_t BATCH_COUNT = BatchCount;
+
+    // Size of each node (large enough to hold the free list link).
+    static constexpr size_t NODE_SIZE = round_to_alignment( std::max( MAX_SIZE, sizeof( void* ) ) );
+
+private:
+
+    struct Node
     {
-        size_t offset;
-        if ( bit ) {
-            offset =  _first_0( word & mask );    // Skip 1s
-            offset += _first_1( word >> offset ); // Skip 0s
-        } else {
-            offset =  _first_1( word & mask );    // Skip 0s
-            offset += _first_0( word >> offset ); // Skip 1s
+        Node* next;
+    };
+
+    // Header at the start of every block allocated from Parent.
+    struct Batch
+    {
+        Batch* next;
+        Blk    blk;
+    };
+
+    static constexpr size_t HEADER_SIZE = round_to_alignment( sizeof( Batch ) );
+    static constexpr size_t BATCH_SIZE = HEADER_SIZE + NODE_SIZE * BATCH_COUNT;
+
+    // Held as a member rather than a base so that Parent may also appear
+    // elsewhere in a composition, e.g. FallbackAllocator< Pool, Parent >.
+    Parent _parent;
+
+    Node*  _pFree = nullptr;    // Head of the free list.
+    Batch* _pBatches = nullptr; // Every batch allocated from Parent.
+
+    // Allocates a batch from Parent and threads its nodes onto the free list.
+    bool _refill()
+    {
+        Blk blk = _parent.allocate( BATCH_SIZE );
+        if ( !blk.ptr )
+            return false;
+
+        Batch* pBatch = new( blk.ptr ) Batch { _pBatches, blk };
+        _pBatches = pBatch;
+
+        byte* nodes = (byte*) blk.ptr + HEADER_SIZE;
+        for ( size_t i = BATCH_COUNT; i-- > 0; )
+            _pFree = new( nodes + i * NODE_SIZE ) Node { _pFree };
+        return true;
+    }
+
+public:
+
+    FreelistAllocator() = default;
+
+    FreelistAllocator( const FreelistAllocator& ) = delete;
+    FreelistAllocator& operator =( const FreelistAllocator& ) = delete;
+
+    // Returns every batch to Parent.
+    ~FreelistAllocator()
+    {
+        while ( _pBatches )
+        {
+            Batch* pBatch = _pBatches;
+            _pBatches = pBatch->next;
+            _parent.deallocate( pBatch->blk );
         }
-        return std::min( offset, BITS_PER_WORD );
     }
 
-    static size_t _first_1( Word word )
+    Blk allocate( size_t size )
     {
-        size_t pos = 0;
-        while ( !(word & 1) && ++pos < BITS_PER_WORD )
-            word >>= 1;
-        return pos;
+        if ( size < MIN_SIZE || size > MAX_SIZE )
+            return { nullptr, 0 };
+
+        if ( !_pFree && !_refill() )
+            return { nullptr, 0 };
+
+        Node* pNode = _pFree;
+        _pFree = pNode->next;
+        return { pNode, size };
     }
 
-    static size_t _first_0( Word word )
+    void deallocate( Blk blk )
     {
-        size_t pos = 0;
-        while ( (word & 1) && ++pos < BITS_PER_WORD )
-            word >>= 1;
-        return pos;
+        if ( blk.ptr == nullptr )
+            return;
+
+        assert( MIN_SIZE <= blk.size && blk.size <= MAX_SIZE );
+        assert( owns( blk.ptr ) );
+        _pFree = new( blk.ptr ) Node { _pFree };
     }
 
-    static constexpr size_t _round_to_aligned( size_t size )
+    // Succeeds while the block still fits in its node.
+    bool expand( Blk& blk, size_t delta )
     {
-        return round_to_alignment( size, ALIGNMENT );
+        if ( blk.size + delta > MAX_SIZE )
+            return false;
+
+        blk.size += delta;
+        return true;
+    }
+
+    // Resizes in place within [MIN_SIZE, MAX_SIZE]. Fails otherwise, so
+    // that a composite allocator can move the block elsewhere.
+    bool reallocate( Blk& blk, size_t size )
+    {
+        if ( !blk.ptr )
+        {
+            blk = allocate( size );
+            return blk.ptr || size == 0;
+        }
+
+        if ( size == 0 )
+        {
+            deallocate( blk );
+            blk = nullptr;
+            return true;
+        }
+
+        if ( size < MIN_SIZE || size > MAX_SIZE )
+            return false;
+
+        blk.size = size;
+        return true;
+    }
+
+    // Returns true if ptr lies in one of the batches. Takes O(batches).
+    bool owns( void* ptr ) const
+    {
+        for ( Batch* pBatch = _pBatches; pBatch; pBatch = pBatch->next )
+        {
+            byte* first = (byte*) pBatch + HEADER_SIZE;
+            if ( first <= ptr && ptr < first + NODE_SIZE * BATCH_COUNT )
+                return true;
+        }
+        return false;
+    }
+};
+
+
+namespace detail
+{
+    // Builds a chain of ThresholdAllocators with one FreelistAllocator per
+    // size class. Anything larger than the last size class fails.
+    template< class Parent, size_t BatchCount, size_t Min, size_t... Sizes >
+    struct pool_chain
+    {
+        using type = NullAllocator;
+    };
+
+    template< class Parent, size_t BatchCount, size_t Min, size_t Size, size_t... Sizes >
+    struct pool_chain< Parent, BatchCount, Min, Size, Sizes... >
+    {
+        static_assert( Min <= Size, "PoolAllocator: size classes must be increasing" );
+
+        using type = ThresholdAllocator< Size,
+            FreelistAllocator< Parent, Min, Size, BatchCount >,
+            typename pool_chain< Parent, BatchCount, Size + 1, Sizes... >::type >;
+    };
+}
+
+// Segregated storage allocator. Each of the SizeClasses (in increasing
+// order) is served by its own FreelistAllocator, each of which draws
+// batches of BatchCount nodes from Parent. A request is served by the
+// smallest size class which fits it; requests larger than the last size
+// class fail. For example:
+//     FallbackAllocator<
+//         PoolAllocator< Mallocator, 64, 16, 32, 64, 128, 256 >,
+//         Mallocator >
+template< class Parent, size_t BatchCount, size_t... SizeClasses >
+class PoolAllocator
+    : public detail::pool_chain< Parent, BatchCount, 0, SizeClasses... >::type
+{
+public:
+
+    static_assert( sizeof...(SizeClasses) > 0, "PoolAllocator: requires at least one size class" );
+
+    static constexpr size_t MAX_SIZE = std::max( { SizeClasses... } );
+};
+
+
+// Adapts a Blk allocator to the standard library allocator requirements so
+// that std containers can draw from it. Holds a pointer to the allocator,
+// which must outlive every container using the adapter.
+template< typename T, class Allocator >
+class StdAllocator
+{
+    template< typename U, class A >
+    friend class StdAllocator;
+
+    Allocator* _pAllocator;
+
+public:
+
+    using value_type = T;
+
+    template< typename U >
+    struct rebind
+    {
+        using other = StdAllocator< U, Allocator >;
+    };
+
+    StdAllocator( Allocator& allocator ) noexcept
+        : _pAllocator( &allocator )
+    {
+    }
+
+    template< typename U >
+    StdAllocator( const StdAllocator< U, Allocator >& other ) noexcept
+        : _pAllocator( other._pAllocator )
+    {
+    }
+
+    T* allocate( size_t count )
+    {
+        Blk blk = _pAllocator->allocate( count * sizeof( T ) );
+        if ( !blk.ptr )
+            throw std::bad_alloc();
+        return (T*) blk.ptr;
+    }
+
+    void deallocate( T* ptr, size_t count )
+    {
+        _pAllocator->deallocate( { ptr, count * sizeof( T ) } );
+    }
+
+    Allocator& allocator() const noexcept
+    {
+        return *_pAllocator;
+    }
+
+    template< typename U >
+    bool operator ==( const StdAllocator< U, Allocator >& other ) const noexcept
+    {
+        return _pAllocator == other._pAllocator;
+    }
+
+    template< typename U >
+    bool operator !=( const StdAllocator< U, Allocator >& other ) const noexcept
+    {
+        return _pAllocator != other._pAllocator;
     }
 };
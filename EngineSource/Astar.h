@@ -2,6 +2,7 @@
 
 #include "Dictionary.h"
 #include "HashMap.h"
+#include "StatsAllocator.h"
 #include "Util.h"
 
 #include <vector>
@@ -23,6 +24,9 @@ public:
     using NodeRef = std::reference_wrapper< Node >;
     using NodeArray = std::vector< NodeRef >;
 
+    // Working sets of a search, counted as pathfinding memory.
+    using NodeSet = std::vector< NodeRef, StatsStdAllocator< NodeRef, AllocTag::Pathfinding > >;
+
     using DistType = DistanceType;
 
     template< typename T >
@@ -48,8 +52,8 @@ public:
         // Fair initial capacity reduces reallocations for map.
         //const int initial_capacity = std::sqrt( sizeHint );
 
-        NodeArray closed_set;
-        NodeArray open_set = { start };
+        NodeSet closed_set;
+        NodeSet open_set = { start };
         NodeMap< Node* > came_from( initial_capacity * 4 );
 
         // For each node, the cost of getting from the start node to that node.
@@ -103,7 +107,7 @@ public:
 
 private:
 
-    static bool _contains( NodeArray& lst, Node& node )
+    static bool _contains( NodeSet& lst, Node& node )
     {
         for ( Node& n : lst )
             if ( &n == &node )
@@ -113,7 +117,7 @@ private:
 
     // Finds the cheapest node in the open set
     static Node& _find_cheapest(
-        NodeArray&           open_set,
+        NodeSet&             open_set,
         NodeMap< DistType >& f_score )
     {
         NodeRef cheapest = open_set[ 0 ];
@@ -158,7 +162,8 @@ auto find_path(
     int           sizeHint = 10 )
 {
     using DistType = decltype( fnEstimate( start, goal ) );
-    return AStar< Node, DistType, HashMap >::find_path(
+    using Alloc = StatsStdAllocator< char, AllocTag::Pathfinding >;
+    return AStar< Node, DistType, HashMap, std::hash< std::reference_wrapper< Node > >, Alloc >::find_path(
         start, goal,
         forward< EstimateFn >( fnEstimate ),
         forward< NodeCostFn >( fnNodeCost ),
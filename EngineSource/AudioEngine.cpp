@@ -1,5 +1,6 @@
 
 #include "AudioEngine.h"
+#include "StatsAllocator.h"
 
 #include <SDL/SDL.h>
 
@@ -20,11 +21,15 @@ struct Implementation
 
     int mnNextChannelId;
 
-    typedef std::map<std::string, FMOD::Sound*> SoundMap;
-    typedef std::map<int, FMOD::Channel*> ChannelMap;
-    typedef std::map<std::string, FMOD::Studio::EventInstance*> EventMap;
-    typedef std::map<std::string, FMOD::Studio::Bank*> BankMap;
-	typedef std::map<std::string, FMOD::Studio::EventInstance*> DupEventMap;
+    // Maps counted as audio memory in the allocation report.
+    template<typename K, typename V>
+    using Map = std::map<K, V, std::less<K>, StatsStdAllocator<std::pair<const K, V>, AllocTag::Audio>>;
+
+    typedef Map<std::string, FMOD::Sound*> SoundMap;
+    typedef Map<int, FMOD::Channel*> ChannelMap;
+    typedef Map<std::string, FMOD::Studio::EventInstance*> EventMap;
+    typedef Map<std::string, FMOD::Studio::Bank*> BankMap;
+	typedef Map<std::string, FMOD::Studio::EventInstance*> DupEventMap;
 
     BankMap mBanks;
     EventMap mEvents;
@@ -84,7 +89,7 @@ Implementation::~Implementation() {
 }
 
 void Implementation::Update() {
-	std::vector<ChannelMap::iterator> pStoppedChannels;
+	std::vector<ChannelMap::iterator, StatsStdAllocator<ChannelMap::iterator, AllocTag::Audio>> pStoppedChannels;
 
 	//iterate through the channels,
 	for (auto it = mChannels.begin(), itEnd = mChannels.end(); it != itEnd; ++it)
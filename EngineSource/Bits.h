@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Bit scanning helpers for 64-bit words. On MSVC these compile to
+// bsf/bsr/popcnt; elsewhere to the equivalent compiler builtins.
+// Unlike the raw instructions, all of them are defined for 0.
+
+// Returns the number of 0 bits below the lowest 1 bit; or 64 if word is 0.
+inline unsigned count_trailing_zeros( uint64_t word )
+{
+    if ( word == 0 )
+        return 64;
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward64( &idx, word );
+    return unsigned( idx );
+#else
+    return unsigned( __builtin_ctzll( word ) );
+#endif
+}
+
+// Returns the number of 0 bits above the highest 1 bit; or 64 if word is 0.
+inline unsigned count_leading_zeros( uint64_t word )
+{
+    if ( word == 0 )
+        return 64;
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse64( &idx, word );
+    return 63 - unsigned( idx );
+#else
+    return unsigned( __builtin_clzll( word ) );
+#endif
+}
+
+// Returns the number of 1 bits in word.
+inline unsigned popcount( uint64_t word )
+{
+#ifdef _MSC_VER
+    return unsigned( __popcnt64( word ) );
+#else
+    return unsigned( __builtin_popcountll( word ) );
+#endif
+}
+
+// Returns a word with the lowest count bits set. Count may be 0 to 64.
+constexpr uint64_t low_bits( unsigned count )
+{
+    return count >= 64 ? ~uint64_t( 0 ) : (uint64_t( 1 ) << count) - 1;
+}
+
+// Returns a word with bit i set wherever bits i to i + len - 1 of word are
+// all set (1 <= len <= 64). Runs which would cross the top of the word are
+// not reported. Takes O(log len) shifts.
+inline uint64_t find_runs( uint64_t word, unsigned len )
+{
+    unsigned remaining = len - 1;
+    for ( unsigned shift = 1; remaining > 0 && word != 0; shift *= 2 )
+    {
+        unsigned s = shift < remaining ? shift : remaining;
+        word &= word >> s;
+        remaining -= s;
+    }
+    return word;
+}
+
+// Spreads the low 16 bits of word out to the even bits.
+constexpr uint32_t spread_bits( uint32_t word )
+{
+    word &= 0x0000FFFF;
+    word = (word | (word << 8)) & 0x00FF00FF;
+    word = (word | (word << 4)) & 0x0F0F0F0F;
+    word = (word | (word << 2)) & 0x33333333;
+    word = (word | (word << 1)) & 0x55555555;
+    return word;
+}
+
+// Returns the Morton code of x and y: bit i of x at bit 2i and bit i of y
+// at bit 2i + 1. Only the low 16 bits of each are used.
+constexpr uint32_t interleave_bits( uint32_t x, uint32_t y )
+{
+    return spread_bits( x ) | (spread_bits( y ) << 1);
+}
@@ -0,0 +1,256 @@
+// Andrew Meckling
+#pragma once
+
+#include "Allocators.h"
+#include "Bits.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+// Reference to a block owned by a CompactingBitsetAllocator. A default
+// constructed handle is null. Handles to freed blocks are detected by their
+// generation.
+struct MemHandle
+{
+    std::uint32_t index = 0;
+    std::uint32_t generation = 0;
+
+    explicit operator bool() const
+    {
+        return generation != 0;
+    }
+};
+
+inline bool operator ==( MemHandle lhs, MemHandle rhs )
+{
+    return lhs.index == rhs.index && lhs.generation == rhs.generation;
+}
+
+inline bool operator !=( MemHandle lhs, MemHandle rhs )
+{
+    return !(lhs == rhs);
+}
+
+
+// BitsetAllocator whose blocks are referenced through handles so that they
+// can be moved. compact() slides live blocks down into the holes left by
+// freed ones, a bounded number of bytes per call, so that running it once a
+// frame keeps the free space in one piece and large requests keep fitting.
+// Pointers returned by get() are only valid until the next compact().
+// Every block is preceded by one ALIGNMENT sized header holding the index
+// of its handle, which is how compact() finds the handle of a block.
+template< size_t Bytes, size_t Align = sizeof( void* ), size_t MaxHandles = 1024 >
+class CompactingBitsetAllocator
+    : protected BitsetAllocator< Bytes, Align >
+{
+    using B = BitsetAllocator< Bytes, Align >;
+
+public:
+
+    static_assert( Align >= sizeof( std::uint32_t ), "CompactingBitsetAllocator: Align too small for the block header" );
+    static_assert( MaxHandles < UINT32_MAX, "CompactingBitsetAllocator: too many handles" );
+
+    using B::SIZE;
+    using B::ALIGNMENT;
+    using B::BLOCK_COUNT;
+    using B::used;
+
+    static constexpr size_t MAX_HANDLES = MaxHandles;
+
+private:
+
+    using Word = typename B::Word;
+    using B::BITS_PER_WORD;
+    using B::WORD_COUNT;
+
+    static constexpr std::uint32_t NO_ENTRY = UINT32_MAX;
+
+    struct Entry
+    {
+        std::uint32_t pos;        // First unit of the block (its header).
+        std::uint32_t size;       // Requested size in bytes.
+        std::uint32_t generation; // Odd while the entry is in use.
+        std::uint32_t nextFree;   // Next entry in the free list.
+    };
+
+    Entry _entries[ MAX_HANDLES ];
+    std::uint32_t _freeEntry = 0; // Head of the free entry list.
+    size_t _cursor = 0;           // Unit where the next compact() starts.
+
+    // Returns the number of units a block of size bytes occupies.
+    static constexpr size_t _units( size_t size )
+    {
+        return 1 + B::_round_to_aligned( size ) / ALIGNMENT;
+    }
+
+    // Returns the first used unit at or after pos; or BLOCK_COUNT.
+    size_t _nextUsed( size_t pos ) const noexcept
+    {
+        size_t idx = pos / BITS_PER_WORD;
+        if ( idx >= WORD_COUNT )
+            return BLOCK_COUNT;
+
+        Word used = B::bitset[ idx ] & ~low_bits( pos % BITS_PER_WORD );
+        while ( used == 0 )
+        {
+            if ( ++idx == WORD_COUNT )
+                return BLOCK_COUNT;
+            used = B::bitset[ idx ];
+        }
+        return std::min( idx * BITS_PER_WORD + count_trailing_zeros( used ), BLOCK_COUNT );
+    }
+
+    // Returns the first free unit at or after pos; or BLOCK_COUNT.
+    size_t _nextFree( size_t pos ) const noexcept
+    {
+        size_t idx = B::_nextOpenWord( pos / BITS_PER_WORD );
+        if ( idx == WORD_COUNT )
+            return BLOCK_COUNT;
+
+        Word open = ~B::bitset[ idx ];
+        if ( idx == pos / BITS_PER_WORD )
+            open &= ~low_bits( pos % BITS_PER_WORD );
+
+        while ( open == 0 )
+        {
+            if ( (idx = B::_nextOpenWord( idx + 1 )) == WORD_COUNT )
+                return BLOCK_COUNT;
+            open = ~B::bitset[ idx ];
+        }
+        return std::min( idx * BITS_PER_WORD + count_trailing_zeros( open ), BLOCK_COUNT );
+    }
+
+    byte* _unit( size_t pos )
+    {
+        return B::memory + pos * ALIGNMENT;
+    }
+
+    Entry* _entry( MemHandle handle )
+    {
+        return valid( handle ) ? &_entries[ handle.index ] : nullptr;
+    }
+
+public:
+
+    CompactingBitsetAllocator() noexcept
+    {
+        for ( std::uint32_t i = 0; i < MAX_HANDLES; ++i )
+            _entries[ i ] = { 0, 0, 0, i + 1 < MAX_HANDLES ? i + 1 : NO_ENTRY };
+    }
+
+    CompactingBitsetAllocator( const CompactingBitsetAllocator& ) = delete;
+    CompactingBitsetAllocator& operator =( const CompactingBitsetAllocator& ) = delete;
+
+    // Returns a null handle if there is no room or no free handle.
+    MemHandle allocate( size_t size ) noexcept
+    {
+        if ( _freeEntry == NO_ENTRY || size > UINT32_MAX )
+            return {};
+
+        Blk blk = B::allocate( _units( size ) * ALIGNMENT );
+        if ( !blk.ptr )
+            return {};
+
+        std::uint32_t index = _freeEntry;
+        Entry& entry = _entries[ index ];
+        _freeEntry = entry.nextFree;
+
+        entry.pos = std::uint32_t( ((byte*) blk.ptr - B::memory) / ALIGNMENT );
+        entry.size = std::uint32_t( size );
+        ++entry.generation;
+        std::memcpy( blk.ptr, &index, sizeof( index ) );
+
+        return { index, entry.generation };
+    }
+
+    // Frees the block referenced by handle. Null handles are ignored.
+    void deallocate( MemHandle handle ) noexcept
+    {
+        Entry* pEntry = _entry( handle );
+        if ( pEntry == nullptr )
+            return;
+
+        B::deallocate( { _unit( pEntry->pos ), _units( pEntry->size ) * ALIGNMENT } );
+
+        ++pEntry->generation;
+        pEntry->nextFree = _freeEntry;
+        _freeEntry = handle.index;
+    }
+
+    // Returns true if handle refers to a live block.
+    bool valid( MemHandle handle ) const noexcept
+    {
+        return handle.generation % 2 == 1 && handle.index < MAX_HANDLES
+            && _entries[ handle.index ].generation == handle.generation;
+    }
+
+    // Returns the block referenced by handle, or null if it has been freed.
+    // The pointer is invalidated by compact().
+    void* get( MemHandle handle ) noexcept
+    {
+        Entry* pEntry = _entry( handle );
+        return pEntry ? _unit( pEntry->pos + 1 ) : nullptr;
+    }
+
+    template< typename T >
+    T* get( MemHandle handle ) noexcept
+    {
+        return (T*) get( handle );
+    }
+
+    // Returns the size of the block referenced by handle.
+    size_t size( MemHandle handle ) noexcept
+    {
+        Entry* pEntry = _entry( handle );
+        return pEntry ? pEntry->size : 0;
+    }
+
+    // Moves live blocks down into free space until about maxBytes have been
+    // moved. At least one block is moved if any can be, so the bound may be
+    // exceeded by up to one block. Picks up where the last call stopped and
+    // starts over once it reaches the end. Returns the number of bytes moved.
+    size_t compact( size_t maxBytes ) noexcept
+    {
+        size_t moved = 0;
+
+        for ( ;; )
+        {
+            size_t hole = _nextFree( _cursor );
+            size_t pos = _nextUsed( hole );
+            if ( pos == BLOCK_COUNT )
+            {
+                _cursor = 0; // Reached the end; start over next time.
+                break;
+            }
+
+            std::uint32_t index;
+            std::memcpy( &index, _unit( pos ), sizeof( index ) );
+            Entry& entry = _entries[ index ];
+            assert( entry.pos == pos );
+
+            size_t len = _units( entry.size );
+            if ( moved > 0 && moved + len * ALIGNMENT > maxBytes )
+            {
+                _cursor = hole;
+                break;
+            }
+
+            std::memmove( _unit( hole ), _unit( pos ), len * ALIGNMENT );
+            B::_setRange( pos, len, false );
+            B::_setRange( hole, len, true );
+            entry.pos = std::uint32_t( hole );
+
+            moved += len * ALIGNMENT;
+            _cursor = hole + len;
+        }
+        return moved;
+    }
+
+    // Moves every live block down so that all free space is at the end.
+    void compact() noexcept
+    {
+        _cursor = 0;
+        compact( SIZE );
+    }
+};
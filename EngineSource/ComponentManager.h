@@ -2,6 +2,7 @@
 
 #include "Util.h"
 #include "LocalVector.h"
+#include "Search.h"
 
 #include <array>
 #include <bitset>
@@ -281,7 +282,7 @@ private:
     Eid _addEntity( Eid eid )
     {
         assert( in_range( eid, 0, CAPACITY ) );
-        _entities.insert( binary_search2( _entities, eid ), eid );
+        _entities.insert( sorted_lower_bound( _entities, eid ), eid );
         return eid;
     }
 
@@ -291,7 +292,7 @@ private:
         if ( in_range( eid, 0, CAPACITY ) )
         {
             _metadata[ eid ].reset();
-            _entities.remove( binary_search( _entities, eid ) );
+            _entities.remove( sorted_find( _entities, eid ) );
         }
     }
 
@@ -301,7 +302,7 @@ public:
     bool exists( Eid eid ) const
     {
         assert( in_range( eid, 0, CAPACITY ) );
-        return std::find( _entities.begin(), _entities.end(), eid ) != _entities.end();
+        return sorted_find( _entities, eid ) != _entities.end();
     }
 
     // Generates and returns a new entity with no attached components.
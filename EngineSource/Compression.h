@@ -0,0 +1,205 @@
+// Andrew Meckling
+#pragma once
+
+#include "Memory.h"
+
+#include <cstdint>
+#include <cstring>
+
+// Block compression in the LZ4 block format: a sequence of runs of
+// literals, each followed by a copy of at least 4 bytes from up to 64KiB
+// back. Matches are found with a single probe of a small hash table, so
+// compression runs at hundreds of MB/s and decompression at close to
+// memcpy speed. Blocks of repetitive data (such as tile maps) shrink a lot.
+
+namespace lz_detail
+{
+    constexpr size_t MIN_MATCH = 4;
+    constexpr size_t LAST_LITERALS = 5;  // The last bytes are always literals.
+    constexpr size_t MATCH_LIMIT = 12;   // No match starts in the last bytes.
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr int    HASH_BITS = 12;
+
+    inline uint32_t read32( const byte* p )
+    {
+        uint32_t value;
+        std::memcpy( &value, p, sizeof( value ) );
+        return value;
+    }
+
+    inline uint32_t hash( uint32_t value )
+    {
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // Writes the part of a length which does not fit in its token nibble.
+    inline byte* write_length( byte* op, size_t length )
+    {
+        for ( ; length >= 255; length -= 255 )
+            *op++ = 255;
+        *op++ = byte( length );
+        return op;
+    }
+
+    // Reads the part of a length which did not fit in its token nibble.
+    inline bool read_length( const byte*& ip, const byte* end, size_t& length )
+    {
+        byte b;
+        do
+        {
+            if ( ip == end )
+                return false;
+            length += b = *ip++;
+        }
+        while ( b == 255 );
+        return true;
+    }
+
+    // Writes a run of literals followed by a match of length bytes at
+    // offset; or just the literals if length is 0.
+    inline byte* write_sequence( byte* op, const byte* literals, size_t literalCount,
+                                 size_t offset, size_t length )
+    {
+        byte* pToken = op++;
+        *pToken = byte( std::min< size_t >( literalCount, 15 ) << 4 );
+        if ( literalCount >= 15 )
+            op = write_length( op, literalCount - 15 );
+
+        if ( literalCount > 0 )
+            std::memcpy( op, literals, literalCount );
+        op += literalCount;
+
+        if ( length == 0 )
+            return op;
+
+        *op++ = byte( offset );
+        *op++ = byte( offset >> 8 );
+
+        length -= MIN_MATCH;
+        *pToken |= byte( std::min< size_t >( length, 15 ) );
+        if ( length >= 15 )
+            op = write_length( op, length - 15 );
+        return op;
+    }
+}
+
+// Returns the largest size lz_compress can produce from size bytes.
+constexpr size_t lz_compress_bound( size_t size )
+{
+    return size + size / 255 + 16;
+}
+
+// Compresses size bytes of src into dst, which must hold at least
+// lz_compress_bound( size ) bytes. Returns the compressed size.
+inline size_t lz_compress( const void* src, size_t size, void* dst )
+{
+    using namespace lz_detail;
+
+    const byte* const begin = (const byte*) src;
+    const byte* const end = begin + size;
+    const byte* ip = begin;
+    const byte* anchor = begin;
+    byte* op = (byte*) dst;
+
+    if ( size > MATCH_LIMIT )
+    {
+        // Positions are kept relative to the start of the block, so very
+        // large blocks only lose matches; the output stays valid.
+        uint32_t table[ 1 << HASH_BITS ] = {};
+        const byte* const matchLimit = end - MATCH_LIMIT;
+        const byte* const copyLimit = end - LAST_LITERALS;
+        unsigned misses = 0;
+
+        while ( ip < matchLimit )
+        {
+            uint32_t value = read32( ip );
+            uint32_t& entry = table[ hash( value ) ];
+            const byte* ref = begin + entry;
+            entry = uint32_t( ip - begin );
+
+            if ( ref >= ip || size_t( ip - ref ) > MAX_OFFSET || read32( ref ) != value )
+            {
+                // Step further through data which does not compress.
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            while ( ip > anchor && ref > begin && ip[ -1 ] == ref[ -1 ] )
+                --ip, --ref;
+
+            size_t length = MIN_MATCH;
+            while ( ip + length < copyLimit && ip[ length ] == ref[ length ] )
+                ++length;
+
+            op = write_sequence( op, anchor, ip - anchor, ip - ref, length );
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence( op, anchor, end - anchor, 0, 0 );
+    return op - (byte*) dst;
+}
+
+// Decompresses size bytes of src into exactly dstSize bytes of dst. Returns
+// false if the data is malformed or does not decompress to dstSize bytes.
+inline bool lz_decompress( const void* src, size_t size, void* dst, size_t dstSize )
+{
+    using namespace lz_detail;
+
+    const byte* ip = (const byte*) src;
+    const byte* const end = ip + size;
+    byte* const begin = (byte*) dst;
+    byte* op = begin;
+    byte* const dstEnd = begin + dstSize;
+
+    while ( ip < end )
+    {
+        byte token = *ip++;
+
+        size_t literalCount = token >> 4;
+        if ( literalCount == 15 && !read_length( ip, end, literalCount ) )
+            return false;
+
+        if ( literalCount > size_t( end - ip ) || literalCount > size_t( dstEnd - op ) )
+            return false;
+
+        std::memcpy( op, ip, literalCount );
+        ip += literalCount;
+        op += literalCount;
+
+        // The last sequence has no match.
+        if ( ip == end )
+            break;
+
+        if ( end - ip < 2 )
+            return false;
+
+        size_t offset = ip[ 0 ] | (ip[ 1 ] << 8);
+        ip += 2;
+        if ( offset == 0 || offset > size_t( op - begin ) )
+            return false;
+
+        size_t length = token & 15;
+        if ( length == 15 && !read_length( ip, end, length ) )
+            return false;
+        length += MIN_MATCH;
+
+        if ( length > size_t( dstEnd - op ) )
+            return false;
+
+        // The match may overlap the output; the copyable span doubles
+        // with each copy.
+        const byte* match = op - offset;
+        while ( length > 0 )
+        {
+            size_t count = std::min( length, size_t( op - match ) );
+            std::memcpy( op, match, count );
+            op += count;
+            length -= count;
+        }
+    }
+
+    return op == dstEnd;
+}
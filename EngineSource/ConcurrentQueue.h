@@ -0,0 +1,385 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Size of a cache line in bytes. Shared counters are padded to this size so
+// the producer and consumer sides never write to the same line.
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// A bounded lock-free ring buffer for exactly one producer thread and
+// exactly one consumer thread. Capacity must be a power of 2. Each side keeps
+// a private copy of the other side's index and only reloads the shared one
+// when the copy says the queue is full (or empty), which keeps cache-line
+// traffic to a minimum.
+template< typename T, size_t Capacity >
+class SpscQueue
+{
+public:
+
+    static_assert( Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                   "SpscQueue: Capacity must be a power of 2" );
+
+    using ValueType = T;
+    static constexpr size_t CAPACITY = Capacity;
+
+private:
+
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    // Consumer side.
+    alignas( CACHE_LINE_SIZE ) std::atomic< size_t > _head; // Next slot to pop.
+    size_t _tailCache;                                      // Last tail seen by the consumer.
+
+    // Producer side.
+    alignas( CACHE_LINE_SIZE ) std::atomic< size_t > _tail; // Next slot to push.
+    size_t _headCache;                                      // Last head seen by the producer.
+
+    alignas( CACHE_LINE_SIZE ) std::aligned_storage_t< sizeof( T ), alignof( T ) > _slots[ CAPACITY ];
+
+    T* _slot( size_t pos )
+    {
+        return reinterpret_cast< T* >( &_slots[ pos & MASK ] );
+    }
+
+    // Returns the number of slots the producer may write, reloading the
+    // shared head only when the cached copy is exhausted.
+    size_t _writable( size_t tail, size_t wanted )
+    {
+        size_t free = CAPACITY - (tail - _headCache);
+        if ( free < wanted )
+        {
+            _headCache = _head.load( std::memory_order_acquire );
+            free = CAPACITY - (tail - _headCache);
+        }
+        return free;
+    }
+
+    // Returns the number of slots the consumer may read, reloading the
+    // shared tail only when the cached copy is exhausted.
+    size_t _readable( size_t head, size_t wanted )
+    {
+        size_t used = _tailCache - head;
+        if ( used < wanted )
+        {
+            _tailCache = _tail.load( std::memory_order_acquire );
+            used = _tailCache - head;
+        }
+        return used;
+    }
+
+public:
+
+    SpscQueue()
+        : _head( 0 )
+        , _tailCache( 0 )
+        , _tail( 0 )
+        , _headCache( 0 )
+    {
+    }
+
+    SpscQueue( const SpscQueue& ) = delete;
+    SpscQueue& operator =( const SpscQueue& ) = delete;
+
+    // Destroys any elements which were never popped.
+    ~SpscQueue()
+    {
+        size_t tail = _tail.load( std::memory_order_relaxed );
+        for ( size_t pos = _head.load( std::memory_order_relaxed ); pos != tail; ++pos )
+            _slot( pos )->~T();
+    }
+
+    // Constructs an element at the back of the queue. Producer only.
+    // Returns false if the queue is full.
+    template< typename... Args >
+    bool tryEmplace( Args&&... args )
+    {
+        size_t tail = _tail.load( std::memory_order_relaxed );
+        if ( _writable( tail, 1 ) == 0 )
+            return false;
+
+        new( _slot( tail ) ) T( std::forward< Args >( args )... );
+        _tail.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Pushes a copy of value to the back of the queue. Producer only.
+    // Returns false if the queue is full.
+    bool tryPush( const T& value )
+    {
+        return tryEmplace( value );
+    }
+
+    // Moves value to the back of the queue. Producer only.
+    // Returns false if the queue is full.
+    bool tryPush( T&& value )
+    {
+        return tryEmplace( std::move( value ) );
+    }
+
+    // Pushes up to count values to the back of the queue and publishes them
+    // all at once. Producer only. Returns the number of values pushed.
+    size_t pushN( const T* values, size_t count )
+    {
+        size_t tail = _tail.load( std::memory_order_relaxed );
+        size_t n = std::min( count, _writable( tail, count ) );
+
+        for ( size_t i = 0; i < n; ++i )
+            new( _slot( tail + i ) ) T( values[ i ] );
+
+        if ( n > 0 )
+            _tail.store( tail + n, std::memory_order_release );
+        return n;
+    }
+
+    // Pops the front of the queue into out. Consumer only.
+    // Returns false if the queue is empty.
+    bool tryPop( T& out )
+    {
+        size_t head = _head.load( std::memory_order_relaxed );
+        if ( _readable( head, 1 ) == 0 )
+            return false;
+
+        T* pValue = _slot( head );
+        out = std::move( *pValue );
+        pValue->~T();
+        _head.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Pops up to count values from the front of the queue into out and
+    // releases their slots all at once. Consumer only. Returns the number
+    // of values popped.
+    size_t popN( T* out, size_t count )
+    {
+        size_t head = _head.load( std::memory_order_relaxed );
+        size_t n = std::min( count, _readable( head, count ) );
+
+        for ( size_t i = 0; i < n; ++i )
+        {
+            T* pValue = _slot( head + i );
+            out[ i ] = std::move( *pValue );
+            pValue->~T();
+        }
+
+        if ( n > 0 )
+            _head.store( head + n, std::memory_order_release );
+        return n;
+    }
+
+    // Returns the number of elements in the queue. Only exact when called
+    // while neither side is active.
+    size_t size() const
+    {
+        return _tail.load( std::memory_order_acquire )
+            - _head.load( std::memory_order_acquire );
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // Returns the maximum size of the queue.
+    size_t capacity() const
+    {
+        return CAPACITY;
+    }
+};
+
+
+// A bounded lock-free queue for any number of producer and consumer threads.
+// Capacity must be a power of 2. This is Dmitry Vyukov's bounded MPMC queue:
+// every slot carries a sequence number which tells a thread whether the slot
+// is ready to be written (sequence == pos) or read (sequence == pos + 1) in
+// the current lap around the ring. Threads claim positions with a single
+// compare-exchange on the shared enqueue or dequeue counter.
+template< typename T, size_t Capacity >
+class MpmcQueue
+{
+public:
+
+    static_assert( Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                   "MpmcQueue: Capacity must be a power of 2 (and at least 2)" );
+
+    using ValueType = T;
+    static constexpr size_t CAPACITY = Capacity;
+
+private:
+
+    static constexpr size_t MASK = CAPACITY - 1;
+
+    struct Cell
+    {
+        std::atomic< size_t > sequence;
+        std::aligned_storage_t< sizeof( T ), alignof( T ) > storage;
+
+        T* value()
+        {
+            return reinterpret_cast< T* >( &storage );
+        }
+    };
+
+    alignas( CACHE_LINE_SIZE ) std::atomic< size_t > _enqueuePos;
+    alignas( CACHE_LINE_SIZE ) std::atomic< size_t > _dequeuePos;
+    alignas( CACHE_LINE_SIZE ) Cell _cells[ CAPACITY ];
+
+    // Claims up to count consecutive positions from counter whose cells
+    // have the sequence number pos + i + lap. Returns the number of
+    // positions claimed and sets pos to the first of them.
+    size_t _claim( std::atomic< size_t >& counter, size_t& pos,
+                   size_t count, size_t lap )
+    {
+        pos = counter.load( std::memory_order_relaxed );
+        for ( ;; )
+        {
+            // Count how many cells starting at pos are ready this lap.
+            size_t n = 0;
+            for ( ; n < count; ++n )
+            {
+                size_t seq = _cells[ (pos + n) & MASK ].sequence.load( std::memory_order_acquire );
+                if ( seq != pos + n + lap )
+                    break;
+            }
+
+            if ( n == 0 )
+            {
+                // The first cell is not ready. If it lags behind pos the
+                // queue is full (or empty); otherwise another thread has
+                // already claimed pos and we reload the counter.
+                size_t seq = _cells[ pos & MASK ].sequence.load( std::memory_order_acquire );
+                if ( intptr_t( seq - (pos + lap) ) < 0 )
+                    return 0;
+
+                pos = counter.load( std::memory_order_relaxed );
+            }
+            else if ( counter.compare_exchange_weak( pos, pos + n, std::memory_order_relaxed ) )
+            {
+                return n;
+            }
+        }
+    }
+
+public:
+
+    MpmcQueue()
+        : _enqueuePos( 0 )
+        , _dequeuePos( 0 )
+    {
+        for ( size_t i = 0; i < CAPACITY; ++i )
+            _cells[ i ].sequence.store( i, std::memory_order_relaxed );
+    }
+
+    MpmcQueue( const MpmcQueue& ) = delete;
+    MpmcQueue& operator =( const MpmcQueue& ) = delete;
+
+    // Destroys any elements which were never popped.
+    ~MpmcQueue()
+    {
+        size_t tail = _enqueuePos.load( std::memory_order_relaxed );
+        for ( size_t pos = _dequeuePos.load( std::memory_order_relaxed ); pos != tail; ++pos )
+            _cells[ pos & MASK ].value()->~T();
+    }
+
+    // Constructs an element at the back of the queue.
+    // Returns false if the queue is full.
+    template< typename... Args >
+    bool tryEmplace( Args&&... args )
+    {
+        size_t pos;
+        if ( _claim( _enqueuePos, pos, 1, 0 ) == 0 )
+            return false;
+
+        Cell& cell = _cells[ pos & MASK ];
+        new( cell.value() ) T( std::forward< Args >( args )... );
+        cell.sequence.store( pos + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Pushes a copy of value to the back of the queue.
+    // Returns false if the queue is full.
+    bool tryPush( const T& value )
+    {
+        return tryEmplace( value );
+    }
+
+    // Moves value to the back of the queue.
+    // Returns false if the queue is full.
+    bool tryPush( T&& value )
+    {
+        return tryEmplace( std::move( value ) );
+    }
+
+    // Pushes up to count values to the back of the queue with a single
+    // claim on the enqueue counter. Returns the number of values pushed.
+    size_t pushN( const T* values, size_t count )
+    {
+        size_t pos;
+        size_t n = count > 0 ? _claim( _enqueuePos, pos, count, 0 ) : 0;
+
+        for ( size_t i = 0; i < n; ++i )
+        {
+            Cell& cell = _cells[ (pos + i) & MASK ];
+            new( cell.value() ) T( values[ i ] );
+            cell.sequence.store( pos + i + 1, std::memory_order_release );
+        }
+        return n;
+    }
+
+    // Pops the front of the queue into out.
+    // Returns false if the queue is empty.
+    bool tryPop( T& out )
+    {
+        size_t pos;
+        if ( _claim( _dequeuePos, pos, 1, 1 ) == 0 )
+            return false;
+
+        Cell& cell = _cells[ pos & MASK ];
+        out = std::move( *cell.value() );
+        cell.value()->~T();
+        cell.sequence.store( pos + CAPACITY, std::memory_order_release );
+        return true;
+    }
+
+    // Pops up to count values from the front of the queue into out with a
+    // single claim on the dequeue counter. Returns the number of values popped.
+    size_t popN( T* out, size_t count )
+    {
+        size_t pos;
+        size_t n = count > 0 ? _claim( _dequeuePos, pos, count, 1 ) : 0;
+
+        for ( size_t i = 0; i < n; ++i )
+        {
+            Cell& cell = _cells[ (pos + i) & MASK ];
+            out[ i ] = std::move( *cell.value() );
+            cell.value()->~T();
+            cell.sequence.store( pos + i + CAPACITY, std::memory_order_release );
+        }
+        return n;
+    }
+
+    // Returns the approximate number of elements in the queue.
+    size_t size() const
+    {
+        size_t tail = _enqueuePos.load( std::memory_order_acquire );
+        size_t head = _dequeuePos.load( std::memory_order_acquire );
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // Returns the maximum size of the queue.
+    size_t capacity() const
+    {
+        return CAPACITY;
+    }
+};
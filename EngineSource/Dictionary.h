@@ -1,6 +1,9 @@
 // Andrew Meckling
 #pragma once
 
+#include "Allocators.h"
+#include "Search.h"
+
 #include <algorithm>
 #include <initializer_list>
 
@@ -26,13 +29,18 @@ struct MapEntry
 // This is to allow key lookup to utilize a binary search. This 
 // dramatically improves lookup performance at the cost of insertion
 // /deletion performance.
-template< typename KeyType_, typename ValueType_ >
+// Memory comes from Allocator, which should be stateless or a handle to
+// shared state (such as ResourceAllocator) since it is copied and swapped
+// along with the entries.
+template< typename KeyType_, typename ValueType_, class Allocator_ = Mallocator >
 class Dictionary
+    : protected Allocator_
 {
 public:
 
     using KeyType   = KeyType_;
     using ValueType = ValueType_;
+    using Allocator = Allocator_;
 
     static constexpr size_t KEY_SIZE   = sizeof( KeyType );
     static constexpr size_t VALUE_SIZE = sizeof( ValueType );
@@ -46,20 +54,22 @@ public:
     using Entry           = MapEntry< KeyType, ValueType >;
     using InitializerListType = std::initializer_list< Entry >;
 
-    friend void std::swap( Dictionary& a, Dictionary& b );
-
 private:
 
     // Allocates a block of memory for the keys and values.
-    static void* _allocate( size_t capacity )
+    void* _allocate( size_t capacity )
     {
-        return new char[ (KEY_SIZE + VALUE_SIZE) * capacity ];
+        Blk blk = Allocator::allocate( (KEY_SIZE + VALUE_SIZE) * capacity );
+        if ( !blk.ptr && capacity > 0 )
+            throw "allocation failed";
+        return blk.ptr;
     }
 
     // Deallocates a block of memory used by the keys and values.
-    static void _deallocate( void* pData )
+    void _deallocate( void* pData, size_t capacity )
     {
-        delete[] pData;
+        if ( pData )
+            Allocator::deallocate( { pData, (KEY_SIZE + VALUE_SIZE) * capacity } );
     }
 
     void*  _pData;      // Pointer to the allocated memory.
@@ -113,8 +123,9 @@ public:
 
     // Allocates memory for the table of keys and values.
     // Default capacity is 12; capacity must be greater than 0.
-    explicit Dictionary( size_t capacity = 12 )
-        : _pData( _allocate( capacity ) )
+    explicit Dictionary( size_t capacity = 12, const Allocator& allocator = Allocator() )
+        : Allocator( allocator )
+        , _pData( _allocate( capacity ) )
         , _capacity( capacity )
         , _count( 0 )
     {
@@ -124,7 +135,7 @@ public:
     ~Dictionary()
     {
         clear();
-        _deallocate( _pData );
+        _deallocate( _pData, _capacity );
     }
 
     // Allocates memory for the supplied table, plus an optional amount of padding.
@@ -165,7 +176,7 @@ public:
 
     // Copies the contents of a map into the constructed map.
     Dictionary( const Dictionary& copy )
-        : Dictionary( copy._capacity )
+        : Dictionary( copy._capacity, copy.allocator() )
     {
         _count = copy._count;
         for ( size_t i = 0; i < copy._count; ++i )
@@ -174,7 +185,8 @@ public:
 
     // Moves the contents from a map into the constructed map.
     Dictionary( Dictionary&& move )
-        : _pData( move._pData )
+        : Allocator( move.allocator() )
+        , _pData( move._pData )
         , _capacity( move._capacity )
         , _count( move._count )
     {
@@ -189,7 +201,7 @@ public:
         if ( _capacity != copy._capacity )
         {
             clear();
-            _deallocate( _pData );
+            _deallocate( _pData, _capacity );
             _pData = _allocate( copy._capacity );
             _capacity = copy._capacity;
 
@@ -216,7 +228,22 @@ public:
     // Moves the contents from one map into another map.
     Dictionary& operator =( Dictionary&& move )
     {
-        std::swap( *this, move );
+        swap( move );
+        return *this;
+    }
+
+    // Exchanges the contents of two maps.
+    void swap( Dictionary& other )
+    {
+        std::swap( static_cast< Allocator& >( *this ), static_cast< Allocator& >( other ) );
+        std::swap( _pData, other._pData );
+        std::swap( _capacity, other._capacity );
+        std::swap( _count, other._count );
+    }
+
+    // Returns the allocator used by the map.
+    const Allocator& allocator() const
+    {
         return *this;
     }
 
@@ -274,23 +301,14 @@ public:
         return itr ? *itr : throw "key not found";
     }
 
-    // Performs a binary search over the keys.
+    // Performs a sorted search over the keys. On failure the returned
+    // iterator is null but still points to where the key would be inserted.
     Iterator search( KeyType key )
     {
-        const KeyType* lower = _pKeys;
-        const KeyType* upper = (_pKeys + _count) - 1;
-        const KeyType* mid   = _pKeys + (_count / 2);
+        const KeyType* pKey = sorted_lower_bound( _pKeys, _pKeys + _count, key );
+        bool found = pKey != _pKeys + _count && !(key < *pKey);
 
-        while ( lower <= upper )
-        {
-            if ( *mid < key ) lower = mid + 1;
-       else if ( key < *mid ) upper = mid - 1;
-            else return Iterator( this, mid );
-
-            mid = lower + (upper - lower) / 2;
-        }
-
-        return Iterator( nullptr, mid );
+        return Iterator( found ? this : nullptr, pKey );
     }
 
     // Performs a binary search over the keys.
@@ -353,10 +371,13 @@ private:
         if ( size == _capacity )
             return;
 
-        Dictionary tmp( size ); // Holder for old map data.
+        if ( size > _capacity && _expandSplit( size, splitPos, splitSize ) )
+            return;
+
+        Dictionary tmp( size, allocator() ); // Holder for old map data.
         tmp._count = std::min( _count, size );
 
-        std::swap( *this, tmp );
+        swap( tmp );
         // Pay careful attention when trying to understand the meaning
         // of the code after the swap.
 
@@ -374,6 +395,40 @@ private:
         // tmp's dtor cleans up old memory allocation.
     }
 
+    // Grows the allocation in place (see allocator_expand) then slides the
+    // values, and the keys after splitPos, up to their new positions.
+    // Only attempted for keys and values which can be moved with memmove.
+    // Returns false if the allocation could not be grown.
+    bool _expandSplit( size_t size, size_t splitPos, size_t splitSize )
+    {
+        if constexpr ( std::is_trivially_copyable< KeyType >::value
+                       && std::is_trivially_copyable< ValueType >::value )
+        {
+            Blk blk = { _pData, this->size() };
+            if ( !allocator_expand( static_cast< Allocator& >( *this ), blk,
+                                    (KEY_SIZE + VALUE_SIZE) * (size - _capacity) ) )
+                return false;
+
+            byte* pOldValues = (byte*) _pData + KEY_SIZE * _capacity;
+            byte* pNewValues = (byte*) _pData + KEY_SIZE * size;
+            size_t head = std::min( splitPos, _count );
+            size_t tail = _count - head;
+
+            // Values move first since the grown key array overlaps them.
+            std::memmove( pNewValues + VALUE_SIZE * (head + splitSize),
+                          pOldValues + VALUE_SIZE * head, VALUE_SIZE * tail );
+            std::memmove( pNewValues, pOldValues, VALUE_SIZE * head );
+            std::memmove( _pKeys + head + splitSize, _pKeys + head, KEY_SIZE * tail );
+
+            _capacity = size;
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
     // Inserts a key and a value at a specific index in the map.
     // Reallocates memory if necessary. Returns an iterator to the
     // newly inserted entry.
@@ -591,11 +646,9 @@ public:
 
 namespace std
 {
-    template< typename K, typename V >
-    void swap( Dictionary< K, V >& a, Dictionary< K, V >& b )
+    template< typename K, typename V, class A >
+    void swap( Dictionary< K, V, A >& a, Dictionary< K, V, A >& b )
     {
-        std::swap( a._pData, b._pData );
-        std::swap( a._capacity, b._capacity );
-        std::swap( a._count, b._count );
+        a.swap( b );
     }
 }
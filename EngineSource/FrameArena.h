@@ -0,0 +1,193 @@
+// Andrew Meckling
+#pragma once
+
+#include "Allocators.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <vector>
+
+// Linear allocator for scratch memory which only needs to live for a frame.
+// Allocation is a pointer bump and deallocation is ignored (except for the
+// most recent allocation). Memory is double-buffered: nextFrame() switches
+// to the other buffer and resets it, so anything allocated during one frame
+// stays valid until the end of the following frame.
+// If a frame runs out of room the overflow is served by malloc and freed at
+// the next reset of that buffer, and the buffer is grown to fit the whole
+// frame when it is reset. After a few frames no further malloc calls occur.
+class FrameArena
+{
+public:
+
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t DEFAULT_SIZE = 1 << 20;
+
+private:
+
+    // Header placed in front of each overflow allocation.
+    struct Overflow
+    {
+        Overflow* next;
+        size_t    size;
+    };
+
+    static constexpr size_t OVERFLOW_HEADER = round_to_alignment( sizeof( Overflow ), ALIGNMENT );
+
+    struct Buffer
+    {
+        byte*     memory = nullptr;    // Start of the buffer.
+        size_t    capacity = 0;        // Size of the buffer in bytes.
+        byte*     ptr = nullptr;       // Top of the allocation stack.
+        Overflow* pOverflow = nullptr; // Allocations which did not fit in the buffer.
+        size_t    overflowSize = 0;    // Total bytes of overflow allocations.
+    };
+
+    Buffer _buffers[ 2 ];
+    size_t _current = 0;
+    size_t _frame = 0;
+
+    static constexpr size_t _round_to_aligned( size_t size )
+    {
+        return round_to_alignment( size, ALIGNMENT );
+    }
+
+    // Frees overflow allocations, grows the buffer if they were needed,
+    // and empties the buffer.
+    static void _reset( Buffer& buf )
+    {
+        size_t needed = (buf.ptr - buf.memory) + buf.overflowSize;
+
+        while ( Overflow* pOverflow = buf.pOverflow )
+        {
+            buf.pOverflow = pOverflow->next;
+            std::free( pOverflow );
+        }
+        buf.overflowSize = 0;
+
+        if ( needed > buf.capacity )
+        {
+            _release( buf );
+            buf.capacity = _round_to_aligned( needed + needed / 2 );
+            buf.memory = (byte*) aligned_malloc( buf.capacity, ALIGNMENT );
+        }
+        buf.ptr = buf.memory;
+    }
+
+    static void _release( Buffer& buf )
+    {
+        aligned_free( buf.memory );
+        buf.memory = nullptr;
+        buf.capacity = 0;
+        buf.ptr = nullptr;
+    }
+
+    // Allocates from the heap and links the block onto the overflow list.
+    static Blk _allocateOverflow( Buffer& buf, size_t size )
+    {
+        void* pData = std::malloc( OVERFLOW_HEADER + size );
+        if ( !pData )
+            return { nullptr, 0 };
+
+        buf.pOverflow = new( pData ) Overflow { buf.pOverflow, size };
+        buf.overflowSize += _round_to_aligned( size );
+        return { (byte*) pData + OVERFLOW_HEADER, size };
+    }
+
+public:
+
+    // Allocates two buffers of bytesPerFrame bytes each.
+    explicit FrameArena( size_t bytesPerFrame = DEFAULT_SIZE )
+    {
+        for ( Buffer& buf : _buffers )
+        {
+            buf.capacity = _round_to_aligned( bytesPerFrame );
+            buf.memory = (byte*) aligned_malloc( buf.capacity, ALIGNMENT );
+            buf.ptr = buf.memory;
+        }
+    }
+
+    FrameArena( const FrameArena& ) = delete;
+    FrameArena& operator =( const FrameArena& ) = delete;
+
+    ~FrameArena()
+    {
+        for ( Buffer& buf : _buffers )
+        {
+            _reset( buf );
+            _release( buf );
+        }
+    }
+
+    // Switches to the other buffer and empties it. Memory allocated before
+    // the previous call to nextFrame() is invalidated.
+    void nextFrame()
+    {
+        _current ^= 1;
+        _reset( _buffers[ _current ] );
+        ++_frame;
+    }
+
+    // Returns the number of times nextFrame() has been called.
+    size_t frame() const
+    {
+        return _frame;
+    }
+
+    Blk allocate( size_t size )
+    {
+        Buffer& buf = _buffers[ _current ];
+        size_t rounded_size = _round_to_aligned( size );
+
+        if ( rounded_size > size_t( buf.memory + buf.capacity - buf.ptr ) )
+            return _allocateOverflow( buf, size );
+
+        Blk result = { buf.ptr, size };
+        buf.ptr += rounded_size;
+        return result;
+    }
+
+    // Only reclaims memory if blk was the most recent allocation.
+    void deallocate( Blk blk )
+    {
+        Buffer& buf = _buffers[ _current ];
+        if ( (byte*) blk.ptr + _round_to_aligned( blk.size ) == buf.ptr )
+            buf.ptr = (byte*) blk.ptr;
+    }
+
+    // Succeeds if blk is the most recent allocation and there is room.
+    bool expand( Blk& blk, size_t delta )
+    {
+        Buffer& buf = _buffers[ _current ];
+        if ( (byte*) blk.ptr + _round_to_aligned( blk.size ) != buf.ptr )
+            return false;
+
+        byte* top = (byte*) blk.ptr + _round_to_aligned( blk.size + delta );
+        if ( top > buf.memory + buf.capacity )
+            return false;
+
+        buf.ptr = top;
+        blk.size += delta;
+        return true;
+    }
+
+    // Returns true if ptr lies in either buffer. Overflow allocations are
+    // not included.
+    bool owns( void* ptr ) const
+    {
+        for ( const Buffer& buf : _buffers )
+            if ( buf.memory <= ptr && ptr < buf.memory + buf.capacity )
+                return true;
+        return false;
+    }
+
+    // Returns the number of bytes allocated during the current frame.
+    size_t used() const
+    {
+        const Buffer& buf = _buffers[ _current ];
+        return (buf.ptr - buf.memory) + buf.overflowSize;
+    }
+};
+
+// A std::vector whose memory lives for (at most) two frames.
+template< typename T >
+using FrameVector = std::vector< T, StdAllocator< T, FrameArena > >;
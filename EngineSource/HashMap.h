@@ -6,6 +6,7 @@
 #include <bitset>
 #include <array>
 #include <initializer_list>
+#include <memory>
 #include <cassert>
 #include <experimental/generator>
 
@@ -34,13 +35,17 @@ inline uint64_t hash2( const std::string& key )
 template<
     typename KeyType,
     typename ValueType,
-    typename HashFn = std::hash< KeyType > >
+    typename HashFn = std::hash< KeyType >,
+    typename Allocator = std::allocator< char > >
 class HashMap
 {
 public:
     using Key = KeyType;
     using Value = ValueType;
 
+    template< typename T >
+    using AllocatorFor = typename std::allocator_traits< Allocator >::template rebind_alloc< T >;
+
     static constexpr double LOAD_FACTOR = 0.75;
     static constexpr double GROWTH_FACTOR = 2.0;
 
@@ -52,7 +57,7 @@ public:
 
     struct Bucket
     {
-        std::vector< Entry > entries;
+        std::vector< Entry, AllocatorFor< Entry > > entries;
 
         bool empty() const
         {
@@ -103,7 +108,7 @@ public:
         }
     };
 
-    using Table = std::vector< Bucket >;
+    using Table = std::vector< Bucket, AllocatorFor< Bucket > >;
 
 private:
 
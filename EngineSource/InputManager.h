@@ -9,6 +9,7 @@
 
 #include "Dictionary.h"
 #include "Util.h"
+#include "Search.h"
 
 #include "ControllerManager.h"
 
@@ -172,7 +173,7 @@ public:
     // Returns 0 if the keycode is not recognized.
     static size_t key_index( SDL_Keycode key )
     {
-        auto itr = binary_search( KEYS, key );
+        auto itr = sorted_find( KEYS, key );
 
         return itr == std::end( KEYS ) ? 0
             : std::distance( std::begin( KEYS ), itr );
@@ -1,161 +1,177 @@
-// Unfinished
+// Andrew Meckling
 #pragma once
 
-#include "Util.h"
+#include "QuadTree.h"
+#include "Bits.h"
 
-#include <array>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
 #include <glm/glm.hpp>
 
-template< typename T, size_t Depth >
-class QuadTree;
-
-struct AABB
-{
-    glm::vec2 center;
-    glm::vec2 halfSize;
-
-    AABB( glm::vec2 center, glm::vec2 halfSize )
-        : center( center )
-        , halfSize( halfSize )
-    {
-    }
-
-    bool contains( glm::vec2 a ) const
-    {
-        return (a.x < center.x + halfSize.x && a.x > center.x - halfSize.x)
-            && (a.y < center.y + halfSize.y && a.y > center.y - halfSize.y);
-    }
-
-    bool intersects( const AABB& b ) const
-    {
-        return ((center.x + halfSize.x > b.center.x - b.halfSize.x)
-            || (center.x - halfSize.x < b.center.x + b.halfSize.x))
-            && ((center.y + halfSize.y > b.center.y - b.halfSize.y)
-            || (center.y - halfSize.y < b.center.y + b.halfSize.y));
-    }
-};
-
 template< typename T >
-struct QuadTreeData
+struct LocalQuadTreeData
 {
     glm::vec2 pos;
     T         load;
 };
 
-template< typename T >
-class QuadTree< T, 0 >
+// Linear quadtree of points over a fixed region, for small scenes of many
+// objects which are rebuilt every frame. The region is a grid of
+// 2^Depth x 2^Depth cells and every object is stored in one array sorted by
+// the Morton code of its cell, so every node of the tree is the contiguous
+// run of objects whose codes share its prefix and no nodes are stored.
+// insert() only appends; rebuild() sorts with a radix sort, O(n), after which
+// queries narrow code ranges with binary searches. Queries made after an
+// insert() and before the next rebuild() miss the new objects.
+template< typename T, size_t Depth = 8 >
+class LocalQuadTree
     : public AABB
 {
 public:
 
     using ValueType = T;
-    using DataType = QuadTreeData< ValueType >;
-    static constexpr size_t DEPTH = 0;
-    using ObjStorage = std::vector< DataType >;
-
-private:
-    
-    ObjStorage _objs;
+    using DataType = LocalQuadTreeData< ValueType >;
 
-public:
-
-    QuadTree( glm::vec2 center, glm::vec2 halfSize )
-        : AABB( center, halfSize )
-    {
-    }
+    static constexpr size_t DEPTH = Depth;
+    static_assert( DEPTH >= 1 && DEPTH <= 16, "LocalQuadTree: codes must fit 32 bits" );
 
-    bool insert( glm::vec2 pos, const ValueType& val )
-    {
-        if ( !contains( pos ) )
-            return false;
+    // Cells along each side of the region.
+    static constexpr uint32_t CELLS = uint32_t( 1 ) << DEPTH;
 
-        _objs.push_back( { pos, val } );
-        return true;
-    }
+    // Runs of at most this many objects are tested one by one rather
+    // than split further.
+    static constexpr size_t LEAF_SIZE = 16;
 
-    auto query( const AABB& range )
-    {
-        std::vector< T > inRange;
+private:
 
-        if ( !intersects( range ) )
-            return inRange;
+    std::vector< DataType > _objs;   // Sorted by code up to _sortedCount.
+    std::vector< uint32_t > _codes;  // Code of each sorted object.
+    size_t _sortedCount = 0;
 
-        for ( DataType& o : _objs )
-            if ( range.contains( o.pos ) )
-                inRange.push_back( o.load );
+    // Scratch space for rebuild(), kept to avoid reallocating every frame.
+    std::vector< DataType > _back;
+    std::vector< uint64_t > _keys;
+    std::vector< uint64_t > _keysBack;
 
-        return inRange;
+    uint32_t _code( glm::vec2 pos ) const
+    {
+        glm::vec2 cell = (pos - (center - halfSize)) / (2.0f * halfSize) * float( CELLS );
+        uint32_t x = uint32_t( glm::clamp( cell.x, 0.0f, float( CELLS - 1 ) ) );
+        uint32_t y = uint32_t( glm::clamp( cell.y, 0.0f, float( CELLS - 1 ) ) );
+        return interleave_bits( x, y );
     }
 
-    bool empty() const
+    // Returns the first sorted object in [first, last) whose code is at
+    // least code.
+    size_t _lowerBound( size_t first, size_t last, uint64_t code ) const
     {
-        return _objs.empty();
+        return std::lower_bound( _codes.begin() + first, _codes.begin() + last, code,
+                                 []( uint32_t a, uint64_t b ) { return a < b; } )
+            - _codes.begin();
     }
-};
-
-template< typename T, size_t Depth >
-class QuadTree
-    : public AABB
-{
-public:
 
-    using ValueType = T;
-    using DataType = QuadTreeData< ValueType >;
-    static constexpr size_t DEPTH = Depth;
+    // Visits the objects in [first, last), the run of the node with the given
+    // prefix at level (0 being the root) whose square is box.
+    template< typename Func >
+    void _query( const AABB& range, uint32_t prefix, size_t level, const AABB& box,
+                 size_t first, size_t last, Func&& func )
+    {
+        if ( first == last || !range.intersects( box ) )
+            return;
+
+        if ( level == DEPTH || last - first <= LEAF_SIZE )
+        {
+            for ( size_t i = first; i < last; ++i )
+                if ( range.contains( _objs[ i ].pos ) )
+                    func( _objs[ i ] );
+            return;
+        }
 
-    using ObjStorage = std::vector< DataType >;
-    using Quad = QuadTree< ValueType, DEPTH - 1 >;
-    using Quads = std::array< Quad, 4 >;
+        // Child c covers codes [(prefix * 4 + c) << shift, ...); bit 0 of c
+        // picks the right half and bit 1 the top half.
+        size_t shift = 2 * (DEPTH - level - 1);
+        glm::vec2 qSize = box.halfSize * 0.5f;
 
-private:
+        for ( uint32_t c = 0; c < 4; ++c )
+        {
+            size_t end = c == 3 ? last
+                : _lowerBound( first, last, uint64_t( prefix * 4 + c + 1 ) << shift );
 
-    ObjStorage _objs;
-    Quads      _quads;
+            glm::vec2 sign( c & 1 ? 1 : -1, c & 2 ? 1 : -1 );
+            _query( range, prefix * 4 + c, level + 1,
+                    AABB( box.center + sign * qSize, qSize ), first, end, func );
+            first = end;
+        }
+    }
 
 public:
 
-    QuadTree( glm::vec2 qCenter, glm::vec2 qSize )
-        : AABB( qCenter, qSize )
-        , _quads {
-            Quad { (qSize /= 2, qCenter - qSize), qSize }, // <- Comma operator.
-            Quad { { qCenter.x + qSize.x, qCenter.y - qSize.y }, qSize },
-            Quad { { qCenter.x - qSize.x, qCenter.y + qSize.y }, qSize },
-            Quad { qCenter + qSize, qSize },
-        }
+    LocalQuadTree( glm::vec2 center, glm::vec2 halfSize )
+        : AABB( center, halfSize )
     {
     }
 
+    // Adds an object at pos. Returns false if pos is outside the region.
+    // The object is not found by queries until the next rebuild().
     bool insert( glm::vec2 pos, const ValueType& val )
     {
         if ( !contains( pos ) )
             return false;
 
-        //if ( !_objs.empty() )
-        for ( Quad& quad : _quads )
-            if ( quad.insert( pos, val ) )
-                return true;
-
         _objs.push_back( { pos, val } );
         return true;
     }
 
-    auto query( const AABB& range )
+    // Removes every object.
+    void clear()
     {
-        std::vector< T > inRange;
-
-        if ( !intersects( range ) )
-            return inRange;
+        _objs.clear();
+        _codes.clear();
+        _sortedCount = 0;
+    }
 
-        for ( DataType& o : _objs )
-            if ( range.contains( o.pos ) )
-                inRange.push_back( o.load );
+    // Sorts the objects by the codes of their current positions. Positions
+    // may be changed through forEach() and the tree rebuilt in place.
+    void rebuild()
+    {
+        size_t count = _objs.size();
+        _keys.resize( count );
+        _keysBack.resize( count );
+
+        for ( size_t i = 0; i < count; ++i )
+            _keys[ i ] = uint64_t( _code( _objs[ i ].pos ) ) << 32 | i;
+
+        // Least significant digit first, 8 bits of code at a time.
+        for ( size_t shift = 32; shift < 32 + 2 * DEPTH; shift += 8 )
+        {
+            size_t offsets[ 257 ] = {};
+            for ( uint64_t key : _keys )
+                ++offsets[ ((key >> shift) & 0xFF) + 1 ];
+            for ( size_t d = 1; d < 257; ++d )
+                offsets[ d ] += offsets[ d - 1 ];
+            for ( uint64_t key : _keys )
+                _keysBack[ offsets[ (key >> shift) & 0xFF ]++ ] = key;
+            _keys.swap( _keysBack );
+        }
 
-        for ( Quad& quad : _quads )
-            array_cat( inRange, quad.query( range ) );
+        _back.clear();
+        _back.reserve( count );
+        _codes.resize( count );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            _back.push_back( std::move( _objs[ uint32_t( _keys[ i ] ) ] ) );
+            _codes[ i ] = uint32_t( _keys[ i ] >> 32 );
+        }
+        _objs.swap( _back );
+        _sortedCount = count;
+    }
 
-        return inRange;
+    // Returns the number of objects, sorted or not.
+    size_t size() const
+    {
+        return _objs.size();
     }
 
     bool empty() const
@@ -163,4 +179,32 @@ public:
         return _objs.empty();
     }
 
+    // Calls func( data ) for every object whose position is within range.
+    template< typename Func >
+    void query( const AABB& range, Func&& func )
+    {
+        _query( range, 0, 0, *this, 0, _sortedCount, func );
+    }
+
+    // Copies the loads of up to capacity objects whose positions are within
+    // range to out. Returns the number of objects found, which may be more
+    // than were written.
+    size_t query( const AABB& range, ValueType* out, size_t capacity )
+    {
+        size_t found = 0;
+        query( range, [&]( DataType& data )
+        {
+            if ( found++ < capacity )
+                out[ found - 1 ] = data.load;
+        } );
+        return found;
+    }
+
+    // Calls func( data ) for every object, in code order once rebuilt.
+    template< typename Func >
+    void forEach( Func&& func )
+    {
+        for ( DataType& data : _objs )
+            func( data );
+    }
 };
@@ -0,0 +1,92 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+bool MappedFile::open( const char* path )
+{
+    close();
+
+    HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( file == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER size;
+    if ( !GetFileSizeEx( file, &size ) || size.QuadPart == 0 )
+    {
+        CloseHandle( file );
+        return false;
+    }
+
+    // The view keeps the mapping alive, so neither handle is needed after.
+    HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    CloseHandle( file );
+    if ( mapping == nullptr )
+        return false;
+
+    void* view = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( mapping );
+    if ( view == nullptr )
+        return false;
+
+    _data = (const byte*) view;
+    _size = size_t( size.QuadPart );
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( _data )
+        UnmapViewOfFile( _data );
+
+    _data = nullptr;
+    _size = 0;
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open( const char* path )
+{
+    close();
+
+    int fd = ::open( path, O_RDONLY );
+    if ( fd < 0 )
+        return false;
+
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || info.st_size == 0 )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    // The mapping keeps the file alive, so the descriptor is not needed after.
+    void* view = mmap( nullptr, size_t( info.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( view == MAP_FAILED )
+        return false;
+
+    _data = (const byte*) view;
+    _size = size_t( info.st_size );
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( _data )
+        munmap( (void*) _data, _size );
+
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif
@@ -0,0 +1,72 @@
+// Andrew Meckling
+#pragma once
+
+#include "Memory.h"
+
+#include <cstddef>
+#include <utility>
+
+// Read-only view of a whole file mapped into memory. The pages are loaded
+// by the system as they are first touched, so opening a large file is
+// cheap and data that is never read is never loaded.
+class MappedFile
+{
+    const byte* _data = nullptr;
+    size_t      _size = 0;
+
+public:
+
+    MappedFile() = default;
+
+    explicit MappedFile( const char* path )
+    {
+        open( path );
+    }
+
+    MappedFile( const MappedFile& ) = delete;
+    MappedFile& operator =( const MappedFile& ) = delete;
+
+    MappedFile( MappedFile&& other ) noexcept
+        : _data( std::exchange( other._data, nullptr ) )
+        , _size( std::exchange( other._size, 0 ) )
+    {
+    }
+
+    MappedFile& operator =( MappedFile&& other ) noexcept
+    {
+        if ( this != &other )
+        {
+            close();
+            _data = std::exchange( other._data, nullptr );
+            _size = std::exchange( other._size, 0 );
+        }
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // Maps the file at path, closing any file already mapped. Returns false
+    // if the file could not be opened or is empty.
+    bool open( const char* path );
+
+    // Unmaps the file.
+    void close();
+
+    const byte* data() const
+    {
+        return _data;
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    explicit operator bool() const
+    {
+        return _data != nullptr;
+    }
+};
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <malloc.h>
 #include <vector>
@@ -50,11 +51,32 @@ struct Blk
     }
 };
 
-void* get_ptr( const Blk& blk )
+inline void* get_ptr( const Blk& blk )
 {
     return blk.ptr;
 }
 
+// Allocates a block of size bytes aligned to align (a power of 2).
+// Memory returned by this function must be freed with aligned_free.
+inline void* aligned_malloc( size_t size, size_t align )
+{
+#ifdef _MSC_VER
+    return _aligned_malloc( size, align );
+#else
+    return std::aligned_alloc( align, (size + align - 1) & ~(align - 1) );
+#endif
+}
+
+// Frees a block of memory returned by aligned_malloc.
+inline void aligned_free( void* ptr )
+{
+#ifdef _MSC_VER
+    _aligned_free( ptr );
+#else
+    std::free( ptr );
+#endif
+}
+
 // Represents an array of units of allocated memory.
 template< typename T >
 struct Array
@@ -0,0 +1,116 @@
+// Andrew Meckling
+#pragma once
+
+#include "Allocators.h"
+
+#include <memory_resource>
+#include <new>
+
+// Exposes an engine allocator as a std::pmr::memory_resource so that
+// std::pmr containers can draw from it, e.g.
+//     ResourceAdapter< FrameArena > resource( frameArena );
+//     std::pmr::vector< int > scratch( &resource );
+// Holds a reference to the allocator, which must outlive the resource.
+// Alignments above DEFAULT_ALIGNMENT are passed on via alignedAllocate.
+template< class Allocator >
+class ResourceAdapter
+    : public std::pmr::memory_resource
+{
+    Allocator* _pAllocator;
+
+public:
+
+    explicit ResourceAdapter( Allocator& allocator ) noexcept
+        : _pAllocator( &allocator )
+    {
+    }
+
+    Allocator& allocator() const noexcept
+    {
+        return *_pAllocator;
+    }
+
+protected:
+
+    void* do_allocate( size_t bytes, size_t align ) override
+    {
+        Blk blk = allocator_aligned_allocate( *_pAllocator, bytes, align );
+        if ( !blk.ptr )
+            throw std::bad_alloc();
+        return blk.ptr;
+    }
+
+    void do_deallocate( void* ptr, size_t bytes, size_t ) override
+    {
+        _pAllocator->deallocate( { ptr, bytes } );
+    }
+
+    bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept override
+    {
+        auto* pOther = dynamic_cast< const ResourceAdapter* >( &other );
+        return pOther && pOther->_pAllocator == _pAllocator;
+    }
+};
+
+
+// Engine allocator (Blk interface) which forwards to a
+// std::pmr::memory_resource. Default constructs to the current default
+// resource, so engine containers can be given any memory resource:
+//     Dictionary< int, Item, ResourceAllocator > items( 16, ResourceAllocator( &pool ) );
+// Since Blk does not carry an alignment, every block is allocated (and
+// deallocated) with DEFAULT_ALIGNMENT, and alignedAllocate fails for
+// anything larger.
+class ResourceAllocator
+{
+    std::pmr::memory_resource* _pResource;
+
+public:
+
+    ResourceAllocator() noexcept
+        : _pResource( std::pmr::get_default_resource() )
+    {
+    }
+
+    ResourceAllocator( std::pmr::memory_resource* pResource ) noexcept
+        : _pResource( pResource )
+    {
+    }
+
+    std::pmr::memory_resource* resource() const noexcept
+    {
+        return _pResource;
+    }
+
+    Blk allocate( size_t size )
+    {
+        try
+        {
+            return { _pResource->allocate( size, DEFAULT_ALIGNMENT ), size };
+        }
+        catch ( const std::bad_alloc& )
+        {
+            return { nullptr, 0 };
+        }
+    }
+
+    Blk alignedAllocate( size_t size, size_t align )
+    {
+        return align <= DEFAULT_ALIGNMENT ? allocate( size ) : Blk { nullptr, 0 };
+    }
+
+    void deallocate( Blk blk )
+    {
+        if ( blk.ptr )
+            _pResource->deallocate( blk.ptr, blk.size, DEFAULT_ALIGNMENT );
+    }
+
+    bool operator ==( const ResourceAllocator& other ) const noexcept
+    {
+        return _pResource == other._pResource || _pResource->is_equal( *other._pResource );
+    }
+
+    bool operator !=( const ResourceAllocator& other ) const noexcept
+    {
+        return !(*this == other);
+    }
+};
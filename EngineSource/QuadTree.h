@@ -1,10 +1,9 @@
-// Unfinished
+// Andrew Meckling
 #pragma once
 
-#include "LocalVector.h"
+#include "Util.h"
 
-#include <array>
-#include <memory>
+#include <functional>
 #include <vector>
 
 #include <glm/glm.hpp>
@@ -14,6 +13,11 @@ struct AABB
     glm::vec2 center;
     glm::vec2 halfSize;
 
+    AABB()
+        : AABB( { 0, 0 }, { 0, 0 } )
+    {
+    }
+
     AABB( glm::vec2 center, glm::vec2 halfSize )
         : center( center )
         , halfSize( halfSize )
@@ -98,210 +102,472 @@ struct QuadTreeData : AABB
     }
 };
 
+// Loose quadtree over a fixed region. The loose bounds of a node are twice
+// the size of its square, so an object is kept in the deepest node whose
+// square holds its center and which is at least as big as the object, and
+// never has to straddle or be split across nodes.
+// Nodes live in one pooled array, four siblings side by side, and objects in
+// another; an object is referred to by a Handle which stays valid until it
+// is removed. A leaf splits once it keeps more than SPLIT_COUNT objects and
+// a subtree folds back into its root once it holds SPLIT_COUNT / 2 or fewer.
+// Queries report to a visitor or into a caller-supplied buffer and do not
+// allocate.
 template< typename T >
 class QuadTree
-    : private AABB
 {
 public:
 
     using ValueType = T;
     using DataType = QuadTreeData< ValueType >;
-    using QueryResult = std::vector< std::reference_wrapper< DataType > >;
-    
-    using ObjStorage = std::vector< DataType >;
-    using QuadPtr = std::unique_ptr< QuadTree >;
-    using Quads = std::array< QuadPtr, 4 >;
+    using Handle = int;
 
-    using AABB::contains;
-    using AABB::intersects;
+    static constexpr Handle NULL_HANDLE = -1;
 
-    QuadTree( const AABB& aabb )
-        : AABB( aabb )
+    // Objects a leaf keeps before it splits.
+    static constexpr int SPLIT_COUNT = 8;
+
+    // Depth of the smallest nodes; the root is at depth 0.
+    static constexpr int MAX_DEPTH = 12;
+
+private:
+
+    static constexpr int NO_NODE = -1;
+
+    struct Node
+    {
+        AABB bounds;   // Square of the node; the loose bounds are twice as big.
+        int  parent;
+        int  children; // First of the four children; NO_NODE for a leaf.
+        int  first;    // First object kept in this node; NULL_HANDLE if none.
+        int  count;    // Objects kept in this node.
+        int  total;    // Objects kept in the subtree.
+        int  depth;
+    };
+
+    struct Item
     {
+        DataType data;
+        int      node; // Node keeping the object; NO_NODE while free.
+        Handle   prev; // Neighbours in the list of the node.
+        Handle   next; // Also links the free list.
+    };
+
+    std::vector< Node > _nodes;     // _nodes[ 0 ] is the root.
+    std::vector< int >  _freeQuads; // First node of each freed set of four.
+    std::vector< Item > _items;
+    Handle _freeItem = NULL_HANDLE;
+    int    _size = 0;
+
+    // Returns true if the loose bounds of node contain a.
+    bool _fits( int node, const AABB& a ) const
+    {
+        const AABB& b = _nodes[ node ].bounds;
+        glm::vec2 d = glm::abs( a.center - b.center ) + a.halfSize;
+        return d.x <= 2 * b.halfSize.x && d.y <= 2 * b.halfSize.y;
     }
 
-    QuadTree( glm::vec2 center, glm::vec2 halfSize )
-        : AABB( center, halfSize )
+    // Returns the loose bounds of node.
+    AABB _loose( int node ) const
     {
+        const AABB& b = _nodes[ node ].bounds;
+        return AABB( b.center, b.halfSize * 2.0f );
     }
 
-    const AABB& aabb() const
+    // Returns the child of node whose square holds the center of a.
+    int _childFor( int node, const AABB& a ) const
     {
-        return static_cast< const AABB& >( *this );
+        const Node& n = _nodes[ node ];
+        return n.children
+            + (a.center.x >= n.bounds.center.x ? 1 : 0)
+            + (a.center.y >= n.bounds.center.y ? 2 : 0);
     }
 
-private:
-    
-    ObjStorage _objs;
-    Quads      _quads;
-     
-    void _subdivide()
+    // Gives node four children, reusing a freed set if there is one.
+    void _addChildren( int node )
+    {
+        int first;
+        if ( !_freeQuads.empty() )
+        {
+            first = _freeQuads.back();
+            _freeQuads.pop_back();
+        }
+        else
+        {
+            first = (int) _nodes.size();
+            _nodes.resize( _nodes.size() + 4 );
+        }
+
+        Node& n = _nodes[ node ];
+        glm::vec2 qSize = n.bounds.halfSize * 0.5f;
+        for ( int i = 0; i < 4; ++i )
+        {
+            glm::vec2 sign( i & 1 ? 1 : -1, i & 2 ? 1 : -1 );
+            _nodes[ first + i ] = {
+                AABB( n.bounds.center + sign * qSize, qSize ),
+                node, NO_NODE, NULL_HANDLE, 0, 0, n.depth + 1
+            };
+        }
+        n.children = first;
+    }
+
+    // Adds an object to the list of node.
+    void _link( Handle h, int node )
+    {
+        Item& item = _items[ h ];
+        Node& n = _nodes[ node ];
+
+        item.node = node;
+        item.prev = NULL_HANDLE;
+        item.next = n.first;
+        if ( n.first != NULL_HANDLE )
+            _items[ n.first ].prev = h;
+        n.first = h;
+        ++n.count;
+
+        for ( int i = node; i != NO_NODE; i = _nodes[ i ].parent )
+            ++_nodes[ i ].total;
+    }
+
+    // Takes an object out of the list of its node.
+    void _unlink( Handle h )
+    {
+        Item& item = _items[ h ];
+        Node& n = _nodes[ item.node ];
+
+        if ( item.prev != NULL_HANDLE )
+            _items[ item.prev ].next = item.next;
+        else
+            n.first = item.next;
+        if ( item.next != NULL_HANDLE )
+            _items[ item.next ].prev = item.prev;
+        --n.count;
+
+        for ( int i = item.node; i != NO_NODE; i = _nodes[ i ].parent )
+            --_nodes[ i ].total;
+        item.node = NO_NODE;
+    }
+
+    // Keeps an object in the deepest node under node which it fits in,
+    // then splits that node if it has become crowded.
+    void _place( Handle h, int node )
     {
-        auto qSize = halfSize * 0.5f;
-        auto newQuad = [qSize]( glm::vec2 center ) {
-            return std::make_unique< QuadTree >( center, qSize );
-        };
+        const AABB& a = _items[ h ].data;
+        while ( _nodes[ node ].children != NO_NODE )
+        {
+            int child = _childFor( node, a );
+            if ( !_fits( child, a ) )
+                break;
+            node = child;
+        }
 
-        _quads[ 0 ] = newQuad( center + qSize );
-        _quads[ 1 ] = newQuad( { center.x - qSize.x, center.y + qSize.y } );
-        _quads[ 2 ] = newQuad( center - qSize );
-        _quads[ 3 ] = newQuad( { center.x + qSize.x, center.y - qSize.y } );
+        _link( h, node );
+        _split( node );
     }
 
-    QuadTree* _getDest( const AABB& a )
+    // Hands the objects of a crowded leaf down to new children.
+    void _split( int node )
     {
-        if ( isSubdivided() )
-            for ( QuadPtr& pQuad : _quads )
-                if ( pQuad->contains( a ) )
-                    if ( QuadTree* pTree = pQuad->_getDest( a ) )
-                        return pTree;
+        if ( _nodes[ node ].children != NO_NODE
+            || _nodes[ node ].count <= SPLIT_COUNT
+            || _nodes[ node ].depth >= MAX_DEPTH )
+            return;
 
-        return contains( a ) ? this : nullptr;
+        _addChildren( node );
+
+        for ( Handle h = _nodes[ node ].first; h != NULL_HANDLE; )
+        {
+            Handle next = _items[ h ].next;
+            int child = _childFor( node, _items[ h ].data );
+            if ( _fits( child, _items[ h ].data ) )
+            {
+                _unlink( h );
+                _link( h, child );
+            }
+            h = next;
+        }
+
+        int first = _nodes[ node ].children;
+        for ( int i = 0; i < 4; ++i )
+            _split( first + i );
     }
 
-    void _subQuery( const AABB& aabb, QueryResult& result )
+    // Folds the highest subtree above node (inclusive) which has become
+    // sparse back into its root.
+    void _collapse( int node )
     {
-        if ( !intersects( aabb ) )
+        int top = NO_NODE;
+        for ( int i = node; i != NO_NODE; i = _nodes[ i ].parent )
+            if ( _nodes[ i ].children != NO_NODE && _nodes[ i ].total <= SPLIT_COUNT / 2 )
+                top = i;
+
+        if ( top == NO_NODE )
             return;
 
-        for ( DataType& data : _objs )
-            if ( &aabb != (AABB*) &data && aabb.intersects( data ) )
-                result.push_back( data );
+        int stack[ 4 * (MAX_DEPTH + 1) ];
+        int depth = 0;
+        stack[ depth++ ] = _nodes[ top ].children;
+        _nodes[ top ].children = NO_NODE;
 
-        if ( isSubdivided() )
-            for ( QuadPtr& pQuad : _quads )
-                pQuad->_subQuery( aabb, result );
+        while ( depth > 0 )
+        {
+            int first = stack[ --depth ];
+            _freeQuads.push_back( first );
+
+            for ( int c = first; c < first + 4; ++c )
+            {
+                for ( Handle h = _nodes[ c ].first; h != NULL_HANDLE; )
+                {
+                    Handle next = _items[ h ].next;
+                    _unlink( h );
+                    _link( h, top );
+                    h = next;
+                }
+                if ( _nodes[ c ].children != NO_NODE )
+                    stack[ depth++ ] = _nodes[ c ].children;
+            }
+        }
     }
 
-public:
+    // Moves an object whose bounds changed if it left the loose bounds of
+    // its node or now fits in a child.
+    void _relocate( Handle h )
+    {
+        const AABB& a = _items[ h ].data;
+        int node = _items[ h ].node;
+
+        if ( _fits( node, a ) )
+        {
+            const Node& n = _nodes[ node ];
+            if ( n.children == NO_NODE || !_fits( _childFor( node, a ), a ) )
+                return;
+        }
+        else
+        {
+            // Objects which leave the root stay in it.
+            while ( node != 0 && !_fits( node, a ) )
+                node = _nodes[ node ].parent;
+        }
+
+        int old = _items[ h ].node;
+        _unlink( h );
+        _place( h, node );
+        if ( _items[ h ].node != old )
+            _collapse( old );
+    }
 
+    // Calls func( node ) for the root and every other node whose loose
+    // bounds meet range, skipping the rest of a subtree when func returns
+    // false. The root is never culled since objects which moved out of its
+    // loose bounds are kept in it.
     template< typename Func >
-    void forEach( Func&& func, size_t level = 0 )
+    void _visit( const AABB& range, Func&& func ) const
+    {
+        if ( _size == 0 )
+            return;
+
+        int stack[ 4 * (MAX_DEPTH + 1) ];
+        int depth = 0;
+        stack[ depth++ ] = 0;
+
+        while ( depth > 0 )
+        {
+            int node = stack[ --depth ];
+            const Node& n = _nodes[ node ];
+            if ( n.total == 0 || (node != 0 && !_loose( node ).intersects( range )) )
+                continue;
+
+            if ( !func( node ) )
+                return;
+
+            if ( n.children != NO_NODE )
+                for ( int c = n.children; c < n.children + 4; ++c )
+                    stack[ depth++ ] = c;
+        }
+    }
+
+public:
+
+    QuadTree( const AABB& aabb )
     {
-        for ( auto& obj : _objs )
-            std::invoke( func, obj, level );
+        _nodes.push_back( { aabb, NO_NODE, NO_NODE, NULL_HANDLE, 0, 0, 0 } );
+    }
 
-        if ( isSubdivided() )
-            for ( QuadPtr& pTree : _quads )
-                pTree->forEach( func, level + 1 );
+    QuadTree( glm::vec2 center, glm::vec2 halfSize )
+        : QuadTree( AABB( center, halfSize ) )
+    {
     }
 
-    bool isSubdivided() const
+    // Returns the region covered by the root.
+    const AABB& aabb() const
     {
-        return _quads[ 0 ] != nullptr;
+        return _nodes[ 0 ].bounds;
     }
 
-    bool empty() const
+    // Returns the object referred to by a handle. If its bounds are
+    // changed, call update( h ) or update() to relocate it.
+    DataType& get( Handle h )
     {
-        if ( !_objs.empty() )
-            return false;
+        return _items[ h ].data;
+    }
 
-        if ( isSubdivided() )
-            for ( QuadPtr& pTree : const_cast< Quads& >( _quads ) )
-                if ( !pTree->empty() )
-                    return false;
+    const DataType& get( Handle h ) const
+    {
+        return _items[ h ].data;
+    }
+
+    // Returns the number of objects in the tree.
+    int size() const
+    {
+        return _size;
+    }
 
-        return true;
+    bool empty() const
+    {
+        return _size == 0;
     }
 
-    bool insert( const AABB& aabb, const ValueType& val )
+    bool isSubdivided() const
     {
-        if ( !contains( aabb ) )
-            return false;
+        return _nodes[ 0 ].children != NO_NODE;
+    }
 
-        QuadTree* pTree = _getDest( aabb );
+    // Adds an object. Returns NULL_HANDLE if it is not within the loose
+    // bounds of the root.
+    Handle insert( const AABB& aabb, const ValueType& val )
+    {
+        if ( !_fits( 0, aabb ) )
+            return NULL_HANDLE;
 
-        if ( pTree == this )
+        Handle h = _freeItem;
+        if ( h != NULL_HANDLE )
         {
-            if ( !isSubdivided() )
-            {
-                _subdivide();
-                pTree = _getDest( aabb );
-            }
-            else
-            {
-                _objs.emplace_back( aabb, val );
-                return true;
-            }
+            _freeItem = _items[ h ].next;
+            _items[ h ].data = DataType( aabb, val );
+        }
+        else
+        {
+            h = (Handle) _items.size();
+            _items.push_back( { DataType( aabb, val ), NO_NODE, NULL_HANDLE, NULL_HANDLE } );
         }
 
-        return pTree->insert( aabb, val );
+        _place( h, 0 );
+        ++_size;
+        return h;
     }
 
-    bool test( const AABB& aabb )
+    // Removes an object. The handle may be reused by a later insert.
+    void remove( Handle h )
     {
-        if ( !intersects( aabb ) )
-            return false;
-
-        for ( DataType& data : _objs )
-            if ( &aabb != (AABB*) &data && aabb.intersects( data ) )
-                return true;
+        int node = _items[ h ].node;
+        _unlink( h );
+        _items[ h ].data = DataType();
+        _items[ h ].next = _freeItem;
+        _freeItem = h;
+        --_size;
+
+        _collapse( node );
+    }
 
-        if ( isSubdivided() )
-            for ( QuadPtr& pQuad : _quads )
-                if ( pQuad->test( aabb ) )
-                    return true;
+    // Changes the bounds of an object, relocating it only if it left the
+    // loose bounds of its node (or now fits a child of it). An object
+    // which leaves the loose bounds of the root stays in the root.
+    void update( Handle h, const AABB& aabb )
+    {
+        static_cast< AABB& >( _items[ h ].data ) = aabb;
+        _relocate( h );
+    }
 
-        return false;
+    // Relocates an object whose bounds were changed through get().
+    void update( Handle h )
+    {
+        _relocate( h );
     }
 
-    QueryResult query( const AABB& aabb )
+    // Relocates every object whose bounds were changed through get().
+    // Objects still within the loose bounds of their node are not touched.
+    void update()
     {
-        QueryResult result;
-        _subQuery( aabb, result );
-        return result;
+        for ( Handle h = 0; h < (Handle) _items.size(); ++h )
+            if ( _items[ h ].node != NO_NODE )
+                _relocate( h );
     }
 
-    void update( QuadTree* parent = nullptr )
+    // Calls func( handle, data ) for every object which intersects range.
+    // func must not insert, remove or update objects.
+    template< typename Func >
+    void query( const AABB& range, Func&& func )
     {
-        if ( isSubdivided() )
-            for ( QuadPtr& pQuad : _quads )
-                pQuad->update( parent ? parent : this );
+        _visit( range, [&]( int node )
+        {
+            for ( Handle h = _nodes[ node ].first; h != NULL_HANDLE; h = _items[ h ].next )
+                if ( range.intersects( _items[ h ].data ) )
+                    func( h, _items[ h ].data );
+            return true;
+        } );
+    }
 
-        auto tmpObjs = std::move( _objs );
-        _objs.clear();
+    // Writes the handles of up to capacity objects which intersect range
+    // to out. Returns the number of objects found, which may be more than
+    // were written.
+    int query( const AABB& range, Handle* out, int capacity ) const
+    {
+        int found = 0;
+        _visit( range, [&]( int node )
+        {
+            for ( Handle h = _nodes[ node ].first; h != NULL_HANDLE; h = _items[ h ].next )
+                if ( range.intersects( _items[ h ].data ) && found++ < capacity )
+                    out[ found - 1 ] = h;
+            return true;
+        } );
+        return found;
+    }
 
-        for ( DataType& data : tmpObjs )
+    // Returns true if any object intersects range.
+    bool test( const AABB& range ) const
+    {
+        bool hit = false;
+        _visit( range, [&]( int node )
         {
-            if ( !contains( data ) )
-            {
-                if ( parent )
-                    parent->insert( data, data.load );
-            }
-            else
+            for ( Handle h = _nodes[ node ].first; h != NULL_HANDLE; h = _items[ h ].next )
             {
-                insert( data, data.load );
+                if ( range.intersects( _items[ h ].data ) )
+                {
+                    hit = true;
+                    return false;
+                }
             }
-        }
+            return true;
+        } );
+        return hit;
+    }
 
-        if ( empty() )
-            clear();
+    // Calls func( data, level ) for every object, level being the depth of
+    // the node keeping it.
+    template< typename Func >
+    void forEach( Func&& func )
+    {
+        for ( Item& item : _items )
+            if ( item.node != NO_NODE )
+                std::invoke( func, item.data, (size_t) _nodes[ item.node ].depth );
     }
 
+    // Removes every object.
     void clear()
     {
-        _objs.clear();
-
-        if ( isSubdivided() )
-            for ( QuadPtr& pQuad : _quads )
-                pQuad = nullptr; // Frees subtree.
+        _nodes.resize( 1 );
+        _nodes[ 0 ] = { _nodes[ 0 ].bounds, NO_NODE, NO_NODE, NULL_HANDLE, 0, 0, 0 };
+        _freeQuads.clear();
+        _items.clear();
+        _freeItem = NULL_HANDLE;
+        _size = 0;
     }
 
+    // Removes every object which intersects range.
     void clear( const AABB& range )
     {
-        if ( !intersects( range ) )
-            return;
-
-        ObjStorage tmp = move( _objs );
-        _objs.clear();
-
-        for ( DataType& data : tmp )
-            if ( !range.intersects( data ) )
-                _objs.push_back( data );
-
-        if ( isSubdivided() )
-            for ( QuadPtr& pQuad : _quads )
-                pQuad->clear( range );
+        Handle found[ 64 ];
+        for ( int count; (count = query( range, found, 64 )) > 0; )
+            for ( int i = 0; i < std::min( count, 64 ); ++i )
+                remove( found[ i ] );
     }
-
 };
@@ -2,6 +2,8 @@
 #pragma once
 
 #include "Scene.h"
+#include "FrameArena.h"
+#include "MemoryResource.h"
 
 // Manages a collection of scenes in a stack. Scenes held by this class 
 // are not "owned" by it; each scene must manage its own lifetime outside
@@ -44,6 +46,13 @@ private:
 
 public:
 
+    // Scratch memory for the scenes. Reset at the start of every update, so
+    // allocations from it stay valid until the end of the following frame.
+    FrameArena frameArena;
+
+    // The frame arena as a memory resource, for std::pmr containers.
+    ResourceAdapter< FrameArena > frameResource { frameArena };
+
     // Gets the top scene or nullptr if there are no scenes.
     Scene* topScene()
     {
@@ -86,9 +95,12 @@ public:
             popScene();
     }
 
-    // Applies pending stack transactions then updates the top scene.
+    // Advances the frame arena, applies pending stack transactions then
+    // updates the top scene.
     void update( unsigned ticks )
     {
+        frameArena.nextFrame();
+
         for ( Scene* scene : _pendingScenes )
             if ( scene == nullptr )
                 _popScene( ticks );
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+#if defined( _M_X64 ) || defined( __SSE2__ ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 2)
+#define SEARCH_SSE2 1
+#include <emmintrin.h>
+#else
+#define SEARCH_SSE2 0
+#endif
+
+// Sorted ranges with fewer elements than this are searched with a linear
+// scan. Below this size a scan touches at most a few cache lines and has
+// no data-dependent branches, which beats any form of binary search.
+constexpr size_t LINEAR_SEARCH_THRESHOLD = 64;
+
+namespace detail
+{
+    // Hints the processor to fetch the cache line containing ptr.
+    inline void prefetch( const void* ptr )
+    {
+    #if SEARCH_SSE2
+        _mm_prefetch( (const char*) ptr, _MM_HINT_T0 );
+    #elif defined( __GNUC__ )
+        __builtin_prefetch( ptr );
+    #endif
+    }
+
+    // Counts the elements in [first, first + count) which are less than value.
+    template< typename T >
+    size_t count_less( const T* first, size_t count, const T& value )
+    {
+        size_t n = 0;
+        for ( size_t i = 0; i < count; ++i )
+            n += first[ i ] < value;
+        return n;
+    }
+
+#if SEARCH_SSE2
+    // SSE2 version of count_less for 32-bit integers. Unsigned keys are
+    // biased into the signed range since SSE2 only has a signed compare.
+    template< typename T >
+    size_t count_less_sse2( const T* first, size_t count, T value )
+    {
+        static_assert( sizeof( T ) == 4, "count_less_sse2: requires 32-bit keys" );
+
+        const int32_t bias = std::is_signed< T >::value ? 0 : INT32_MIN;
+        const __m128i vBias = _mm_set1_epi32( bias );
+        const __m128i vKey = _mm_set1_epi32( int32_t( value ) ^ bias );
+
+        __m128i acc0 = _mm_setzero_si128();
+        __m128i acc1 = _mm_setzero_si128();
+        size_t i = 0;
+
+        // Each lane of a compare result is 0 or -1; subtracting counts.
+        for ( ; i + 8 <= count; i += 8 )
+        {
+            __m128i a = _mm_loadu_si128( (const __m128i*) (first + i) );
+            __m128i b = _mm_loadu_si128( (const __m128i*) (first + i + 4) );
+            acc0 = _mm_sub_epi32( acc0, _mm_cmplt_epi32( _mm_xor_si128( a, vBias ), vKey ) );
+            acc1 = _mm_sub_epi32( acc1, _mm_cmplt_epi32( _mm_xor_si128( b, vBias ), vKey ) );
+        }
+
+        __m128i acc = _mm_add_epi32( acc0, acc1 );
+        acc = _mm_add_epi32( acc, _mm_shuffle_epi32( acc, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        acc = _mm_add_epi32( acc, _mm_shuffle_epi32( acc, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+
+        size_t n = (size_t) _mm_cvtsi128_si32( acc );
+        for ( ; i < count; ++i )
+            n += first[ i ] < value;
+        return n;
+    }
+#endif
+}
+
+// Returns a pointer to the first element in the sorted range
+// [first, first + count) which is not less than value. Scans every element,
+// using SSE2 for 32-bit integer keys. Best for small ranges.
+template< typename T >
+const T* linear_lower_bound( const T* first, size_t count, const T& value )
+{
+#if SEARCH_SSE2
+    if constexpr ( std::is_integral< T >::value && sizeof( T ) == 4 )
+        return first + detail::count_less_sse2( first, count, value );
+    else
+#endif
+        return first + detail::count_less( first, count, value );
+}
+
+// Returns a pointer to the first element in the sorted range
+// [first, first + count) which is not less than value. The loop body has
+// no data-dependent branches (the select compiles to a conditional move)
+// and both candidate midpoints of the next step are prefetched.
+template< typename T >
+const T* branchless_lower_bound( const T* first, size_t count, const T& value )
+{
+    if ( count == 0 )
+        return first;
+
+    const T* base = first;
+
+    while ( count > 1 )
+    {
+        size_t half = count / 2;
+        detail::prefetch( base + half / 2 );
+        detail::prefetch( base + half + half / 2 );
+        base = (base[ half ] < value) ? base + half : base;
+        count -= half;
+    }
+
+    return base + (*base < value);
+}
+
+// Returns a pointer to the first element in the sorted range
+// [first, first + count) which is not less than value. Chooses between a
+// linear scan and a branchless binary search based on the size of the range.
+template< typename T >
+const T* sorted_lower_bound( const T* first, size_t count, const T& value )
+{
+    return count < LINEAR_SEARCH_THRESHOLD
+        ? linear_lower_bound( first, count, value )
+        : branchless_lower_bound( first, count, value );
+}
+
+// Returns an iterator to the first element in the sorted range [first, last)
+// which is not less than value. The range must be contiguous in memory.
+template< typename Itr, typename T >
+Itr sorted_lower_bound( Itr first, Itr last, const T& value )
+{
+    using Value = std::remove_cv_t< std::remove_reference_t< decltype( *first ) > >;
+
+    auto count = std::distance( first, last );
+    if ( count == 0 )
+        return first;
+
+    const Value* pFirst = std::addressof( *first );
+    return first + (sorted_lower_bound( pFirst, size_t( count ), Value( value ) ) - pFirst);
+}
+
+// Returns an iterator to the first element in the sorted container
+// which is not less than value.
+template< typename Cont, typename T >
+auto sorted_lower_bound( Cont& cont, const T& value )
+{
+    return sorted_lower_bound( std::begin( cont ), std::end( cont ), value );
+}
+
+// Searches the sorted range [first, last) for value. Returns an iterator to
+// the matched element on success; or last on failure.
+template< typename Itr, typename T >
+Itr sorted_find( Itr first, Itr last, const T& value )
+{
+    Itr itr = sorted_lower_bound( first, last, value );
+    return itr != last && !(value < *itr) ? itr : last;
+}
+
+// Searches the sorted container for value. Returns an iterator to the
+// matched element on success; or end() on failure.
+template< typename Cont, typename T >
+auto sorted_find( Cont& cont, const T& value )
+{
+    return sorted_find( std::begin( cont ), std::end( cont ), value );
+}
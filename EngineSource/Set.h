@@ -3,6 +3,7 @@
 #include <vector>
 #include <set>
 #include "Util.h"
+#include "Search.h"
 
 template< typename T >
 class Set
@@ -17,17 +18,21 @@ public:
 
     void add( Value value )
     {
-        _array.insert( binary_search( _array, value ), move( value ) );
+        auto where = sorted_lower_bound( _array, value );
+        if ( where == _array.end() || value < *where )
+            _array.insert( where, move( value ) );
     }
 
     void remove( const Value& value )
     {
-        _array.erase( binary_search( _array, value ) );
+        auto where = sorted_find( _array, value );
+        if ( where != _array.end() )
+            _array.erase( where );
     }
 
     bool contains( const Value& value ) const
     {
-        return binary_search( _array, value ) != _array.end();
+        return sorted_find( _array, value ) != _array.end();
     }
 
     auto begin()
@@ -0,0 +1,459 @@
+#pragma once
+
+#include "Memory.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <utility>
+
+// A growable struct-of-arrays vector. Each of the Types is stored in its
+// own contiguous column and all columns share one allocation carved up by
+// jalloc_aligned. Datawise, the allocated memory looks like this:
+//     struct AllocatedMemory {
+//         alignas( ALIGNMENT ) T0 column0[ N ];
+//         alignas( ALIGNMENT ) T1 column1[ N ];
+//         ...
+//     };
+// where N is the capacity of the vector. Iteration yields tuples of
+// references so elements can be unpacked with structured bindings:
+//     for ( auto [ pos, vel ] : particles )
+//         pos += vel;
+template< typename... Types >
+class SoAVector
+{
+public:
+
+    static_assert( sizeof...(Types) > 0, "SoAVector: requires at least one column" );
+
+    // Number of columns (one per type).
+    static constexpr size_t COLUMN_COUNT = sizeof...(Types);
+
+    // Alignment of the start of every column. Suitable for 256-bit SIMD.
+    static constexpr size_t ALIGNMENT = std::max( { size_t( 32 ), alignof( Types )... } );
+
+    using Reference      = tuple< Types&... >;
+    using ConstReference = tuple< const Types&... >;
+
+    template< size_t I >
+    using ColumnType = std::tuple_element_t< I, std::tuple< Types... > >;
+
+    template< typename Ref >
+    class _iterator;
+
+    using Iterator      = _iterator< Reference >;
+    using ConstIterator = _iterator< ConstReference >;
+
+private:
+
+    using Columns = std::tuple< Types*... >;
+    using Indices = std::index_sequence_for< Types... >;
+
+    void*   _pData;    // Pointer to the allocated memory.
+    Columns _columns;  // Pointers to the start of each column within _pData.
+    size_t  _capacity; // Maximum number of elements that can be stored by _pData.
+    size_t  _count;    // Current number of elements that are stored by _pData.
+
+    // Allocates a block of memory for all of the columns.
+    static void* _allocate( size_t size )
+    {
+        return aligned_malloc( size, ALIGNMENT );
+    }
+
+    // Deallocates a block of memory used by the columns.
+    static void _deallocate( void* pData )
+    {
+        aligned_free( pData );
+    }
+
+    // Allocates room for capacity elements in every column and points
+    // columns at the start of each one. Returns the allocation.
+    template< size_t... Is >
+    static void* _allocateColumns( Columns& columns, size_t capacity,
+                                   std::index_sequence< Is... > )
+    {
+        return jalloc_aligned< ALIGNMENT >( _allocate,
+            std::tuple< Types*&... >( std::get< Is >( columns )... ),
+            ((void) Is, capacity)... );
+    }
+
+    // Moves count elements from one column to another, destroying the
+    // moved-from elements.
+    template< typename T >
+    static void _relocate( T* dest, T* src, size_t count )
+    {
+        if constexpr ( std::is_trivially_copyable_v< T > )
+        {
+            if ( count > 0 )
+                std::memcpy( dest, src, count * sizeof( T ) );
+        }
+        else
+        {
+            for ( size_t i = 0; i < count; ++i )
+            {
+                new( dest + i ) T( std::move( src[ i ] ) );
+                src[ i ].~T();
+            }
+        }
+    }
+
+    template< size_t... Is >
+    void _relocateColumns( Columns& dest, std::index_sequence< Is... > )
+    {
+        auto _ = { (_relocate( std::get< Is >( dest ),
+                               std::get< Is >( _columns ), _count ), 0)..., 0 };
+    }
+
+    template< size_t... Is >
+    void _copyColumns( const SoAVector& copy, std::index_sequence< Is... > )
+    {
+        for ( size_t i = 0; i < copy._count; ++i )
+            auto _ = { (new( std::get< Is >( _columns ) + i )
+                Types( std::get< Is >( copy._columns )[ i ] ), 0)..., 0 };
+    }
+
+    // Constructs an element in every column at a specific index.
+    template< size_t... Is, typename... Args >
+    void _construct( size_t pos, std::index_sequence< Is... >, Args&&... args )
+    {
+        auto _ = { (new( std::get< Is >( _columns ) + pos )
+            Types( forward< Args >( args ) ), 0)..., 0 };
+    }
+
+    // Destroys the element in every column at a specific index.
+    void _destroy( size_t pos )
+    {
+        TUPLE_FOR( auto* column, _columns ) {
+            destroy( column[ pos ] );
+        };
+    }
+
+    // Allocates memory, moves elements, then deallocates memory.
+    // All columns are reallocated together in a single block.
+    void _reallocate( size_t capacity )
+    {
+        assert( capacity >= _count );
+
+        Columns columns;
+        void* pData = _allocateColumns( columns, capacity, Indices {} );
+
+        _relocateColumns( columns, Indices {} );
+        _deallocate( _pData );
+
+        _pData = pData;
+        _columns = columns;
+        _capacity = capacity;
+    }
+
+    // Reallocates to hold at least one more element.
+    void _grow()
+    {
+        _reallocate( _capacity < 8 ? 8 : _capacity * 2 );
+    }
+
+    template< size_t... Is >
+    Reference _at( size_t pos, std::index_sequence< Is... > )
+    {
+        return Reference( std::get< Is >( _columns )[ pos ]... );
+    }
+
+    template< size_t... Is >
+    ConstReference _at( size_t pos, std::index_sequence< Is... > ) const
+    {
+        return ConstReference( std::get< Is >( _columns )[ pos ]... );
+    }
+
+public:
+
+    // Allocates memory for capacity elements in every column.
+    explicit SoAVector( size_t capacity = 0 )
+        : _pData( nullptr )
+        , _columns {}
+        , _capacity( 0 )
+        , _count( 0 )
+    {
+        if ( capacity > 0 )
+            _reallocate( capacity );
+    }
+
+    // Clears and deallocates the vector.
+    ~SoAVector()
+    {
+        clear();
+        _deallocate( _pData );
+    }
+
+    // Copies the contents of a vector into the constructed vector.
+    SoAVector( const SoAVector& copy )
+        : SoAVector( copy._count )
+    {
+        _copyColumns( copy, Indices {} );
+        _count = copy._count;
+    }
+
+    // Moves the contents from a vector into the constructed vector.
+    SoAVector( SoAVector&& move )
+        : _pData( move._pData )
+        , _columns( move._columns )
+        , _capacity( move._capacity )
+        , _count( move._count )
+    {
+        move._pData = nullptr;
+        move._columns = {};
+        move._capacity = 0;
+        move._count = 0;
+    }
+
+    // Copies the contents of one vector into another vector.
+    SoAVector& operator =( const SoAVector& copy )
+    {
+        SoAVector tmp( copy );
+        swap( tmp );
+        return *this;
+    }
+
+    // Moves the contents from one vector into another vector.
+    SoAVector& operator =( SoAVector&& move )
+    {
+        swap( move );
+        return *this;
+    }
+
+    void swap( SoAVector& other )
+    {
+        std::swap( _pData, other._pData );
+        std::swap( _columns, other._columns );
+        std::swap( _capacity, other._capacity );
+        std::swap( _count, other._count );
+    }
+
+    // Returns the number of elements in every column.
+    size_t size() const
+    {
+        return _count;
+    }
+
+    // Returns the number of elements that can be held without
+    // automatically reallocating memory.
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    bool empty() const
+    {
+        return _count == 0;
+    }
+
+    // Ensures room for at least capacity elements.
+    void reserve( size_t capacity )
+    {
+        if ( capacity > _capacity )
+            _reallocate( capacity );
+    }
+
+    // Reallocates so that capacity matches the number of elements.
+    void shrink_to_fit()
+    {
+        if ( _capacity != _count )
+            _reallocate( _count );
+    }
+
+    // Empties the vector without deallocating memory.
+    void clear()
+    {
+        while ( _count > 0 )
+            _destroy( --_count );
+    }
+
+    // Resizes the vector, value-initializing any new elements.
+    void resize( size_t size )
+    {
+        reserve( size );
+
+        while ( _count > size )
+            _destroy( --_count );
+
+        for ( ; _count < size; ++_count )
+            _construct( _count, Indices {}, Types {}... );
+    }
+
+    // Appends an element to the end of every column.
+    void push_back( Types... values )
+    {
+        if ( _count == _capacity )
+            _grow();
+
+        _construct( _count, Indices {}, std::move( values )... );
+        ++_count;
+    }
+
+    // Removes the last element from every column.
+    void pop_back()
+    {
+        assert( _count > 0 );
+        _destroy( --_count );
+    }
+
+    // Removes the element at a specific index, preserving the order of
+    // the remaining elements.
+    void erase( size_t pos )
+    {
+        assert( pos < _count );
+
+        TUPLE_FOR( auto* column, _columns ) {
+            for ( size_t i = pos; i + 1 < _count; ++i )
+                column[ i ] = std::move( column[ i + 1 ] );
+        };
+        _destroy( --_count );
+    }
+
+    // Removes the element at a specific index by moving the last element
+    // into its place. Does not preserve order, but runs in O(1).
+    void swapRemove( size_t pos )
+    {
+        assert( pos < _count );
+
+        if ( pos + 1 != _count )
+        {
+            TUPLE_FOR( auto* column, _columns ) {
+                column[ pos ] = std::move( column[ _count - 1 ] );
+            };
+        }
+        _destroy( --_count );
+    }
+
+    // Indexed element access. Returns a tuple of references.
+    Reference operator []( size_t pos )
+    {
+        assert( pos < _count );
+        return _at( pos, Indices {} );
+    }
+
+    // Indexed const-element access. Returns a tuple of references.
+    ConstReference operator []( size_t pos ) const
+    {
+        assert( pos < _count );
+        return _at( pos, Indices {} );
+    }
+
+    // Gets the column at index I.
+    template< size_t I >
+    Array< ColumnType< I > > column()
+    {
+        return { std::get< I >( _columns ), _count };
+    }
+
+    // Gets the column at index I.
+    template< size_t I >
+    Array< const ColumnType< I > > column() const
+    {
+        return { std::get< I >( _columns ), _count };
+    }
+
+    // Gets the (first) column of type T.
+    template< typename T >
+    Array< T > column()
+    {
+        return column< tuple_element_index< T, std::tuple< Types... > >::value >();
+    }
+
+    // Gets the (first) column of type T.
+    template< typename T >
+    Array< const T > column() const
+    {
+        return column< tuple_element_index< T, std::tuple< Types... > >::value >();
+    }
+
+    #pragma region Iterators
+
+    template< typename Ref >
+    class _iterator
+    {
+        using VectorType = std::conditional_t<
+            std::is_same< Ref, ConstReference >::value,
+            const SoAVector, SoAVector >;
+
+        VectorType* _pVec;
+        size_t      _index;
+
+    public:
+
+        _iterator( VectorType* pVec, size_t index )
+            : _pVec( pVec )
+            , _index( index )
+        {
+        }
+
+        size_t index() const
+        {
+            return _index;
+        }
+
+        Ref operator *() const
+        {
+            return (*_pVec)[ _index ];
+        }
+
+        _iterator& operator ++()
+        {
+            ++_index;
+            return *this;
+        }
+
+        _iterator& operator --()
+        {
+            --_index;
+            return *this;
+        }
+
+        _iterator operator ++(int)
+        {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        _iterator operator --(int)
+        {
+            auto tmp = *this;
+            --*this;
+            return tmp;
+        }
+
+        bool operator ==( const _iterator& itr ) const
+        {
+            return _index == itr._index;
+        }
+
+        bool operator !=( const _iterator& itr ) const
+        {
+            return _index != itr._index;
+        }
+    };
+
+    Iterator begin()
+    {
+        return Iterator( this, 0 );
+    }
+
+    Iterator end()
+    {
+        return Iterator( this, _count );
+    }
+
+    ConstIterator begin() const
+    {
+        return ConstIterator( this, 0 );
+    }
+
+    ConstIterator end() const
+    {
+        return ConstIterator( this, _count );
+    }
+
+    #pragma endregion
+};
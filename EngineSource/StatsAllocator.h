@@ -0,0 +1,404 @@
+// Andrew Meckling
+#pragma once
+
+#include "Allocators.h"
+#include "Bits.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#pragma intrinsic( _ReturnAddress )
+#define STATS_NOINLINE __declspec( noinline )
+#define STATS_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define STATS_NOINLINE __attribute__(( noinline ))
+#define STATS_RETURN_ADDRESS() __builtin_return_address( 0 )
+#endif
+
+// Allocation statistics for one subsystem. All counters are updated with
+// relaxed atomics so they may be read at any time from any thread; reads
+// taken while other threads allocate are approximate.
+// Every instance registers itself in a global list which can be walked
+// with first()/next() or written out with dumpAll().
+class AllocationStats
+{
+public:
+
+    // Number of power-of-2 size buckets in the histogram. Bucket i counts
+    // allocations of [2^(i-1), 2^i) bytes; the last bucket is open ended.
+    static constexpr size_t HISTOGRAM_SIZE = 32;
+
+    // Number of distinct call sites tracked. Sites past this are counted
+    // together as "other".
+    static constexpr size_t MAX_CALL_SITES = 64;
+
+    struct CallSite
+    {
+        std::atomic< uintptr_t > address { 0 }; // Return address of the caller.
+        std::atomic< size_t >    count { 0 };   // Number of allocations made there.
+        std::atomic< size_t >    bytes { 0 };   // Total bytes allocated there.
+    };
+
+private:
+
+    const char* _name;
+    AllocationStats* _pNext;
+
+    std::atomic< size_t > _bytesInUse { 0 };
+    std::atomic< size_t > _peakBytes { 0 };
+    std::atomic< size_t > _totalBytes { 0 };
+    std::atomic< size_t > _allocations { 0 };
+    std::atomic< size_t > _deallocations { 0 };
+    std::atomic< size_t > _failures { 0 };
+    std::atomic< size_t > _histogram[ HISTOGRAM_SIZE ] = {};
+
+    CallSite _sites[ MAX_CALL_SITES ];
+    std::atomic< size_t > _otherSites { 0 };
+
+    static inline AllocationStats* sFirst = nullptr;
+
+    static size_t _bucket( size_t size )
+    {
+        size_t bucket = 64 - count_leading_zeros( size );
+        return bucket < HISTOGRAM_SIZE ? bucket : HISTOGRAM_SIZE - 1;
+    }
+
+    // Adds to the bytes in use, raising the peak if needed.
+    void _addBytes( size_t size )
+    {
+        size_t inUse = _bytesInUse.fetch_add( size, std::memory_order_relaxed ) + size;
+        size_t peak = _peakBytes.load( std::memory_order_relaxed );
+        while ( inUse > peak && !_peakBytes.compare_exchange_weak( peak, inUse,
+                                                                   std::memory_order_relaxed ) )
+            ;
+        _totalBytes.fetch_add( size, std::memory_order_relaxed );
+    }
+
+    // Finds or claims the slot for a call site by open addressing.
+    CallSite* _site( uintptr_t address )
+    {
+        size_t hash = size_t( (address * 0x9E3779B97F4A7C15ull) >> 32 );
+
+        for ( size_t i = 0; i < 8; ++i )
+        {
+            CallSite& site = _sites[ (hash + i) % MAX_CALL_SITES ];
+            uintptr_t current = site.address.load( std::memory_order_relaxed );
+
+            if ( current == address )
+                return &site;
+
+            if ( current == 0 && site.address.compare_exchange_strong( current, address,
+                                                                        std::memory_order_relaxed ) )
+                return &site;
+
+            if ( current == address )
+                return &site;
+        }
+        return nullptr;
+    }
+
+public:
+
+    // Registers the statistics under name, which must outlive this object.
+    explicit AllocationStats( const char* name )
+        : _name( name )
+        , _pNext( sFirst )
+    {
+        sFirst = this;
+    }
+
+    AllocationStats( const AllocationStats& ) = delete;
+    AllocationStats& operator =( const AllocationStats& ) = delete;
+
+    // Records a successful allocation made from the call site at address.
+    void recordAllocate( size_t size, const void* address )
+    {
+        _addBytes( size );
+        _allocations.fetch_add( 1, std::memory_order_relaxed );
+        _histogram[ _bucket( size ) ].fetch_add( 1, std::memory_order_relaxed );
+
+        if ( CallSite* pSite = _site( uintptr_t( address ) ) )
+        {
+            pSite->count.fetch_add( 1, std::memory_order_relaxed );
+            pSite->bytes.fetch_add( size, std::memory_order_relaxed );
+        }
+        else
+        {
+            _otherSites.fetch_add( 1, std::memory_order_relaxed );
+        }
+    }
+
+    // Records a block changing size from oldSize to newSize bytes.
+    void recordResize( size_t oldSize, size_t newSize )
+    {
+        if ( newSize > oldSize )
+            _addBytes( newSize - oldSize );
+        else
+            _bytesInUse.fetch_sub( oldSize - newSize, std::memory_order_relaxed );
+    }
+
+    // Records an allocation which returned null.
+    void recordFailure()
+    {
+        _failures.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    // Records a deallocation.
+    void recordDeallocate( size_t size )
+    {
+        _bytesInUse.fetch_sub( size, std::memory_order_relaxed );
+        _deallocations.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    const char* name() const { return _name; }
+
+    // Returns the number of bytes currently allocated.
+    size_t bytesInUse() const { return _bytesInUse.load( std::memory_order_relaxed ); }
+
+    // Returns the highest value bytesInUse() has reached.
+    size_t peakBytes() const { return _peakBytes.load( std::memory_order_relaxed ); }
+
+    // Returns the number of bytes allocated over all time.
+    size_t totalBytes() const { return _totalBytes.load( std::memory_order_relaxed ); }
+
+    size_t allocations() const { return _allocations.load( std::memory_order_relaxed ); }
+    size_t deallocations() const { return _deallocations.load( std::memory_order_relaxed ); }
+    size_t failures() const { return _failures.load( std::memory_order_relaxed ); }
+
+    // Returns the number of allocations in a histogram bucket.
+    size_t histogram( size_t bucket ) const
+    {
+        return _histogram[ bucket ].load( std::memory_order_relaxed );
+    }
+
+    // Returns a tracked call site (its address is 0 if unused).
+    const CallSite& callSite( size_t index ) const
+    {
+        return _sites[ index ];
+    }
+
+    // Returns the number of allocations from untracked call sites.
+    size_t otherCallSites() const
+    {
+        return _otherSites.load( std::memory_order_relaxed );
+    }
+
+    // Resets the counters (but not bytesInUse, which would underflow).
+    void reset()
+    {
+        _peakBytes.store( bytesInUse(), std::memory_order_relaxed );
+        _totalBytes.store( 0, std::memory_order_relaxed );
+        _allocations.store( 0, std::memory_order_relaxed );
+        _deallocations.store( 0, std::memory_order_relaxed );
+        _failures.store( 0, std::memory_order_relaxed );
+        _otherSites.store( 0, std::memory_order_relaxed );
+
+        for ( auto& bucket : _histogram )
+            bucket.store( 0, std::memory_order_relaxed );
+
+        for ( CallSite& site : _sites )
+        {
+            site.count.store( 0, std::memory_order_relaxed );
+            site.bytes.store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    // Writes a human readable report to file.
+    void dump( FILE* file ) const
+    {
+        fprintf( file, "[%s]\n", _name );
+        fprintf( file, "  in use:        %zu bytes\n", bytesInUse() );
+        fprintf( file, "  peak:          %zu bytes\n", peakBytes() );
+        fprintf( file, "  total:         %zu bytes\n", totalBytes() );
+        fprintf( file, "  allocations:   %zu\n", allocations() );
+        fprintf( file, "  deallocations: %zu\n", deallocations() );
+        fprintf( file, "  failures:      %zu\n", failures() );
+
+        fprintf( file, "  sizes:\n" );
+        for ( size_t i = 0; i < HISTOGRAM_SIZE; ++i )
+            if ( size_t count = histogram( i ) )
+                fprintf( file, "    < %-10zu %zu\n", size_t( 1 ) << i, count );
+
+        fprintf( file, "  call sites:\n" );
+        for ( const CallSite& site : _sites )
+            if ( uintptr_t address = site.address.load( std::memory_order_relaxed ) )
+                fprintf( file, "    %#018llx %zu allocs, %zu bytes\n",
+                         (unsigned long long) address,
+                         site.count.load( std::memory_order_relaxed ),
+                         site.bytes.load( std::memory_order_relaxed ) );
+
+        if ( size_t other = otherCallSites() )
+            fprintf( file, "    other              %zu allocs\n", other );
+    }
+
+    // Returns the first registered AllocationStats object.
+    static const AllocationStats* first()
+    {
+        return sFirst;
+    }
+
+    // Returns the next registered AllocationStats object.
+    const AllocationStats* next() const
+    {
+        return _pNext;
+    }
+
+    // Writes the report of every registered AllocationStats object to a
+    // file. Returns false if the file could not be opened.
+    static bool dumpAll( const char* path )
+    {
+        FILE* file = fopen( path, "w" );
+        if ( !file )
+            return false;
+
+        for ( const AllocationStats* pStats = first(); pStats; pStats = pStats->next() )
+            pStats->dump( file );
+
+        fclose( file );
+        return true;
+    }
+};
+
+
+// Subsystem tags for StatsAllocator. A tag only needs a NAME.
+namespace AllocTag
+{
+    struct General     { static constexpr const char* NAME = "General"; };
+    struct Ecs         { static constexpr const char* NAME = "ECS"; };
+    struct Audio       { static constexpr const char* NAME = "Audio"; };
+    struct Textures    { static constexpr const char* NAME = "Textures"; };
+    struct Pathfinding { static constexpr const char* NAME = "Pathfinding"; };
+}
+
+
+// Forwards to Parent and records statistics for the subsystem Tag. All
+// StatsAllocators with the same Tag share one AllocationStats object.
+// The call site recorded is the return address of allocate(), which is
+// kept out of line for that reason.
+template< class Parent, class Tag = AllocTag::General >
+class StatsAllocator
+    : protected Parent
+{
+    using P = Parent;
+
+    static inline AllocationStats sStats { Tag::NAME };
+
+public:
+
+    // Returns the statistics for Tag.
+    static const AllocationStats& stats()
+    {
+        return sStats;
+    }
+
+    STATS_NOINLINE Blk allocate( size_t size )
+    {
+        Blk blk = P::allocate( size );
+        if ( blk.ptr )
+            sStats.recordAllocate( blk.size, STATS_RETURN_ADDRESS() );
+        else
+            sStats.recordFailure();
+        return blk;
+    }
+
+    void deallocate( Blk blk )
+    {
+        if ( blk.ptr )
+            sStats.recordDeallocate( blk.size );
+        P::deallocate( blk );
+    }
+
+    bool owns( void* ptr )
+    {
+        return P::owns( ptr );
+    }
+
+    STATS_NOINLINE Blk alignedAllocate( size_t size, size_t align )
+    {
+        Blk blk = allocator_aligned_allocate( _parent(), size, align );
+        if ( blk.ptr )
+            sStats.recordAllocate( blk.size, STATS_RETURN_ADDRESS() );
+        else
+            sStats.recordFailure();
+        return blk;
+    }
+
+    bool expand( Blk& blk, size_t delta )
+    {
+        size_t size = blk.size;
+        if ( !allocator_expand( _parent(), blk, delta ) )
+            return false;
+
+        sStats.recordResize( size, blk.size );
+        return true;
+    }
+
+    bool reallocate( Blk& blk, size_t size )
+    {
+        Blk prev = blk;
+        if ( !allocator_reallocate( _parent(), blk, size ) )
+            return false;
+
+        sStats.recordResize( prev.ptr ? prev.size : 0, blk.ptr ? blk.size : 0 );
+        return true;
+    }
+
+private:
+
+    P& _parent() { return *this; }
+};
+
+
+// Adapts StatsAllocator< Parent, Tag > to the standard library allocator
+// requirements, so that std containers owned by a subsystem are counted
+// under its Tag. Stateless, unlike StdAllocator, so containers using it are
+// default constructible and freely copied and swapped.
+template< typename T, class Tag, class Parent = Mallocator >
+class StatsStdAllocator
+{
+public:
+
+    using value_type = T;
+
+    template< typename U >
+    struct rebind
+    {
+        using other = StatsStdAllocator< U, Tag, Parent >;
+    };
+
+    StatsStdAllocator() noexcept = default;
+
+    template< typename U >
+    StatsStdAllocator( const StatsStdAllocator< U, Tag, Parent >& ) noexcept
+    {
+    }
+
+    T* allocate( size_t count )
+    {
+        Blk blk = StatsAllocator< Parent, Tag >().allocate( count * sizeof( T ) );
+        if ( !blk.ptr )
+            throw std::bad_alloc();
+        return (T*) blk.ptr;
+    }
+
+    void deallocate( T* ptr, size_t count )
+    {
+        StatsAllocator< Parent, Tag >().deallocate( { ptr, count * sizeof( T ) } );
+    }
+
+    template< typename U >
+    bool operator ==( const StatsStdAllocator< U, Tag, Parent >& ) const noexcept
+    {
+        return true;
+    }
+
+    template< typename U >
+    bool operator !=( const StatsStdAllocator< U, Tag, Parent >& ) const noexcept
+    {
+        return false;
+    }
+};
@@ -1,5 +1,6 @@
 // Andrew Meckling
 #include "TextureManager.h"
+#include "StatsAllocator.h"
 #include "lodepng.h"
 
 // Global array of gl texture objects created by odin::load_texture(...).
@@ -17,18 +18,60 @@ struct gl_texture_unit_deleter
 }
 gl_texture_unit_deleter_instance;
 
+// lodepng.cpp is built with LODEPNG_NO_COMPILE_ALLOCATORS, so every buffer
+// it decodes into comes from these and is counted as texture memory. Blocks
+// keep their size in a header since lodepng_free() is not given it.
+using TextureAllocator = StatsAllocator< Mallocator, AllocTag::Textures >;
+static constexpr size_t LODEPNG_HEADER_SIZE = 16;
+
+void* lodepng_malloc( size_t size )
+{
+    Blk blk = TextureAllocator().allocate( size + LODEPNG_HEADER_SIZE );
+    if ( !blk.ptr )
+        return nullptr;
+
+    *(size_t*) blk.ptr = blk.size;
+    return (char*) blk.ptr + LODEPNG_HEADER_SIZE;
+}
+
+void* lodepng_realloc( void* ptr, size_t size )
+{
+    if ( !ptr )
+        return lodepng_malloc( size );
+
+    char* header = (char*) ptr - LODEPNG_HEADER_SIZE;
+    Blk blk = { header, *(size_t*) header };
+    if ( !TextureAllocator().reallocate( blk, size + LODEPNG_HEADER_SIZE ) )
+        return nullptr;
+
+    *(size_t*) blk.ptr = blk.size;
+    return (char*) blk.ptr + LODEPNG_HEADER_SIZE;
+}
+
+void lodepng_free( void* ptr )
+{
+    if ( !ptr )
+        return;
+
+    char* header = (char*) ptr - LODEPNG_HEADER_SIZE;
+    TextureAllocator().deallocate( { header, *(size_t*) header } );
+}
+
 GLuint load_texture( int index, const char* filename )
 {
-    std::vector< GLubyte > image;
+    unsigned char* image = nullptr;
     unsigned width, height;
 
-    if ( unsigned error = lodepng::decode( image, width, height, filename ) )
+    if ( unsigned error = lodepng_decode32_file( &image, &width, &height, filename ) )
     {
         printf( "Error %u: %s\n", error, lodepng_error_text( error ) );
+        lodepng_free( image );
         return 0;
     }
 
-    return load_texture( index, width, height, (void*) std::data( image ) );
+    GLuint texture = load_texture( index, width, height, image );
+    lodepng_free( image );
+    return texture;
 }
 
 GLuint load_texture( int index, int width, int height, void* data )
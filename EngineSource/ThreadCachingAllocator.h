@@ -0,0 +1,274 @@
+// Andrew Meckling
+#pragma once
+
+#include "Allocators.h"
+#include "ConcurrentQueue.h"
+#include "VirtualArena.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+
+// Size-class allocator where every thread allocates from its own cache
+// without any locking. Memory is carved from spans of SPAN_SIZE bytes
+// (aligned to SPAN_SIZE) and every span records the cache which owns it.
+// Spans are committed from one range of address space reserved up front,
+// so owns() is a range check and the allocator can sit under a
+// FallbackAllocator or Segregator.
+// A block freed by its owning thread goes straight back onto that thread's
+// free list. A block freed by any other thread is pushed onto the owner's
+// lock-free remote-free stack, and the owner takes the whole stack back in
+// one exchange the next time one of its free lists runs dry.
+// When a thread exits, its cache is handed to the next thread which needs
+// one, so spans are never stranded. Spans are never returned to the system.
+// Requests larger than the last size class fail, so compose it as e.g.
+//     ThresholdAllocator< 256, ThreadCachingAllocator< 16, 32, 64, 128, 256 >,
+//                         Mallocator >
+template< size_t... SizeClasses >
+class ThreadCachingAllocator
+{
+public:
+
+    static_assert( sizeof...(SizeClasses) > 0, "ThreadCachingAllocator: requires at least one size class" );
+
+    static constexpr size_t ALIGNMENT = 16;
+    static constexpr size_t SPAN_SIZE = 64 * 1024;
+    static constexpr size_t CLASS_COUNT = sizeof...(SizeClasses);
+    static constexpr size_t SIZES[ CLASS_COUNT ] = { round_to_alignment( SizeClasses, ALIGNMENT )... };
+    static constexpr size_t MAX_SIZE = SIZES[ CLASS_COUNT - 1 ];
+
+    // Address space reserved for spans; allocation fails once it is used.
+    static constexpr size_t RESERVE = sizeof( void* ) == 8 ? size_t( 1 ) << 36 : size_t( 1 ) << 28;
+
+private:
+
+    struct Node
+    {
+        Node* next;
+    };
+
+    struct ThreadCache
+    {
+        Node* freeLists[ CLASS_COUNT ] = {}; // Touched only by the owning thread.
+        ThreadCache* pNextOrphan = nullptr;  // Link in the list of caches without a thread.
+
+        // Blocks freed by other threads. Kept on its own cache line since
+        // every other thread writes to it.
+        alignas( CACHE_LINE_SIZE ) std::atomic< Node* > remoteFree { nullptr };
+    };
+
+    // Header at the start of every span.
+    struct Span
+    {
+        ThreadCache* pOwner;
+        size_t       sizeClass;
+    };
+
+    static constexpr size_t HEADER_SIZE = round_to_alignment( sizeof( Span ), ALIGNMENT );
+
+    static_assert( HEADER_SIZE + MAX_SIZE <= SPAN_SIZE, "ThreadCachingAllocator: size class too large for a span" );
+
+    // The reserved range spans are committed from, in order.
+    struct SpanRange
+    {
+        uintptr_t first = 0;
+        uintptr_t last = 0;
+        std::atomic< uintptr_t > next { 0 };
+
+        SpanRange()
+        {
+            // Reserve an extra span to align the first one.
+            if ( void* pData = virtual_reserve( RESERVE + SPAN_SIZE ) )
+            {
+                first = round_to_alignment( uintptr_t( pData ), SPAN_SIZE );
+                last = first + RESERVE;
+                next = first;
+            }
+        }
+    };
+
+    // Reserved on first use and never released, since blocks may be freed
+    // by other static objects' destructors.
+    static SpanRange& _range()
+    {
+        static SpanRange range;
+        return range;
+    }
+
+    // Orphans this thread's cache when the thread exits.
+    struct CacheHolder
+    {
+        ThreadCache* pCache = nullptr;
+
+        ~CacheHolder()
+        {
+            if ( pCache )
+            {
+                std::lock_guard< std::mutex > lock( sOrphanMutex );
+                pCache->pNextOrphan = sOrphans;
+                sOrphans = pCache;
+            }
+        }
+    };
+
+    static inline std::mutex sOrphanMutex;
+    static inline ThreadCache* sOrphans = nullptr;
+    static inline thread_local CacheHolder tCache;
+
+    // Returns the current thread's cache, adopting an orphan or creating
+    // one on first use.
+    static ThreadCache& _cache()
+    {
+        if ( !tCache.pCache )
+        {
+            {
+                std::lock_guard< std::mutex > lock( sOrphanMutex );
+                if ( (tCache.pCache = sOrphans) )
+                    sOrphans = sOrphans->pNextOrphan;
+            }
+
+            if ( tCache.pCache )
+            {
+                // Adopt the orphan's spans.
+                _reclaim( *tCache.pCache );
+                tCache.pCache->pNextOrphan = nullptr;
+            }
+            else
+            {
+                tCache.pCache = new ThreadCache;
+            }
+        }
+        return *tCache.pCache;
+    }
+
+    static Span* _spanOf( void* ptr )
+    {
+        return (Span*) (uintptr_t( ptr ) & ~uintptr_t( SPAN_SIZE - 1 ));
+    }
+
+    static size_t _sizeClass( size_t size )
+    {
+        size_t cls = 0;
+        while ( SIZES[ cls ] < size )
+            ++cls;
+        return cls;
+    }
+
+    // Moves every block on the remote-free stack onto the local free lists.
+    static void _reclaim( ThreadCache& cache )
+    {
+        Node* pNode = cache.remoteFree.exchange( nullptr, std::memory_order_acquire );
+        while ( pNode )
+        {
+            Node* pNext = pNode->next;
+            Node*& pHead = cache.freeLists[ _spanOf( pNode )->sizeClass ];
+            pNode->next = pHead;
+            pHead = pNode;
+            pNode = pNext;
+        }
+    }
+
+    // Allocates a new span for a size class and threads its blocks onto
+    // the free list.
+    static bool _refill( ThreadCache& cache, size_t cls )
+    {
+        SpanRange& range = _range();
+        uintptr_t span = range.next.fetch_add( SPAN_SIZE, std::memory_order_relaxed );
+        if ( span < range.first || span >= range.last )
+            return false;
+
+        void* pData = (void*) span;
+        if ( !virtual_commit( pData, SPAN_SIZE ) )
+            return false;
+
+        new( pData ) Span { &cache, cls };
+
+        size_t count = (SPAN_SIZE - HEADER_SIZE) / SIZES[ cls ];
+        byte* first = (byte*) pData + HEADER_SIZE;
+        Node*& pHead = cache.freeLists[ cls ];
+
+        for ( size_t i = count; i-- > 0; )
+            pHead = new( first + i * SIZES[ cls ] ) Node { pHead };
+        return true;
+    }
+
+public:
+
+    Blk allocate( size_t size )
+    {
+        if ( size > MAX_SIZE )
+            return { nullptr, 0 };
+
+        size_t cls = _sizeClass( size );
+        ThreadCache& cache = _cache();
+        Node*& pHead = cache.freeLists[ cls ];
+
+        if ( !pHead )
+        {
+            _reclaim( cache );
+            if ( !pHead && !_refill( cache, cls ) )
+                return { nullptr, 0 };
+        }
+
+        Node* pNode = pHead;
+        pHead = pNode->next;
+        return { pNode, size };
+    }
+
+    void deallocate( Blk blk )
+    {
+        if ( blk.ptr == nullptr )
+            return;
+
+        assert( blk.size <= SIZES[ _spanOf( blk.ptr )->sizeClass ] );
+
+        ThreadCache* pOwner = _spanOf( blk.ptr )->pOwner;
+        Node* pNode = new( blk.ptr ) Node;
+
+        if ( pOwner == tCache.pCache )
+        {
+            Node*& pHead = pOwner->freeLists[ _spanOf( blk.ptr )->sizeClass ];
+            pNode->next = pHead;
+            pHead = pNode;
+        }
+        else
+        {
+            pNode->next = pOwner->remoteFree.load( std::memory_order_relaxed );
+            while ( !pOwner->remoteFree.compare_exchange_weak( pNode->next, pNode,
+                        std::memory_order_release, std::memory_order_relaxed ) )
+                ;
+        }
+    }
+
+    // Succeeds while the block still fits in its size class.
+    bool expand( Blk& blk, size_t delta )
+    {
+        if ( blk.size + delta > SIZES[ _spanOf( blk.ptr )->sizeClass ] )
+            return false;
+
+        blk.size += delta;
+        return true;
+    }
+
+    // Returns true if ptr lies in a span of this allocator, whichever
+    // thread it belongs to.
+    bool owns( void* ptr ) const
+    {
+        const SpanRange& range = _range();
+        return range.first <= uintptr_t( ptr ) && uintptr_t( ptr ) < range.last;
+    }
+
+    // Moves blocks freed by other threads back onto this thread's free lists.
+    void collect()
+    {
+        _reclaim( _cache() );
+    }
+};
+
+template< size_t... Sizes >
+constexpr bool operator ==( ThreadCachingAllocator< Sizes... >,
+                            ThreadCachingAllocator< Sizes... > )
+{
+    return true;
+}
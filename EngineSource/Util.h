@@ -365,69 +365,6 @@ inline float random( float min, float max )
     return min + (r * (max - min));
 }
 
-// Performs a binary search over the range. Returns an iterator to 
-// the matched element on success; or end() on failure.
-template< typename Itr >
-Itr binary_search( Itr first, Itr last, const decltype( *first ) target )
-{
-    Itr lower = first;
-    Itr upper = last;
-
-    while ( lower <= upper )
-    {
-        Itr midle = lower + (upper - lower) / 2;
-
-        if ( *midle < target )
-            lower = midle + 1;
-        else if ( target < *midle )
-            upper = midle - 1;
-        else
-            return midle;
-    }
-
-    return last;
-}
-
-// Performs a binary search over the range. Returns an iterator to 
-// the matched element on success; or end() on failure.
-template< typename Cont >
-auto binary_search( Cont& cont, const decltype( *std::begin( cont ) ) target )
-{
-    return binary_search( std::begin( cont ), std::end( cont ), target );
-}
-
-// Performs a binary search over the range. Returns an iterator to 
-// the matched element on success; or the nearest element on failure.
-template< typename Itr >
-Itr binary_search2( Itr first, Itr last, const decltype( *first ) target )
-{
-    Itr lower = first;
-    Itr upper = last;
-    Itr midle = lower + (upper - lower) / 2;
-
-    while ( lower < upper )
-    {
-        if ( *midle < target )
-            lower = midle + 1;
-        else if ( target < *midle )
-            upper = midle - 1;
-        else
-            return midle;
-
-        midle = lower + (upper - lower) / 2;
-    }
-
-    return midle;
-}
-
-// Performs a binary search over the range. Returns an iterator to 
-// the matched element on success; or the nearest element on failure.
-template< typename Cont >
-auto binary_search2( Cont& cont, const decltype( *std::begin( cont ) ) target )
-{
-    return binary_search2( std::begin( cont ), std::end( cont ), target );
-}
-
 template< typename T >
 constexpr T sum( T&& arg )
 {
@@ -782,6 +719,44 @@ auto jalloc( Sizes... sizes )
     //return jalloc( std::malloc, output, sizes... );
 }
 
+namespace detail
+{
+    template< typename... Types, size_t... Is >
+    void jalloc_assign( std::tuple< Types*&... > output, char* base,
+                        const size_t* blockSizes, std::index_sequence< Is... > )
+    {
+        size_t offset = 0;
+        // Hack to repeatedly assign via pack expansion (evaluated in order).
+        auto _ = { ((std::get< Is >( output ) = (Types*) (base + offset),
+                     offset += blockSizes[ Is ]), 0)..., 0 };
+    }
+}
+
+// Like jalloc, but every array begins on an Align byte boundary. The
+// allocation function must return memory aligned to at least Align.
+template< size_t Align, typename AllocFn, typename... Types, typename... Sizes >
+auto jalloc_aligned( AllocFn&& allocate, std::tuple< Types*&... > output, Sizes... sizes )
+    -> enable_if_t< sizeof...(Types) == sizeof...(Sizes), decltype(allocate( 1 )) >
+{
+    static_assert( Align > 0 && (Align & (Align - 1)) == 0,
+                   "jalloc_aligned: Align must be a power of 2" );
+
+    size_t blockSizes[] {
+        (size_t( sizes ) * sizeof( Types ) + Align - 1) & ~(Align - 1)...
+    };
+
+    size_t totalSize = 0;
+    for ( size_t size : blockSizes )
+        totalSize += size;
+
+    auto allocation = allocate( totalSize );
+    char* base = (char*) detail::get_ptr( allocation );
+
+    detail::jalloc_assign( output, base, blockSizes,
+                           std::index_sequence_for< Types... >{} );
+    return allocation;
+}
+
 // Empty tuple case.
 template< typename Func >
 void tuple_for( const std::tuple<>&, Func&& )
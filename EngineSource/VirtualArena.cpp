@@ -0,0 +1,70 @@
+#include "VirtualArena.h"
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+
+void* virtual_reserve( size_t size )
+{
+    return VirtualAlloc( nullptr, size, MEM_RESERVE, PAGE_NOACCESS );
+}
+
+bool virtual_commit( void* ptr, size_t size )
+{
+    return VirtualAlloc( ptr, size, MEM_COMMIT, PAGE_READWRITE ) != nullptr;
+}
+
+void virtual_decommit( void* ptr, size_t size )
+{
+    VirtualFree( ptr, size, MEM_DECOMMIT );
+}
+
+void virtual_release( void* ptr, size_t )
+{
+    VirtualFree( ptr, 0, MEM_RELEASE );
+}
+
+size_t virtual_page_size()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo( &info );
+    return info.dwPageSize;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+void* virtual_reserve( size_t size )
+{
+    void* ptr = mmap( nullptr, size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+bool virtual_commit( void* ptr, size_t size )
+{
+    return mprotect( ptr, size, PROT_READ | PROT_WRITE ) == 0;
+}
+
+void virtual_decommit( void* ptr, size_t size )
+{
+    // Drop the pages first so they read back as zero if committed again.
+    madvise( ptr, size, MADV_DONTNEED );
+    mprotect( ptr, size, PROT_NONE );
+}
+
+void virtual_release( void* ptr, size_t size )
+{
+    munmap( ptr, size );
+}
+
+size_t virtual_page_size()
+{
+    return size_t( sysconf( _SC_PAGESIZE ) );
+}
+
+#endif
@@ -0,0 +1,251 @@
+// Andrew Meckling
+#pragma once
+
+#include "Allocators.h"
+
+#include <cassert>
+#include <cstring>
+
+// Reserves size bytes of address space without backing it with memory.
+// Returns null on failure.
+void* virtual_reserve( size_t size );
+
+// Backs the pages in [ptr, ptr + size) with zeroed read/write memory.
+bool virtual_commit( void* ptr, size_t size );
+
+// Returns the memory behind the pages in [ptr, ptr + size) to the system
+// but keeps the address range reserved.
+void virtual_decommit( void* ptr, size_t size );
+
+// Releases a whole range returned by virtual_reserve.
+void virtual_release( void* ptr, size_t size );
+
+// Returns the granularity of virtual_commit in bytes.
+size_t virtual_page_size();
+
+
+// Linear allocator over a large reserved range of address space. Pages are
+// committed only when the top of the stack first reaches them, so a huge
+// reservation costs nothing until it is used. Since the range never moves,
+// growing the most recent allocation (with expand or reallocate) never
+// copies and every pointer into the arena stays valid. This makes it a good
+// home for a single large growable buffer, e.g.
+//     VirtualArena arena( 256 << 20 );
+//     Blk vertices = arena.allocate( 1024 * sizeof( Vertex ) );
+//     arena.expand( vertices, 1024 * sizeof( Vertex ) ); // same address
+// Deallocation is ignored for all but the most recent allocation. When the
+// top of the stack drops far enough, the pages above it are decommitted.
+class VirtualArena
+{
+public:
+
+    static constexpr size_t ALIGNMENT = 16;
+
+    // Default size of the reserved range.
+    static constexpr size_t DEFAULT_RESERVE = size_t( 1 ) << 30;
+
+    // Pages are committed in steps of at least this many bytes.
+    static constexpr size_t COMMIT_GRANULARITY = 64 * 1024;
+
+    // Unused committed memory kept above the top before it is decommitted.
+    static constexpr size_t DECOMMIT_THRESHOLD = 1024 * 1024;
+
+private:
+
+    byte*  _memory;    // Start of the reserved range.
+    size_t _reserved;  // Size of the reserved range in bytes.
+    size_t _committed; // Bytes committed from the start of the range.
+    byte*  _ptr;       // Top of the allocation stack.
+
+    static constexpr size_t _round_to_aligned( size_t size )
+    {
+        return round_to_alignment( size, ALIGNMENT );
+    }
+
+    // Commits pages so that everything below top is accessible.
+    bool _commitTo( byte* top )
+    {
+        size_t needed = top - _memory;
+        if ( needed <= _committed )
+            return true;
+
+        size_t target = round_to_alignment( needed, COMMIT_GRANULARITY );
+        if ( target > _reserved )
+            target = _reserved;
+
+        if ( !virtual_commit( _memory + _committed, target - _committed ) )
+            return false;
+
+        _committed = target;
+        return true;
+    }
+
+    // Decommits pages above the top of the stack, keeping slack bytes.
+    void _decommitAbove( size_t slack )
+    {
+        size_t keep = round_to_alignment( (_ptr - _memory) + slack, COMMIT_GRANULARITY );
+        if ( keep >= _committed )
+            return;
+
+        virtual_decommit( _memory + keep, _committed - keep );
+        _committed = keep;
+    }
+
+    // Moves the top of the stack down, decommitting if enough is unused.
+    void _lowerTop( byte* top )
+    {
+        _ptr = top;
+        if ( _committed - (_ptr - _memory) > DECOMMIT_THRESHOLD )
+            _decommitAbove( DECOMMIT_THRESHOLD / 2 );
+    }
+
+    bool _isTop( const Blk& blk ) const
+    {
+        return (byte*) blk.ptr + _round_to_aligned( blk.size ) == _ptr;
+    }
+
+public:
+
+    // Reserves (at least) reserveBytes of address space.
+    explicit VirtualArena( size_t reserveBytes = DEFAULT_RESERVE )
+        : _reserved( round_to_alignment( reserveBytes, COMMIT_GRANULARITY ) )
+        , _committed( 0 )
+    {
+        assert( COMMIT_GRANULARITY % virtual_page_size() == 0 );
+
+        _memory = (byte*) virtual_reserve( _reserved );
+        if ( !_memory )
+            throw "VirtualArena: could not reserve address space";
+        _ptr = _memory;
+    }
+
+    VirtualArena( const VirtualArena& ) = delete;
+    VirtualArena& operator =( const VirtualArena& ) = delete;
+
+    ~VirtualArena()
+    {
+        virtual_release( _memory, _reserved );
+    }
+
+    Blk allocate( size_t size )
+    {
+        size_t rounded_size = _round_to_aligned( size );
+        if ( rounded_size > size_t( _memory + _reserved - _ptr ) )
+            return { nullptr, 0 };
+
+        if ( !_commitTo( _ptr + rounded_size ) )
+            return { nullptr, 0 };
+
+        Blk result = { _ptr, size };
+        _ptr += rounded_size;
+        return result;
+    }
+
+    // Only reclaims memory if blk was the most recent allocation.
+    void deallocate( Blk blk )
+    {
+        assert( blk.ptr == nullptr || owns( blk.ptr ) );
+        if ( blk.ptr && _isTop( blk ) )
+            _lowerTop( (byte*) blk.ptr );
+    }
+
+    bool owns( void* ptr ) const
+    {
+        return _memory <= ptr && ptr < _memory + _reserved;
+    }
+
+    // Pads the top of the stack up to align before allocating. The padding
+    // is not reclaimed when the block is deallocated.
+    Blk alignedAllocate( size_t size, size_t align )
+    {
+        size_t offset = round_to_alignment( uintptr_t( _ptr ), align ) - uintptr_t( _ptr );
+        if ( offset > size_t( _memory + _reserved - _ptr ) )
+            return { nullptr, 0 };
+
+        byte* prev = _ptr;
+        _ptr += offset;
+        Blk result = allocate( size );
+        if ( !result.ptr )
+            _ptr = prev;
+        return result;
+    }
+
+    // Succeeds if blk is the most recent allocation and the reserved range
+    // has room. Never moves the block.
+    bool expand( Blk& blk, size_t delta )
+    {
+        if ( !_isTop( blk ) )
+            return false;
+
+        size_t rounded_size = _round_to_aligned( blk.size + delta );
+        if ( rounded_size > size_t( _memory + _reserved - (byte*) blk.ptr ) )
+            return false;
+
+        if ( !_commitTo( (byte*) blk.ptr + rounded_size ) )
+            return false;
+
+        _ptr = (byte*) blk.ptr + rounded_size;
+        blk.size += delta;
+        return true;
+    }
+
+    // Resizes the most recent allocation in place, decommitting pages when
+    // it shrinks; any other block is copied to the top of the stack.
+    bool reallocate( Blk& blk, size_t size )
+    {
+        if ( blk.ptr && _isTop( blk ) )
+        {
+            if ( size > blk.size )
+                return expand( blk, size - blk.size );
+
+            _lowerTop( (byte*) blk.ptr + _round_to_aligned( size ) );
+            blk.size = size;
+            if ( size == 0 )
+                blk = nullptr;
+            return true;
+        }
+
+        Blk result = { nullptr, 0 };
+        if ( size > 0 && !(result = allocate( size )).ptr )
+            return false;
+
+        if ( blk.ptr )
+        {
+            std::memcpy( result.ptr, blk.ptr, std::min( blk.size, size ) );
+            deallocate( blk );
+        }
+        blk = result;
+        return true;
+    }
+
+    // Empties the arena and decommits all of its pages.
+    void reset()
+    {
+        _ptr = _memory;
+        shrink();
+    }
+
+    // Decommits every page above the top of the stack.
+    void shrink()
+    {
+        _decommitAbove( 0 );
+    }
+
+    // Returns the number of bytes allocated.
+    size_t used() const
+    {
+        return _ptr - _memory;
+    }
+
+    // Returns the number of bytes backed by memory.
+    size_t committed() const
+    {
+        return _committed;
+    }
+
+    // Returns the size of the reserved range in bytes.
+    size_t reserved() const
+    {
+        return _reserved;
+    }
+};
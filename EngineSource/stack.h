@@ -1,22 +1,27 @@
 #pragma once
 
+#include "Allocators.h"
+
+#include <algorithm>
 #include <array>
 #include <initializer_list>
 #include <cassert>
 
+// Raw storage for the first Size values; slots are only constructed while
+// they hold a value.
 template< typename T, size_t Size >
 struct stack_base
 {
-    std::array< T, Size > array;
+    alignas( T ) unsigned char storage[ Size * sizeof( T ) ];
 
     T* data()
     {
-        return array.data();
+        return reinterpret_cast< T* >( storage );
     }
 
     const T* data() const
     {
-        return array.data();
+        return reinterpret_cast< const T* >( storage );
     }
 };
 
@@ -34,9 +39,10 @@ struct stack_base< T, 0 >
     }
 };
 
-template< typename T, size_t LocalMax = 0 >
+template< typename T, size_t LocalMax = 0, class Allocator = Mallocator >
 class stack
     : private stack_base< T, LocalMax >
+    , protected Allocator
 {
 public:
     
@@ -52,14 +58,60 @@ private:
     size_t capacity;
     size_t count;
 
-    static Value* allocate( size_t count )
+    Value* allocate( size_t count )
     {
-        return std::calloc( count, sizeof( Value ) );
+        return (Value*) Allocator::allocate( count * sizeof( Value ) ).ptr;
     }
 
-    static void deallocate( Value* ptr )
+    // Deallocates the heap storage; ptr must have capacity elements.
+    void deallocate( Value* ptr )
     {
-        std::free( (void*) ptr );
+        Allocator::deallocate( { ptr, capacity * sizeof( Value ) } );
+    }
+
+    // Resizes the heap storage in place if the allocator can, otherwise
+    // lets the allocator move it. Only valid for trivially copyable values.
+    bool reallocate( size_t size )
+    {
+        Blk blk = { pValues, capacity * sizeof( Value ) };
+        if ( !allocator_reallocate( static_cast< Allocator& >( *this ), blk, size * sizeof( Value ) ) )
+            return false;
+
+        pValues = (Value*) blk.ptr;
+        return true;
+    }
+
+    // Makes room for at least size values, moving the live values into new
+    // storage if needed. Slots past count stay unconstructed.
+    void reserve( size_t size )
+    {
+        if ( size <= capacity )
+            return;
+
+        if ( !(std::is_trivially_copyable< Value >::value && isAllocated() && reallocate( size )) )
+        {
+            Value* arr = allocate( size );
+
+            for ( size_t i = 0; i < count; ++i )
+            {
+                new( arr + i ) Value( std::move( pValues[ i ] ) );
+                pValues[ i ].~Value();
+            }
+
+            if ( isAllocated() )
+                deallocate( pValues );
+
+            pValues = arr;
+        }
+
+        capacity = size;
+    }
+
+    // Makes room for at least n more values.
+    void grow( size_t n = 1 )
+    {
+        if ( count + n > capacity )
+            reserve( std::max< size_t >( { capacity * 2, count + n, 8 } ) );
     }
 
 public:
@@ -72,6 +124,16 @@ public:
     {
     }
 
+    // Constructs an empty stack which allocates from a copy of allocator.
+    explicit stack( const Allocator& allocator )
+        : Base()
+        , Allocator( allocator )
+        , pValues { data() }
+        , capacity { LOCAL_SIZE }
+        , count { 0 }
+    {
+    }
+
     explicit stack( size_t count, Value copy = {} )
         : Base()
         , pValues { count <= LOCAL_SIZE ? data() : allocate( count ) }
@@ -84,11 +146,9 @@ public:
 
     ~stack()
     {
+        clear();
         if ( isAllocated() )
-        {
-            clear();
             deallocate( pValues );
-        }
     }
 
 private:
@@ -105,56 +165,6 @@ private:
         return pValues != data() && pValues != nullptr;
     }
 
-    void resize( size_t size )
-    {
-        size_t minSize = std::min( size, count );
-
-        if ( size <= LOCAL_SIZE )
-        {
-            if ( isAllocated() )
-            {
-                Value* arr = data();
-
-                for ( size_t i = 0; i < minSize; ++i )
-                    arr[ i ] = std::move( pValues[ i ] );
-
-                for ( size_t i = minSize; i < size; ++i )
-                    arr[ i ] = {};
-
-                clear();
-                deallocate( pValues );
-                pValues = arr;
-            }
-            else
-            {
-                for ( size_t i = minSize; i < size; ++i )
-                    pValues[ i ] = {};
-
-                for ( size_t i = size; i < count; ++i )
-                    pValues[ i ].~Value();
-            }
-        }
-        else
-        {
-            Value* arr = allocate( size );
-
-            for ( size_t i = 0; i < minSize; ++i )
-                new( arr + i ) Value( std::move( pValues[ i ] ) );
-
-            for ( size_t i = minSize; i < size; ++i )
-                new( arr + i ) Value();
-
-            clear();
-            if ( isAllocated() )
-                deallocate( pValues );
-
-            pValues = arr;
-        }
-
-        capacity = std::max( LOCAL_SIZE, size );
-        count = size;
-    }
-
 public:
 
     size_t size() const
@@ -164,12 +174,16 @@ public:
 
     void push( Value value )
     {
-        pValues[ count++ ] = std::move( value );
+        grow();
+        new( pValues + count ) Value( std::move( value ) );
+        ++count;
     }
 
     Value pop()
     {
-        return std::move( pValues[ --count ] );
+        Value value = std::move( pValues[ --count ] );
+        pValues[ count ].~Value();
+        return value;
     }
 
     Value& peek()
@@ -206,15 +220,31 @@ public:
 
 private:
 
-    void shiftItems( Value* pStart, Value* pEnd, int64_t offset )
+    // Moves the values from offset on up by n slots; there must be room.
+    // Slots moved into past count are constructed, the rest assigned.
+    void openGap( size_t offset, size_t n )
     {
-        if ( offset < 0 )
-            for ( Value* ptr = pStart; ptr != pEnd; ++ptr )
-                ptr[ offset ] = std::move( *ptr );
+        if ( n == 0 )
+            return;
 
-        else if ( offset > 0 )
-            for ( Value* ptr = pEnd - 1; ptr < pStart; --ptr )
-                ptr[ offset ] = std::move( *ptr );
+        for ( size_t i = count; i-- > offset; )
+        {
+            if ( i + n >= count )
+                new( pValues + i + n ) Value( std::move( pValues[ i ] ) );
+            else
+                pValues[ i + n ] = std::move( pValues[ i ] );
+        }
+    }
+
+    // Stores value in slot i of a gap opened by openGap(), constructing it
+    // if the slot was past count.
+    template< typename U >
+    void fillGap( size_t i, U&& value )
+    {
+        if ( i < count )
+            pValues[ i ] = std::forward< U >( value );
+        else
+            new( pValues + i ) Value( std::forward< U >( value ) );
     }
 
 public:
@@ -231,21 +261,24 @@ public:
 
     void insert( size_t offset, Value value )
     {
-        shiftItems( begin() + offset, end(), 1 );
-        pValues[ offset ] = std::move( value );
+        grow();
+        openGap( offset, 1 );
+        fillGap( offset, std::move( value ) );
         ++count;
     }
 
     template< typename Itr >
     void insert( size_t offset, Itr first, Itr last )
     {
-        shiftItems( begin() + offset, end(), std::distance( first, last ) );
-        int i = offset;
-        
+        size_t n = std::distance( first, last );
+        grow( n );
+        openGap( offset, n );
+
+        size_t i = offset;
         for ( Itr it = first; it != last; ++it )
-            pValues[ i++ ] = *it;
+            fillGap( i++, *it );
 
-        count += std::distance( first, last );
+        count += n;
     }
 
 };
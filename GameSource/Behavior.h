@@ -30,7 +30,7 @@ struct WanderBehavior
 struct PathBehavior
 {
     Eid eid;
-    RefVector< LevelTile > path;
+    RefVector< TileState > path;
     Delay delay;
 
     explicit PathBehavior( Eid eid )
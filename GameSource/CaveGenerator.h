@@ -0,0 +1,328 @@
+#pragma once
+
+#include "Dungeon.h"
+#include "TileBitboard.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Generates cave dungeons with cellular automata. The map is a grid of
+// square regions, each of which becomes one Room. A region is generated
+// on its own from a seed derived from the dungeon seed and its
+// coordinates: random walls are smoothed into caves, all but the largest
+// cave are filled in, and corridors are carved from the largest cave to
+// a door on each edge shared with another region. The door on an edge is
+// placed by hashing the edge, so the regions on both sides agree on it
+// and the whole map ends up connected without the regions ever looking
+// at one another. Regions are therefore generated in parallel and the
+// result is the same, tile for tile, whatever the number of threads.
+class CaveGenerator
+{
+public:
+
+    struct Params
+    {
+        uint64_t seed = 0;
+        ivec2    regions { 16, 16 };   // Number of regions across and down.
+        int      regionSize = 64;      // Width and height of a region in tiles.
+        float    wallChance = 0.45f;   // Chance of a cell starting as a wall.
+        int      smoothSteps = 4;      // Number of cellular automaton steps.
+        LevelTile floor = LevelTile( LevelTile::TILE3 );
+        LevelTile wall = LevelTile( LevelTile::BRICK3 );
+    };
+
+private:
+
+    // splitmix64. Unlike the standard distributions it gives the same
+    // numbers on every platform.
+    class Random
+    {
+        uint64_t _state;
+
+    public:
+
+        explicit Random( uint64_t seed )
+            : _state( seed )
+        {
+        }
+
+        uint64_t next()
+        {
+            uint64_t z = (_state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // Returns a number in [0, 1).
+        float real()
+        {
+            return float( next() >> 40 ) / float( 1 << 24 );
+        }
+    };
+
+    enum Cell : uint8_t { OPEN, SOLID };
+
+    Params _params;
+
+    uint64_t _hash( int x, int y, int salt ) const
+    {
+        Random random( _params.seed
+                       ^ (uint64_t( uint32_t( x ) ) * 0xD6E8FEB86659FD93ull)
+                       ^ (uint64_t( uint32_t( y ) ) * 0xA0761D6478BD642Full)
+                       ^ (uint64_t( salt ) << 56) );
+        return random.next();
+    }
+
+    // Returns the position along the edge of the door between region and
+    // the one to its east (vertical) or south (!vertical).
+    int _door( ivec2 region, bool vertical ) const
+    {
+        int span = _params.regionSize - 2;
+        return 1 + int( _hash( region.x, region.y, vertical ? 1 : 2 ) % uint64_t( span ) );
+    }
+
+    bool _hasRegion( ivec2 region ) const
+    {
+        return region.x >= 0 && region.y >= 0
+            && region.x < _params.regions.x && region.y < _params.regions.y;
+    }
+
+    // Runs one step of the automaton from src into dst. A cell becomes
+    // solid if at least 5 of the 9 cells around and including it are.
+    // The border stays solid.
+    void _smooth( const std::vector< uint8_t >& src, std::vector< uint8_t >& dst ) const
+    {
+        int size = _params.regionSize;
+        std::fill( dst.begin(), dst.end(), SOLID );
+
+        for ( int y = 1; y < size - 1; ++y )
+        {
+            const uint8_t* pAbove = &src[ (y - 1) * size ];
+            const uint8_t* pRow = &src[ y * size ];
+            const uint8_t* pBelow = &src[ (y + 1) * size ];
+            uint8_t* pOut = &dst[ y * size ];
+
+            for ( int x = 1; x < size - 1; ++x )
+            {
+                int solid = pAbove[ x - 1 ] + pAbove[ x ] + pAbove[ x + 1 ]
+                          + pRow[ x - 1 ] + pRow[ x ] + pRow[ x + 1 ]
+                          + pBelow[ x - 1 ] + pBelow[ x ] + pBelow[ x + 1 ];
+                pOut[ x ] = solid >= 5 ? SOLID : OPEN;
+            }
+        }
+    }
+
+    // Fills in every cave but the largest (the first found if several tie)
+    // and returns the cell of the largest cave closest to the centre. If
+    // there is no cave, opens the centre cell and returns it.
+    int _keepLargestCave( std::vector< uint8_t >& cells, std::vector< int >& labels,
+                          std::vector< int >& stack ) const
+    {
+        int size = _params.regionSize;
+        std::fill( labels.begin(), labels.end(), -1 );
+
+        int best = -1;
+        int bestSize = 0;
+        int caveCount = 0;
+
+        for ( int start = 0; start < size * size; ++start )
+        {
+            if ( cells[ start ] != OPEN || labels[ start ] != -1 )
+                continue;
+
+            int cave = caveCount++;
+            int caveSize = 0;
+            labels[ start ] = cave;
+            stack.push_back( start );
+
+            while ( !stack.empty() )
+            {
+                int i = stack.back();
+                stack.pop_back();
+                ++caveSize;
+
+                int x = i % size;
+                int y = i / size;
+                int adj[ 4 ] { x > 0 ? i - 1 : -1, x < size - 1 ? i + 1 : -1,
+                               y > 0 ? i - size : -1, y < size - 1 ? i + size : -1 };
+                for ( int j : adj )
+                    if ( j >= 0 && cells[ j ] == OPEN && labels[ j ] == -1 )
+                    {
+                        labels[ j ] = cave;
+                        stack.push_back( j );
+                    }
+            }
+
+            if ( caveSize > bestSize )
+            {
+                best = cave;
+                bestSize = caveSize;
+            }
+        }
+
+        int center = size / 2 + (size / 2) * size;
+        if ( best == -1 )
+        {
+            cells[ center ] = OPEN;
+            return center;
+        }
+
+        int target = -1;
+        int targetDist = INT_MAX;
+        for ( int i = 0; i < size * size; ++i )
+        {
+            if ( labels[ i ] != best )
+            {
+                cells[ i ] = SOLID;
+                continue;
+            }
+
+            int dx = i % size - size / 2;
+            int dy = i / size - size / 2;
+            int dist = dx * dx + dy * dy;
+            if ( dist < targetDist )
+            {
+                target = i;
+                targetDist = dist;
+            }
+        }
+        return target;
+    }
+
+    // Opens an L shaped corridor from the door cell to the target cell,
+    // along the axis leaving the edge first.
+    void _carve( std::vector< uint8_t >& cells, ivec2 from, ivec2 to, bool xFirst ) const
+    {
+        int size = _params.regionSize;
+        ivec2 pos = from;
+        cells[ pos.x + pos.y * size ] = OPEN;
+
+        for ( int leg = 0; leg < 2; ++leg )
+        {
+            int axis = (leg == 0) == xFirst ? 0 : 1;
+            while ( pos[ axis ] != to[ axis ] )
+            {
+                pos[ axis ] += pos[ axis ] < to[ axis ] ? 1 : -1;
+                cells[ pos.x + pos.y * size ] = OPEN;
+            }
+        }
+    }
+
+    // Scratch buffers of one worker thread.
+    struct Scratch
+    {
+        std::vector< uint8_t > cells, next;
+        std::vector< int > labels, stack;
+    };
+
+    void _generateRegion( ivec2 region, LevelTile* pTiles, Scratch& scratch ) const
+    {
+        int size = _params.regionSize;
+        auto& cells = scratch.cells;
+        auto& next = scratch.next;
+        cells.assign( size * size, SOLID );
+        next.resize( size * size );
+        scratch.labels.resize( size * size );
+
+        Random random( _hash( region.x, region.y, 0 ) );
+        for ( int y = 1; y < size - 1; ++y )
+            for ( int x = 1; x < size - 1; ++x )
+                cells[ x + y * size ] = random.real() < _params.wallChance ? SOLID : OPEN;
+
+        for ( int step = 0; step < _params.smoothSteps; ++step )
+        {
+            _smooth( cells, next );
+            std::swap( cells, next );
+        }
+
+        int target = _keepLargestCave( cells, scratch.labels, scratch.stack );
+        ivec2 to { target % size, target / size };
+
+        if ( _hasRegion( region - ivec2( 1, 0 ) ) )
+            _carve( cells, { 0, _door( region - ivec2( 1, 0 ), true ) }, to, true );
+        if ( _hasRegion( region + ivec2( 1, 0 ) ) )
+            _carve( cells, { size - 1, _door( region, true ) }, to, true );
+        if ( _hasRegion( region - ivec2( 0, 1 ) ) )
+            _carve( cells, { _door( region - ivec2( 0, 1 ), false ), 0 }, to, false );
+        if ( _hasRegion( region + ivec2( 0, 1 ) ) )
+            _carve( cells, { _door( region, false ), size - 1 }, to, false );
+
+        for ( int i = 0; i < size * size; ++i )
+            pTiles[ i ] = cells[ i ] == OPEN ? _params.floor : _params.wall;
+    }
+
+public:
+
+    explicit CaveGenerator( const Params& params )
+        : _params( params )
+    {
+        if ( _params.regionSize < 3 )
+            throw "CaveGenerator: regionSize must be at least 3";
+    }
+
+    const Params& params() const
+    {
+        return _params;
+    }
+
+    // Fills in the regionSize * regionSize tiles of a region, row by row,
+    // without connections. The result depends only on the parameters and
+    // the region, so regions may be generated on demand, e.g. as the
+    // Source of a ChunkedWorld whose chunks are the regions.
+    void generateRegion( ivec2 region, LevelTile* pTiles ) const
+    {
+        Scratch scratch;
+        _generateRegion( region, pTiles, scratch );
+    }
+
+    // Generates every region on threadCount threads (0 for one per core)
+    // and returns the dungeon with its tile connections computed.
+    Dungeon generate( int threadCount = 0 ) const
+    {
+        int size = _params.regionSize;
+        int count = _params.regions.x * _params.regions.y;
+
+        std::vector< std::pair< Room, vec2 > > rooms;
+        rooms.reserve( count );
+        for ( int i = 0; i < count; ++i )
+        {
+            ivec2 region { i % _params.regions.x, i / _params.regions.x };
+            rooms.emplace_back( Room( size, size ), vec2( region * size ) );
+        }
+
+        if ( threadCount <= 0 )
+            threadCount = std::max( 1u, std::thread::hardware_concurrency() );
+        threadCount = std::min( threadCount, count );
+
+        // Workers take regions in turn; which worker makes a region does not
+        // change what it holds.
+        std::atomic< int > nextRegion { 0 };
+        auto work = [&]
+        {
+            Scratch scratch;
+            for ( int i; (i = nextRegion.fetch_add( 1, std::memory_order_relaxed )) < count; )
+            {
+                ivec2 region { i % _params.regions.x, i / _params.regions.x };
+                _generateRegion( region, rooms[ i ].first.data(), scratch );
+            }
+        };
+
+        std::vector< std::thread > workers;
+        for ( int t = 1; t < threadCount; ++t )
+            workers.emplace_back( work );
+        work();
+        for ( std::thread& worker : workers )
+            worker.join();
+
+        Dungeon dungeon;
+        dungeon.addRooms( std::move( rooms ) );
+        TileBitboard( dungeon ).applyConnections( dungeon );
+        return dungeon;
+    }
+};
@@ -0,0 +1,413 @@
+#pragma once
+
+#include "Dungeon.h"
+#include "DungeonFile.h"
+#include "ConcurrentQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// World of tiles split into square chunks which are loaded on a background
+// thread around a focus (the player or the camera) and evicted, least
+// recently used first, once more than a fixed number are resident. The
+// map can be of any size while memory stays at about maxChunks chunks.
+// Chunks come from a Source, which fills in the tiles of one chunk; see
+// fileSource for one reading a DungeonFile, or pass any function to
+// generate them. Tiles of a chunk which is not resident are unknown:
+// findTile returns null for them, whereas tiles known to be empty are
+// Tile::NONE. Paths may be found over the resident tiles with find_path and
+// the functions below, as over a Dungeon; tiles stay put until their chunk
+// is evicted in update(). Every member is for the main thread only.
+class ChunkedWorld
+{
+public:
+
+    static constexpr int CHUNK_SIZE = 64;
+    static constexpr int CHUNK_TILES = CHUNK_SIZE * CHUNK_SIZE;
+
+    // Fills in the CHUNK_TILES tiles of a chunk, row by row. The tiles start
+    // out as Tile::NONE. Called on the loader thread.
+    using Source = std::function< void( ivec2 chunk, LevelTile* pTiles ) >;
+
+private:
+
+    struct Chunk
+    {
+        std::unique_ptr< LevelTile[] > tiles;
+        uint64_t lastUsed; // Value of _clock when last used.
+    };
+
+    struct LoadedChunk
+    {
+        ivec2 chunk;
+        std::unique_ptr< LevelTile[] > tiles;
+    };
+
+    Source _source;
+    size_t _maxChunks;
+    uint64_t _clock = 0;
+
+    std::unordered_map< uint64_t, Chunk > _chunks;
+    std::unordered_set< uint64_t > _pending; // Requested but not yet received.
+    std::map< const LevelTile*, uint64_t > _byAddress; // Chunk of each tile array.
+
+    // Last chunk found by findTile, which saves the lookup for the runs of
+    // queries on one chunk that most code makes.
+    uint64_t _lastKey = 0;
+    Chunk* _pLast = nullptr;
+
+    SpscQueue< ivec2, 256 > _requests;    // Main thread to loader.
+    SpscQueue< LoadedChunk, 256 > _loaded; // Loader to main thread.
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::atomic< bool > _stop { false };
+    std::thread _thread;
+
+    static int _floorDiv( int x )
+    {
+        return (x >= 0 ? x : x - (CHUNK_SIZE - 1)) / CHUNK_SIZE;
+    }
+
+    static uint64_t _key( ivec2 chunk )
+    {
+        return (uint64_t( uint32_t( chunk.x ) ) << 32) | uint32_t( chunk.y );
+    }
+
+    static ivec2 _chunk( uint64_t key )
+    {
+        return { int32_t( uint32_t( key >> 32 ) ), int32_t( uint32_t( key ) ) };
+    }
+
+    Chunk* _find( uint64_t key )
+    {
+        if ( _pLast && _lastKey == key )
+            return _pLast;
+
+        auto it = _chunks.find( key );
+        if ( it == _chunks.end() )
+            return nullptr;
+
+        _lastKey = key;
+        return _pLast = &it->second;
+    }
+
+    void _loaderMain()
+    {
+        while ( !_stop.load( std::memory_order_relaxed ) )
+        {
+            ivec2 chunk;
+            if ( !_requests.tryPop( chunk ) )
+            {
+                std::unique_lock< std::mutex > lock( _mutex );
+                _wake.wait( lock, [&] { return _stop.load() || !_requests.empty(); } );
+                continue;
+            }
+
+            LoadedChunk loaded { chunk, std::make_unique< LevelTile[] >( CHUNK_TILES ) };
+            _source( chunk, loaded.tiles.get() );
+
+            while ( !_loaded.tryPush( std::move( loaded ) ) )
+            {
+                if ( _stop.load( std::memory_order_relaxed ) )
+                    return;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Evicts the least recently used chunks until at most _maxChunks are
+    // resident.
+    void _evict()
+    {
+        if ( _chunks.size() <= _maxChunks )
+            return;
+
+        std::vector< std::pair< uint64_t, uint64_t > > ages; // lastUsed, key
+        ages.reserve( _chunks.size() );
+        for ( auto& [key, chunk] : _chunks )
+            ages.emplace_back( chunk.lastUsed, key );
+
+        size_t count = _chunks.size() - _maxChunks;
+        std::nth_element( ages.begin(), ages.begin() + (count - 1), ages.end() );
+
+        for ( size_t i = 0; i < count; ++i )
+        {
+            auto it = _chunks.find( ages[ i ].second );
+            _byAddress.erase( it->second.tiles.get() );
+            _chunks.erase( it );
+        }
+        _pLast = nullptr;
+    }
+
+public:
+
+    // Starts the loader thread. maxChunks should be larger than the number
+    // of chunks around the focus, or those would evict one another.
+    ChunkedWorld( Source source, size_t maxChunks )
+        : _source( std::move( source ) )
+        , _maxChunks( maxChunks )
+    {
+        _thread = std::thread( [this] { _loaderMain(); } );
+    }
+
+    ChunkedWorld( const ChunkedWorld& ) = delete;
+    ChunkedWorld& operator =( const ChunkedWorld& ) = delete;
+
+    // Stops the loader thread; a chunk it is loading is finished first.
+    ~ChunkedWorld()
+    {
+        {
+            std::lock_guard< std::mutex > lock( _mutex );
+            _stop = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+    }
+
+    // Returns the chunk holding the tile at x, y.
+    static ivec2 chunkOf( int x, int y )
+    {
+        return { _floorDiv( x ), _floorDiv( y ) };
+    }
+
+    // Requests every chunk within radius tiles of pos that is neither
+    // resident nor already requested, nearest first, and keeps the resident
+    // ones from being evicted soon. Call once per frame, before update().
+    void setFocus( vec2 pos, int radius )
+    {
+        ivec2 lo = chunkOf( int( std::floor( pos.x ) ) - radius, int( std::floor( pos.y ) ) - radius );
+        ivec2 hi = chunkOf( int( std::floor( pos.x ) ) + radius, int( std::floor( pos.y ) ) + radius );
+        ivec2 center = chunkOf( int( std::floor( pos.x ) ), int( std::floor( pos.y ) ) );
+
+        std::vector< ivec2 > missing;
+        for ( int y = lo.y; y <= hi.y; ++y )
+            for ( int x = lo.x; x <= hi.x; ++x )
+            {
+                uint64_t key = _key( { x, y } );
+                if ( Chunk* pChunk = _find( key ) )
+                    pChunk->lastUsed = _clock;
+                else if ( !_pending.count( key ) )
+                    missing.push_back( { x, y } );
+            }
+
+        std::sort( missing.begin(), missing.end(), [&]( ivec2 a, ivec2 b )
+        {
+            ivec2 da = glm::abs( a - center );
+            ivec2 db = glm::abs( b - center );
+            return std::max( da.x, da.y ) < std::max( db.x, db.y );
+        } );
+
+        for ( ivec2 chunk : missing )
+        {
+            if ( !_requests.tryPush( chunk ) )
+                break; // The rest are requested once there is room.
+            _pending.insert( _key( chunk ) );
+        }
+
+        if ( !missing.empty() )
+        {
+            // Taking the lock makes sure the loader is either waiting or
+            // yet to check the queue, so the notification is not lost.
+            { std::lock_guard< std::mutex > lock( _mutex ); }
+            _wake.notify_one();
+        }
+    }
+
+    // Takes in the chunks the loader has finished and evicts the least
+    // recently used ones over the budget. Call once per frame.
+    void update()
+    {
+        ++_clock;
+
+        LoadedChunk loaded;
+        while ( _loaded.tryPop( loaded ) )
+        {
+            uint64_t key = _key( loaded.chunk );
+            _pending.erase( key );
+
+            Chunk& chunk = _chunks[ key ];
+            _byAddress.erase( chunk.tiles.get() );
+            _byAddress[ loaded.tiles.get() ] = key;
+            chunk = { std::move( loaded.tiles ), _clock };
+        }
+
+        _evict();
+    }
+
+    // Returns the tile at x, y; or null if its chunk is not resident, in
+    // which case the tile is unknown.
+    LevelTile* findTile( int x, int y )
+    {
+        ivec2 chunk = chunkOf( x, y );
+        Chunk* pChunk = _find( _key( chunk ) );
+        if ( pChunk == nullptr )
+            return nullptr;
+
+        pChunk->lastUsed = _clock;
+        ivec2 local = ivec2( x, y ) - chunk * CHUNK_SIZE;
+        return &pChunk->tiles[ local.x + local.y * CHUNK_SIZE ];
+    }
+
+    // Returns the position of a resident tile.
+    ivec2 tilePos( const LevelTile* pTile ) const
+    {
+        auto it = std::prev( _byAddress.upper_bound( pTile ) );
+        int offset = int( pTile - it->first );
+        return _chunk( it->second ) * CHUNK_SIZE + ivec2( offset % CHUNK_SIZE, offset / CHUNK_SIZE );
+    }
+
+    auto distanceEstimateFunc()
+    {
+        return [this]( LevelTile& start, LevelTile& goal )
+        {
+            ivec2 d = glm::abs( tilePos( &start ) - tilePos( &goal ) );
+            return d.x + d.y;
+        };
+    }
+
+    auto tileCostFunc()
+    {
+        return [this]( LevelTile& tile )
+        {
+            return 1;
+        };
+    }
+
+    // Yields the floor tiles next to a tile. Tiles of chunks which are not
+    // resident are left out, so paths stay within the known world.
+    auto neighborsFunc()
+    {
+        return [this]( LevelTile& tile )
+        {
+            ivec2 pos = tilePos( &tile );
+
+            static const ivec2 VECTORS[] {
+                { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 }
+            };
+
+            for ( ivec2 v : VECTORS )
+                if ( LevelTile* pTile = findTile( pos.x + v.x, pos.y + v.y ) )
+                    if ( pTile->type() == Tile::FLOOR )
+                        co_yield std::ref( *pTile );
+        };
+    }
+
+    // Returns true if the tile at x, y is known, i.e. its chunk is resident.
+    bool isKnown( int x, int y )
+    {
+        return _find( _key( chunkOf( x, y ) ) ) != nullptr;
+    }
+
+    size_t residentCount() const
+    {
+        return _chunks.size();
+    }
+
+    size_t pendingCount() const
+    {
+        return _pending.size();
+    }
+
+    // Returns a Source which reads the chunks from a dungeon file: straight
+    // from the mapping if it is uncompressed, or else decompressing only the
+    // blocks which a chunk covers. Where rooms overlap the first one wins,
+    // as in Dungeon::findTile. Tiles of corrupt blocks are left as
+    // Tile::NONE.
+    static Source fileSource( std::shared_ptr< const DungeonFile > pFile )
+    {
+        return [pFile]( ivec2 chunk, LevelTile* pTiles )
+        {
+            ivec2 origin = chunk * CHUNK_SIZE;
+            std::bitset< CHUNK_TILES > claimed;
+            std::vector< LevelTile > block( DungeonFile::BLOCK_SIZE * DungeonFile::BLOCK_SIZE );
+
+            for ( int i = 0; i < pFile->roomCount(); ++i )
+            {
+                const DungeonFile::RoomHeader& rh = pFile->room( i );
+                vec2 pos { rh.x, rh.y };
+
+                // Same cells as Dungeon's grid, clipped to the chunk.
+                ivec2 lo = glm::max( ivec2( glm::ceil( pos ) ), origin );
+                ivec2 hi = glm::min( ivec2( glm::ceil( pos + vec2( rh.width, rh.height ) ) ),
+                                     origin + CHUNK_SIZE );
+                if ( lo.x >= hi.x || lo.y >= hi.y )
+                    continue;
+
+                if ( const LevelTile* pRoom = pFile->tiles( i ) )
+                {
+                    for ( int y = lo.y; y < hi.y; ++y )
+                        for ( int x = lo.x; x < hi.x; ++x )
+                        {
+                            int rx = x - pos.x;
+                            int ry = y - pos.y;
+                            int cell = (x - origin.x) + (y - origin.y) * CHUNK_SIZE;
+                            if ( claimed[ cell ] || rx >= rh.width || ry >= rh.height )
+                                continue;
+
+                            claimed[ cell ] = true;
+                            pTiles[ cell ] = pRoom[ rx + ry * rh.width ];
+                        }
+                    continue;
+                }
+
+                // Room tiles under the first and last cells, and so the
+                // blocks between them.
+                ivec2 first = ivec2( vec2( lo ) - pos );
+                ivec2 last = glm::min( ivec2( vec2( hi - 1 ) - pos ), ivec2( rh.width, rh.height ) - 1 );
+                int across = pFile->blockCount( i ).x;
+
+                for ( int by = first.y / DungeonFile::BLOCK_SIZE; by <= last.y / DungeonFile::BLOCK_SIZE; ++by )
+                    for ( int bx = first.x / DungeonFile::BLOCK_SIZE; bx <= last.x / DungeonFile::BLOCK_SIZE; ++bx )
+                    {
+                        int b = bx + by * across;
+                        if ( !pFile->readBlock( i, b, block.data() ) )
+                            continue;
+
+                        ivec4 rect = pFile->blockRect( i, b );
+                        for ( int y = lo.y; y < hi.y; ++y )
+                            for ( int x = lo.x; x < hi.x; ++x )
+                            {
+                                int rx = x - pos.x;
+                                int ry = y - pos.y;
+                                int cell = (x - origin.x) + (y - origin.y) * CHUNK_SIZE;
+                                if ( claimed[ cell ] || rx < rect.x || rx >= rect.x + rect.z
+                                     || ry < rect.y || ry >= rect.y + rect.w )
+                                    continue;
+
+                                claimed[ cell ] = true;
+                                pTiles[ cell ] = block[ (rx - rect.x) + (ry - rect.y) * rect.z ];
+                            }
+                    }
+            }
+        };
+    }
+};
+
+// A* over a ChunkedWorld tells tiles apart by address.
+namespace std
+{
+    template<>
+    struct hash< std::reference_wrapper< LevelTile > >
+    {
+        size_t operator ()( const LevelTile& tile ) const
+        {
+            return (size_t) &tile;
+        }
+    };
+}
+
+inline bool operator ==( std::reference_wrapper< LevelTile > lhs, std::reference_wrapper< LevelTile > rhs )
+{
+    return &lhs.get() == &rhs.get();
+}
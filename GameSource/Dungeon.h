@@ -3,8 +3,11 @@
 #include "Util.h"
 #include "SmartTexture.h"
 #include "Astar.h"
+#include "Search.h"
 
+#include <algorithm>
 #include <memory>
+#include <utility>
 #include <vector>
 
 using Position = glm::vec2;
@@ -175,88 +178,105 @@ struct LevelTile
         return OFFSET[ flav ];
     }
 
-    Tile tileType;
-    ivec2 offset;
-    std::bitset< 8 > connections;
+    // Returns the offset of the given flavor of a tile type in its texture.
+    static ivec2 flavor_offset( Tile type, int flavor )
+    {
+        switch ( type )
+        {
+        case Tile::FLOOR: return floor_offset( Floor( flavor ) );
+        case Tile::WALL:  return wall_offset( Wall( flavor ) );
+        case Tile::PIT:   return pit_offset( Pit( flavor ) );
+        default:          return { 0, 0 };
+        }
+    }
 
-    union {
-        Floor floorFlavor;
-        Wall  wallFlavor;
-        Pit   pitFlavor;
-    };
+    // Returns the number of flavors of a tile type.
+    static int flavor_count( Tile type )
+    {
+        static constexpr int COUNT[] { 1, GRASS4 + 1, CRYSTAL4 + 1, ACID4 + 1 };
+        return COUNT[ (int) type ];
+    }
+
+    // Returns the flavor of a tile type drawn at offset; or 0 if there is
+    // none, whose offset is { 0, 0 }.
+    static int offset_flavor( Tile type, ivec2 offset )
+    {
+        for ( int flavor = 0; flavor < flavor_count( type ); ++flavor )
+            if ( flavor_offset( type, flavor ) == offset )
+                return flavor;
+        return 0;
+    }
 
+private:
+
+    // Packed into two bytes so that scanning a room touches as little
+    // memory as possible. How a tile connects to its neighbours depends on
+    // where its room is placed, so that is kept in a TileState instead.
+    // Tiles may be read straight from a file without being checked, so the
+    // accessors treat an unknown type as NONE and an unknown flavor as 0.
+    uint8_t _type = 0;   // Tile.
+    uint8_t _flavor = 0; // Index into the offset table of the type.
+
+public:
+
+    // The offset is looked up in the flavor table of the type; offsets
+    // which are not in it are stored as flavor 0.
     explicit LevelTile( Tile type = Tile::NONE,
                         ivec2 offset = { 0, 0 } )
-        : tileType { type }
-        , offset { offset }
+        : _type { uint8_t( type ) }
+        , _flavor { uint8_t( offset_flavor( type, offset ) ) }
     {
     }
 
     LevelTile( Floor flav )
-        : LevelTile( Tile::FLOOR, floor_offset( flav ) )
+        : _type { uint8_t( Tile::FLOOR ) }
+        , _flavor { uint8_t( flav ) }
     {
-        floorFlavor = flav;
     }
 
     LevelTile( Wall flav )
-        : LevelTile( Tile::WALL, wall_offset( flav ) )
+        : _type { uint8_t( Tile::WALL ) }
+        , _flavor { uint8_t( flav ) }
     {
-        wallFlavor = flav;
     }
 
     LevelTile( Pit flav )
-        : LevelTile( Tile::PIT, pit_offset( flav ) )
+        : _type { uint8_t( Tile::PIT ) }
+        , _flavor { uint8_t( flav ) }
     {
-        pitFlavor = flav;
     }
 
-    decltype(auto) operator []( AdjDirection dir )
+    Tile type() const
     {
-        return connections[ dir ];
+        return _type <= uint8_t( Tile::PIT ) ? Tile( _type ) : Tile::NONE;
     }
 
-    bool operator []( AdjDirection dir ) const
+    // Returns the flavor as an index into the offset table of the type.
+    int flavor() const
     {
-        return connections.test( dir );
+        return _flavor < flavor_count( type() ) ? _flavor : 0;
     }
 
-    bool allConnects( std::initializer_list< AdjDirection > il ) const
+    // Returns the offset of the tile's sprites in its texture.
+    ivec2 offset() const
     {
-        for ( AdjDirection dir : il )
-            if ( !connections.test( dir ) )
-                return false;
-        return true;
-    }
-
-    bool noneConnects( std::initializer_list< AdjDirection > il ) const
-    {
-        for ( AdjDirection dir : il )
-            if ( connections.test( dir ) )
-                return false;
-        return true;
+        return flavor_offset( type(), flavor() );
     }
 
     bool shouldConnect( const LevelTile& tile ) const
     {
-        if ( tileType != Tile::FLOOR && tile.tileType == Tile::NONE  )
+        if ( type() != Tile::FLOOR && tile.type() == Tile::NONE  )
             return true;
-        return tileType == tile.tileType;
-    }
-
-    template< typename List >
-    void updateConnections( List&& adjs )
-    {
-        int dir = 0;
-        for ( const LevelTile& tile : adjs )
-            connections[ dir++ ] = shouldConnect( tile );
+        return type() == tile.type();
     }
 
     TextureId getTexture() const
     {
-        return (TextureId) tileType;
+        return (TextureId) type();
     }
 
-    glm::vec4 getSprite() const
+    // Returns the sprite drawn for the tile with the given connection mask.
+    glm::vec4 getSprite( uint8_t connections ) const
     {
         static constexpr uint8_t BITMASKS[] { 0, 15, 15, 63 };
         static constexpr TextureOffset NULL_OFFSET { 0, 0 };
@@ -264,63 +284,146 @@ struct LevelTile
             &NULL_OFFSET, FLOOR_OFFSETS, WALL_OFFSETS, PIT_OFFSETS
         };
 
-        int index = connections.to_ulong() & BITMASKS[ (int) tileType ];
-        TextureOffset off = OFFSETS[ (int) tileType ][ index ];
-        return vec4( offset + ivec2( off.x, off.y ), 1, 1 ) * 16f;
+        int index = connections & BITMASKS[ (int) type() ];
+        TextureOffset off = OFFSETS[ (int) type() ][ index ];
+        return vec4( offset() + ivec2( off.x, off.y ), 1, 1 ) * 16f;
+    }
+};
+
+static_assert( sizeof( LevelTile ) == 2, "LevelTile should pack into two bytes" );
+
+// State of a tile of a room placed in a dungeon: how it connects to its
+// neighbours and any gameplay flags. Kept apart from the LevelTile, which
+// rooms made from one template share, so every placed tile has a TileState
+// of its own and its address names the placed tile, e.g. for pathfinding.
+class TileState
+{
+    uint8_t _connections = 0; // One bit per AdjDirection.
+    uint8_t _flags = 0;       // Free for gameplay state.
+
+public:
+
+    // Returns the connection mask; bit i is set if the tile connects
+    // toward AdjDirection i.
+    uint8_t connections() const
+    {
+        return _connections;
+    }
+
+    void setConnections( uint8_t connections )
+    {
+        _connections = connections;
+    }
+
+    uint8_t flags() const
+    {
+        return _flags;
+    }
+
+    void setFlags( uint8_t flags )
+    {
+        _flags = flags;
+    }
+
+    bool operator []( AdjDirection dir ) const
+    {
+        return (_connections >> dir) & 1;
+    }
+
+    bool allConnects( std::initializer_list< AdjDirection > il ) const
+    {
+        for ( AdjDirection dir : il )
+            if ( !(*this)[ dir ] )
+                return false;
+        return true;
+    }
+
+    bool noneConnects( std::initializer_list< AdjDirection > il ) const
+    {
+        for ( AdjDirection dir : il )
+            if ( (*this)[ dir ] )
+                return false;
+        return true;
+    }
+
+    // Connects tile toward each of its neighbours, given in AdjDirection
+    // order.
+    template< typename List >
+    void updateConnections( const LevelTile& tile, List&& adjs )
+    {
+        uint8_t connections = 0;
+        int dir = 0;
+        for ( const LevelTile& adj : adjs )
+            connections |= uint8_t( tile.shouldConnect( adj ) ) << dir++;
+        _connections = connections;
     }
 };
 
+static_assert( sizeof( TileState ) == 2, "TileState should pack into two bytes" );
+
 namespace std
 {
     template<>
-    struct hash< std::reference_wrapper< LevelTile > >
+    struct hash< std::reference_wrapper< TileState > >
     {
-        size_t operator ()( const LevelTile& tile ) const
+        size_t operator ()( const TileState& state ) const
         {
-            return (size_t) &tile;
+            return (size_t) &state;
         }
     };
 }
 
-inline bool operator ==( const LevelTile& lhs, const LevelTile& rhs )
+inline bool operator ==( const TileState& lhs, const TileState& rhs )
 {
     return &lhs == &rhs;
 }
 
+// Rectangle of tiles. Copies of a room share its tiles until one of them
+// is changed, so a room can serve as a template from which any number of
+// rooms are made at the cost of a pointer copy each. Anything which gives
+// out non-const access to the tiles (getTile, findTile, data, eachTile and
+// enumerate) first gives the room its own copy if the tiles are shared, so
+// only reach for it to change tiles, and hold on to the pointers it
+// returns rather than to ones taken through a const Room. A room may also
+// borrow its tiles, e.g. from a mapped file; they are then copied before
+// the first change, as if they were shared.
 class Room
 {
     ivec2 size;
-    std::unique_ptr< LevelTile[] > tiles;
-
-public:
+    std::shared_ptr< LevelTile[] > tiles;
+    bool _borrowed = false; // The tiles belong to someone else and are read-only.
 
-    Room( int width, int height )
-        : size { width, height }
-        , tiles { new LevelTile[ width * height ] }
+    std::shared_ptr< LevelTile[] > _copyTiles() const
     {
+        std::shared_ptr< LevelTile[] > copy { new LevelTile[ numTiles() ] };
+        std::copy_n( tiles.get(), numTiles(), copy.get() );
+        return copy;
     }
 
-    Room( const Room& copy )
-        : Room( copy.width(), copy.height() )
+    Room( ivec2 size, std::shared_ptr< LevelTile[] > tiles, bool borrowed )
+        : size { size }
+        , tiles { std::move( tiles ) }
+        , _borrowed { borrowed }
     {
-        for ( int i = 0; i < numTiles(); ++i )
-            tiles[ i ] = copy.tiles[ i ];
     }
 
-    Room( Room&& ) = default;
+public:
 
-    Room& operator =( const Room& copy )
+    Room( int width, int height )
+        : size { width, height }
+        , tiles { new LevelTile[ width * height ] }
     {
-        size = copy.size;
-        tiles = std::make_unique< LevelTile[] >( numTiles() );
-
-        for ( int i = 0; i < numTiles(); ++i )
-            tiles[ i ] = copy.tiles[ i ];
-
-        return *this;
     }
 
-    Room& operator =( Room&& ) = default;
+    // Makes a room which reads its width * height tiles, row by row, from
+    // pTiles in place. owner keeps them alive for as long as the room, or
+    // any room copied from it, still reads them.
+    static Room borrow( int width, int height, const LevelTile* pTiles, const std::shared_ptr< const void >& owner )
+    {
+        return Room( { width, height },
+                     std::shared_ptr< LevelTile[] >( owner, const_cast< LevelTile* >( pTiles ) ),
+                     true );
+    }
 
     int numTiles() const
     {
@@ -337,18 +440,60 @@ public:
         return size.y;
     }
 
+    // Returns true if the tiles are shared with another room or borrowed.
+    bool shared() const
+    {
+        return _borrowed || tiles.use_count() > 1;
+    }
+
+    // Gives the room its own copy of the tiles if they are shared.
+    void unshare()
+    {
+        if ( !shared() )
+            return;
+
+        tiles = _copyTiles();
+        _borrowed = false;
+    }
+
     LevelTile& getTile( int x, int y )
+    {
+        unshare();
+        return tiles[ x + y * width() ];
+    }
+
+    const LevelTile& getTile( int x, int y ) const
     {
         return tiles[ x + y * width() ];
     }
 
     LevelTile* findTile( int x, int y )
+    {
+        if ( x < 0 || x >= width() || y < 0 || y >= height() )
+            return nullptr;
+        unshare();
+        return &tiles[ x + y * width() ];
+    }
+
+    const LevelTile* findTile( int x, int y ) const
     {
         if ( x < 0 || x >= width() || y < 0 || y >= height() )
             return nullptr;
         return &tiles[ x + y * width() ];
     }
 
+    // Returns the tiles, row by row.
+    LevelTile* data()
+    {
+        unshare();
+        return tiles.get();
+    }
+
+    const LevelTile* data() const
+    {
+        return tiles.get();
+    }
+
     bool owns( const LevelTile* pTile ) const
     {
         auto* pTiles = tiles.get();
@@ -367,14 +512,25 @@ public:
     template< typename Func >
     void eachTile( Func&& func )
     {
+        unshare();
         int i = 0;
         for ( int y = 0; y < size.y; ++y )
             for ( int x = 0; x < size.x; ++x )
                 func( tiles[ i++ ], { x, y } );
     }
 
+    template< typename Func >
+    void eachTile( Func&& func ) const
+    {
+        int i = 0;
+        for ( int y = 0; y < size.y; ++y )
+            for ( int x = 0; x < size.x; ++x )
+                func( (const LevelTile&) tiles[ i++ ], { x, y } );
+    }
+
     auto enumerate()
     {
+        unshare();
         int i = 0;
         for ( int y = 0; y < size.y; ++y )
             for ( int x = 0; x < size.x; ++x )
@@ -384,28 +540,217 @@ public:
 
 class Dungeon
 {
+    // Rooms in a dungeon share their tiles with the room they were made
+    // from until one of them is changed, and keep a TileState of their own
+    // for each tile. findState and tilePos rely on the states keeping their
+    // addresses.
     struct DungeonRoom : Room
     {
         vec2 pos { 0, 0 };
+        std::vector< TileState > states; // One per tile, row by row.
 
-        DungeonRoom() : Room( 1, 1 )
+        DungeonRoom()
+            : DungeonRoom( Room( 1, 1 ) )
         {
         }
 
-        DungeonRoom( const Room& room, vec2 pos = { 0, 0 } )
-            : Room( room )
+        DungeonRoom( Room room, vec2 pos = { 0, 0 } )
+            : Room( std::move( room ) )
             , pos { pos }
+            , states( numTiles() )
+        {
+        }
+
+        // Returns the state of the tile at x, y of the room.
+        TileState& getState( int x, int y )
         {
+            return states[ x + y * width() ];
         }
     };
 
+    static constexpr int NO_ROOM = -1;
+
     std::vector< DungeonRoom > rooms;
 
     ivec2 _pos;
     ivec2 _size;
 
+    // Index of the room covering each cell of the grid (the first one if
+    // rooms overlap) or NO_ROOM. Covers [_gridPos, _gridPos + _gridSize).
+    std::vector< int > _grid;
+    ivec2 _gridPos { 0, 0 };
+    ivec2 _gridSize { 0, 0 };
+    size_t _hiddenTiles = 0; // Room tiles under a cell claimed by an earlier room.
+
+    // Address of the first tile state of every room in ascending order,
+    // and the index of that room. Used to find the room which owns a state.
+    std::vector< uintptr_t > _tileStarts;
+    std::vector< int > _tileRooms;
+
+    // Returns the cells covered by a room as { x0, y0, x1, y1 }, with the
+    // end exclusive. Matches the bounds test done by Room::findTile.
+    static ivec4 _cellRange( const DungeonRoom& room )
+    {
+        return ivec4( glm::ceil( room.pos ),
+                      glm::ceil( room.pos + vec2( room.width(), room.height() ) ) );
+    }
+
+    // Returns the room covering the grid cell at x, y; or NO_ROOM.
+    int _roomAt( int x, int y ) const
+    {
+        x -= _gridPos.x;
+        y -= _gridPos.y;
+        if ( unsigned( x ) >= unsigned( _gridSize.x ) || unsigned( y ) >= unsigned( _gridSize.y ) )
+            return NO_ROOM;
+        return _grid[ x + y * _gridSize.x ];
+    }
+
+    // Returns the offset of the tile at x, y in the room covering it; or
+    // -1 if there is none. Sets index to the room.
+    int _tileAt( int x, int y, int& index ) const
+    {
+        index = _roomAt( x, y );
+        if ( index == NO_ROOM )
+            return -1;
+
+        const DungeonRoom& room = rooms[ index ];
+        int rx = x - room.pos.x;
+        int ry = y - room.pos.y;
+        if ( rx < 0 || rx >= room.width() || ry < 0 || ry >= room.height() )
+            return -1;
+        return rx + ry * room.width();
+    }
+
+    // Claims the free cells covered by a room.
+    void _indexRoom( int index )
+    {
+        ivec4 r = _cellRange( rooms[ index ] ) - ivec4( _gridPos, _gridPos );
+        r = glm::clamp( r, ivec4( 0 ), ivec4( _gridSize, _gridSize ) );
+
+        for ( int y = r.y; y < r.w; ++y )
+        {
+            int* pCell = &_grid[ size_t( y ) * _gridSize.x ];
+            for ( int x = r.x; x < r.z; ++x )
+            {
+                if ( pCell[ x ] == NO_ROOM )
+                    pCell[ x ] = index;
+                else
+                    ++_hiddenTiles;
+            }
+        }
+    }
+
+    // Inserts a room into the table used by tilePos.
+    void _indexTiles( int index )
+    {
+        uintptr_t start = uintptr_t( rooms[ index ].states.data() );
+        size_t i = sorted_lower_bound( _tileStarts, start ) - _tileStarts.begin();
+        _tileStarts.insert( _tileStarts.begin() + i, start );
+        _tileRooms.insert( _tileRooms.begin() + i, index );
+    }
+
+    // Returns the index of the room owning a tile state; or NO_ROOM.
+    int _roomOf( const TileState* pState ) const
+    {
+        // Find the last room whose states start at or before pState.
+        uintptr_t addr = uintptr_t( pState );
+        auto it = sorted_lower_bound( _tileStarts, addr );
+        if ( it == _tileStarts.end() || *it != addr )
+        {
+            if ( it == _tileStarts.begin() )
+                return NO_ROOM;
+            --it;
+        }
+
+        int index = _tileRooms[ it - _tileStarts.begin() ];
+        const DungeonRoom& room = rooms[ index ];
+        if ( pState < room.states.data() || pState >= room.states.data() + room.states.size() )
+            return NO_ROOM;
+        return index;
+    }
+
+    // Extends the bounds of the dungeon to cover a room placed at pos.
+    void _growBounds( const Room& room, vec2 pos )
+    {
+        int width = room.width() + pos.x;
+        int height = room.height() + pos.y;
+        int x = pos.x;
+        int y = pos.y;
+
+        if ( width > _size.x )
+            _size.x = width;
+
+        if ( height > _size.y )
+            _size.y = height;
+
+        if ( x < _pos.x )
+            _pos.x = x;
+
+        if ( y < _pos.y )
+            _pos.y = y;
+    }
+
+    // Rebuilds the grid over the cells in [lo, hi).
+    void _rebuildGrid( ivec2 lo, ivec2 hi )
+    {
+        _gridPos = lo;
+        _gridSize = glm::max( hi - lo, ivec2( 0 ) );
+        _grid.assign( size_t( _gridSize.x ) * _gridSize.y, NO_ROOM );
+        _hiddenTiles = 0;
+
+        for ( int i = 0; i < (int) rooms.size(); ++i )
+            _indexRoom( i );
+    }
+
 public:
 
+    Dungeon() = default;
+
+    Dungeon( const Dungeon& copy )
+        : rooms( copy.rooms )
+        , _pos( copy._pos )
+        , _size( copy._size )
+    {
+        reindex();
+    }
+
+    Dungeon( Dungeon&& ) = default;
+
+    Dungeon& operator =( const Dungeon& copy )
+    {
+        rooms = copy.rooms;
+        _pos = copy._pos;
+        _size = copy._size;
+        reindex();
+        return *this;
+    }
+
+    Dungeon& operator =( Dungeon&& ) = default;
+
+    // Rebuilds the spatial index from scratch. Only needed if a room is
+    // resized or reassigned through eachRoom.
+    void reindex()
+    {
+        ivec2 lo { 0, 0 };
+        ivec2 hi { 0, 0 };
+
+        for ( DungeonRoom& room : rooms )
+        {
+            if ( room.states.size() != size_t( room.numTiles() ) )
+                room.states.assign( room.numTiles(), TileState() );
+
+            ivec4 r = _cellRange( room );
+            lo = glm::min( lo, ivec2( r.x, r.y ) );
+            hi = glm::max( hi, ivec2( r.z, r.w ) );
+        }
+        _rebuildGrid( lo, hi );
+
+        _tileStarts.clear();
+        _tileRooms.clear();
+        for ( int i = 0; i < (int) rooms.size(); ++i )
+            _indexTiles( i );
+    }
+
     size_t roomCount() const
     {
         return rooms.size();
@@ -540,43 +885,116 @@ public:
         return ivec4( position(), dimensions() );
     }
 
-    LevelTile& getTile( int x, int y )
+    // Returns the cells covered by the spatial index as { x, y, width, height }.
+    // Every cell covered by a room lies inside it.
+    ivec4 indexRect() const
     {
-        for ( DungeonRoom& room : rooms )
-            if ( x >= room.pos.x && x < room.pos.x + room.width() )
-            if ( y >= room.pos.y && y < room.pos.y + room.height() )
-                return room.getTile( x - room.pos.x, y - room.pos.y );
+        return ivec4( _gridPos, _gridSize );
+    }
 
-        throw "Invalid Tile";
+    // Returns the number of room tiles hidden under another room, which
+    // findTile can not reach.
+    size_t hiddenTileCount() const
+    {
+        return _hiddenTiles;
     }
 
-    LevelTile* findTile( int x, int y )
+    // Tiles are read through a const Dungeon so that rooms keep sharing
+    // their tiles; change them with setTile.
+
+    const LevelTile& getTile( int x, int y ) const
     {
-        for ( DungeonRoom& room : rooms )
-            if ( x >= room.pos.x && x < room.pos.x + room.width() )
-            if ( y >= room.pos.y && y < room.pos.y + room.height() )
-                return room.findTile( x - room.pos.x, y - room.pos.y );
+        if ( const LevelTile* pTile = findTile( x, y ) )
+            return *pTile;
 
-        return nullptr;
+        throw "Invalid Tile";
     }
 
     const LevelTile* findTile( int x, int y ) const
     {
-        return const_cast< Dungeon& >( *this ).findTile( x, y );
+        int index;
+        int off = _tileAt( x, y, index );
+        return off < 0 ? nullptr : ((const Room&) rooms[ index ]).data() + off;
     }
 
-    vec2 tilePos( const LevelTile* pTile ) const
+    // Changes the tile at x, y, giving its room its own copy of the tiles
+    // if they are shared.
+    void setTile( int x, int y, LevelTile tile )
     {
-        for ( const DungeonRoom& room : rooms )
-            if ( room.owns( pTile ) )
-                return (vec2) room.tilePos( pTile ) + room.pos;
+        int index;
+        int off = _tileAt( x, y, index );
+        if ( off < 0 )
+            throw "Invalid Tile";
+
+        rooms[ index ].data()[ off ] = tile;
+    }
+
+    // Changes the tile whose state is given, which may be hidden under
+    // another room.
+    void setTile( const TileState& state, LevelTile tile )
+    {
+        int index = _roomOf( &state );
+        if ( index == NO_ROOM )
+            throw "Invalid Tile";
+
+        DungeonRoom& room = rooms[ index ];
+        room.data()[ &state - room.states.data() ] = tile;
+    }
+
+    TileState& getState( int x, int y )
+    {
+        if ( TileState* pState = findState( x, y ) )
+            return *pState;
+
+        throw "Invalid Tile";
+    }
+
+    // Returns the state of the tile findTile finds at x, y; or null.
+    TileState* findState( int x, int y )
+    {
+        int index;
+        int off = _tileAt( x, y, index );
+        return off < 0 ? nullptr : &rooms[ index ].states[ off ];
+    }
+
+    const TileState* findState( int x, int y ) const
+    {
+        return const_cast< Dungeon& >( *this ).findState( x, y );
+    }
+
+    // Returns the tile whose state is given.
+    const LevelTile& tileOf( const TileState& state ) const
+    {
+        const DungeonRoom& room = rooms[ _roomOf( &state ) ];
+        return ((const Room&) room).data()[ &state - room.states.data() ];
+    }
+
+    // Returns the cell of the index which holds the room tile at tpos, as
+    // given by eachTile and tilePos. Rooms cover the cells from the ceiling
+    // of their position on, as in _cellRange.
+    static ivec2 tileCell( vec2 tpos )
+    {
+        return ivec2( glm::ceil( tpos ) );
+    }
+
+    vec2 tilePos( const TileState* pState ) const
+    {
+        int index = _roomOf( pState );
+        if ( index != NO_ROOM )
+        {
+            const DungeonRoom& room = rooms[ index ];
+            int off = pState - room.states.data();
+            return room.pos + vec2( off % room.width(), off / room.width() );
+        }
         assert( false );
         return {};
     }
 
+    // Pathfinding works on placed tiles, named by their states.
+
     auto distanceEstimateFunc()
     {
-        return [this]( LevelTile& start, LevelTile& goal )
+        return [this]( TileState& start, TileState& goal )
         {
             return manhattan( tilePos( &start ), tilePos( &goal ) );
         };
@@ -584,7 +1002,7 @@ public:
 
     auto tileCostFunc()
     {
-        return [this]( LevelTile& tile )
+        return [this]( TileState& state )
         {
             return 1;
         };
@@ -592,41 +1010,59 @@ public:
 
     auto neighborsFunc()
     {
-        return [this]( LevelTile& tile )
+        return [this]( TileState& state )
         {
-            vec2 pos = tilePos( &tile );
+            vec2 pos = tilePos( &state );
 
             static const ivec2 VECTORS[] {
                 { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 }
             };
 
             for ( ivec2 v : VECTORS )
-                if ( LevelTile* pTile = findTile( pos.x + v.x, pos.y + v.y ) )
-                    if ( pTile->tileType == Tile::FLOOR )
-                        co_yield std::ref( *pTile );
+                if ( const LevelTile* pTile = findTile( pos.x + v.x, pos.y + v.y ) )
+                    if ( pTile->type() == Tile::FLOOR )
+                        co_yield std::ref( *findState( pos.x + v.x, pos.y + v.y ) );
         };
     }
 
     void addRoom( Room room, vec2 pos = { 0, 0 } )
     {
-        int width = room.width() + pos.x;
-        int height = room.height() + pos.y;
-        int x = pos.x;
-        int y = pos.y;
-
-        if ( width > _size.x )
-            _size.x = width;
-
-        if ( height > _size.y )
-            _size.y = height;
+        _growBounds( room, pos );
+        rooms.emplace_back( move( room ), pos );
+        int index = int( rooms.size() - 1 );
+        _indexTiles( index );
 
-        if ( x < _pos.x )
-            _pos.x = x;
+        // Grow the grid with some slack if the room does not fit in it.
+        ivec4 r = _cellRange( rooms[ index ] );
+        ivec2 lo = _gridPos;
+        ivec2 hi = _gridPos + _gridSize;
 
-        if ( y < _pos.y )
-            _pos.y = y;
+        if ( r.x < lo.x || r.y < lo.y || r.z > hi.x || r.w > hi.y )
+        {
+            ivec2 slack = (glm::max( hi, ivec2( r.z, r.w ) ) - glm::min( lo, ivec2( r.x, r.y ) )) / 2;
+            if ( r.x < lo.x ) lo.x = r.x - slack.x;
+            if ( r.y < lo.y ) lo.y = r.y - slack.y;
+            if ( r.z > hi.x ) hi.x = r.z + slack.x;
+            if ( r.w > hi.y ) hi.y = r.w + slack.y;
+            _rebuildGrid( lo, hi );
+        }
+        else
+        {
+            _indexRoom( index );
+        }
+    }
 
-        rooms.emplace_back( move( room ), pos );
+    // Adds many rooms, each with its position, and indexes them all at once
+    // rather than room by room.
+    void addRooms( std::vector< std::pair< Room, vec2 > > newRooms )
+    {
+        rooms.reserve( rooms.size() + newRooms.size() );
+        for ( auto& [room, pos] : newRooms )
+        {
+            _growBounds( room, pos );
+            rooms.emplace_back( move( room ), pos );
+        }
+        reindex();
     }
 
     void removeRoom( Room& room )
@@ -651,11 +1087,29 @@ public:
                 if ( recalcPos )
                     _pos = calculatePos();
 
+                reindex();
                 break;
             }
         }
     }
 
+    void moveRoom( Room& room, vec2 pos )
+    {
+        for ( DungeonRoom& droom : rooms )
+        {
+            if ( &droom == &room )
+            {
+                droom.pos = pos;
+                _size = calculateDimensions();
+                _pos = calculatePos();
+                reindex();
+                break;
+            }
+        }
+    }
+
+    // Calls func( room, pos ) for every room. Changing the tiles of a room
+    // gives it its own copy of them if they are shared.
     template< typename Func >
     void eachRoom( Func&& func )
     {
@@ -670,10 +1124,97 @@ public:
             func( (const Room&) room, room.pos );
     }
 
+    // Calls func( x, y, pTiles, pStates, count ) for every run of cells on a
+    // row of the index which findTile maps to the same room, in row-major
+    // order. The tile at x + i, y is pTiles[ i ] for i < count, and its
+    // state pStates[ i ].
+    template< typename Func >
+    void eachTileRun( Func&& func )
+    {
+        std::as_const( *this ).eachTileRun(
+            [&]( int x, int y, const LevelTile* pTiles, const TileState* pStates, int count )
+        {
+            func( x, y, pTiles, const_cast< TileState* >( pStates ), count );
+        } );
+    }
+
+    template< typename Func >
+    void eachTileRun( Func&& func ) const
+    {
+        for ( int y = 0; y < _gridSize.y; ++y )
+        {
+            const int* pRow = &_grid[ size_t( y ) * _gridSize.x ];
+            for ( int x = 0; x < _gridSize.x; )
+            {
+                int index = pRow[ x ];
+                int end = x + 1;
+                while ( end < _gridSize.x && pRow[ end ] == index )
+                    ++end;
+
+                if ( index != NO_ROOM )
+                {
+                    ivec2 cell = _gridPos + ivec2( x, y );
+                    func( cell.x, cell.y, findTile( cell.x, cell.y ),
+                          findState( cell.x, cell.y ), end - x );
+                }
+                x = end;
+            }
+        }
+    }
+
+    // Calls func( tile, state, pos ) for every tile of every room, room by
+    // room and row by row. Tiles hidden under an earlier room are visited
+    // too, as with eachRoom. func may change tiles with setTile.
+    template< typename Func >
+    void eachTile( Func&& func )
+    {
+        for ( DungeonRoom& room : rooms )
+        {
+            const Room& layout = room;
+            int i = 0;
+            for ( int y = 0; y < room.height(); ++y )
+                for ( int x = 0; x < room.width(); ++x, ++i )
+                    func( layout.data()[ i ], room.states[ i ], room.pos + vec2( x, y ) );
+        }
+    }
+
+    template< typename Func >
+    void eachTile( Func&& func ) const
+    {
+        const_cast< Dungeon& >( *this ).eachTile(
+            [&]( const LevelTile& tile, const TileState& state, vec2 pos )
+        {
+            func( tile, state, pos );
+        } );
+    }
+
+    // Calls func( tile, state, pos ) for every tile of every room whose
+    // cell (see tileCell) lies in area, given as inclusive
+    // { x0, y0, x1, y1 }. Tiles hidden under an earlier room are visited
+    // too, as with eachRoom.
+    template< typename Func >
+    void eachTileIn( ivec4 area, Func&& func )
+    {
+        for ( DungeonRoom& room : rooms )
+        {
+            // Tile x, y of the room lies in cell first + ( x, y ).
+            ivec2 first = tileCell( room.pos );
+            int x0 = std::max( area.x - first.x, 0 );
+            int y0 = std::max( area.y - first.y, 0 );
+            int x1 = std::min( area.z - first.x, room.width() - 1 );
+            int y1 = std::min( area.w - first.y, room.height() - 1 );
+
+            for ( int y = y0; y <= y1; ++y )
+                for ( int x = x0; x <= x1; ++x )
+                    func( ((const Room&) room).getTile( x, y ), room.getState( x, y ), room.pos + vec2( x, y ) );
+        }
+    }
+
     void settleRooms()
     {
         for ( DungeonRoom& room : rooms )
             room.pos = glm::round( room.pos );
+        reindex();
     }
 
     auto enumerate()
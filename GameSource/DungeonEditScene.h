@@ -1,6 +1,8 @@
 #pragma once
 
 #include "DungeonScene.h"
+#include "DungeonFile.h"
+#include "DungeonText.h"
 
 #include <fstream>
 
@@ -21,30 +23,27 @@ public:
         DungeonScene::update( ticks );
 
         vec2 mPos = getMousePos() / (RENDER_SCALE * TILE_SIZE);
-        LevelTile* pTile = dungeon.findTile( mPos.x, mPos.y );
-
-        if ( pTile != nullptr )
+        if ( dungeon.findTile( mPos.x, mPos.y ) != nullptr )
         {
             if ( wasButtonPressed( LEFT_BUTTON ) )
             {
-                *pTile = FLOOR_TILE;
-                updateConnections();
-                initExtras();
+                dungeon.setTile( mPos.x, mPos.y, FLOOR_TILE );
+                markDirty( mPos );
             }
             else if ( wasButtonPressed( RIGHT_BUTTON ) )
             {
-                *pTile = WALL_TILE;
-                updateConnections();
-                initExtras();
+                dungeon.setTile( mPos.x, mPos.y, WALL_TILE );
+                markDirty( mPos );
             }
             else if ( wasButtonPressed( MIDDLE_BUTTON ) )
             {
-                *pTile = PIT_TILE;
-                updateConnections();
-                initExtras();
+                dungeon.setTile( mPos.x, mPos.y, PIT_TILE );
+                markDirty( mPos );
             }
         }
 
+        updateDirtyTiles();
+
         // Ctrl + S (save) behaviour
         if ( isCtrlDown() && wasKeyPressed( SDLK_s ) )
             saveDungeon();
@@ -78,63 +77,51 @@ public:
 
 protected:
 
+    // Saves the binary dungeon.dgn, plus dungeon.txt which can be read and
+    // diffed.
     void saveDungeon()
     {
-        using std::endl;
-
-        std::ofstream file( "dungeon.txt", std::ios_base::trunc );
-
-        file << dungeon.roomCount() << endl;
-
-        dungeon.eachRoom( [&]( Room& room, vec2 pos )
-        {
-            file << pos.x << ' ' << pos.y << endl;
-            file << room.width() << ' ' << room.height() << endl;
-
-            room.eachTile( [&]( LevelTile& tile, ivec2 )
-            {
-                file << (int) tile.tileType << ' '
-                    << tile.offset.x << ' '
-                    << tile.offset.y << ' ';
-            } );
-
-            file << endl;
-        } );
+        DungeonFile::save( "dungeon.dgn", dungeon );
+        saveDungeonText();
     }
 
+    // Loads dungeon.dgn; or dungeon.txt if there is no valid binary file.
     void loadDungeon()
     {
-        std::ifstream file( "dungeon.txt" );
-
-        int numRooms;
-        file >> numRooms;
-
-        Dungeon newDungeon;
-
-        for ( int i = 0; i < numRooms; ++i )
+        DungeonFile file;
+        if ( file.open( "dungeon.dgn" ) )
         {
-            vec2 pos;
-            file >> pos.x >> pos.y;
-
-            ivec2 size;
-            file >> size.x >> size.y;
-            Room room( size.x, size.y );
-
-            room.eachTile( [&]( LevelTile& tile, ivec2 )
+            try
             {
-                Tile type;
-                ivec2 off;
-                file >> (int&) type >> off.x >> off.y;
-
-                tile = LevelTile( type, off );
-            } );
-
-            newDungeon.addRoom( move( room ), pos );
+                setDungeon( file.load() );
+                return;
+            }
+            catch ( const char* )
+            {
+                // A block is corrupt; fall back on the text file.
+            }
         }
+        loadDungeonText();
+    }
 
+    void setDungeon( Dungeon&& newDungeon )
+    {
         dungeon = move( newDungeon );
         updateConnections();
         initExtras();
+        dirtyTiles = { 0, 0, -1, -1 };
+    }
+
+    void saveDungeonText()
+    {
+        std::ofstream file( "dungeon.txt", std::ios_base::trunc );
+        save_dungeon_text( file, dungeon );
+    }
+
+    void loadDungeonText()
+    {
+        std::ifstream file( "dungeon.txt" );
+        setDungeon( load_dungeon_text( file ) );
     }
 
 };
@@ -0,0 +1,368 @@
+#pragma once
+
+#include "Dungeon.h"
+#include "MappedFile.h"
+#include "Compression.h"
+
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Binary dungeon file. A Header is followed by a RoomHeader for every room,
+// then a BlockHeader for every block and then the tiles, as packed
+// LevelTiles. In an uncompressed file the tiles of each room lie together,
+// row by row, and are used in place: the file is mapped, load() makes rooms
+// which borrow their tiles from the mapping and nothing is parsed or copied
+// beyond the tables. In a compressed file the tiles of a room are split into
+// blocks of up to BLOCK_SIZE x BLOCK_SIZE tiles, row by row, each compressed
+// on its own with lz_compress, so a loader which needs part of a large map
+// only decompresses the blocks it covers. Opening a file checks the tables
+// and that the tiles they point at lie within the file; the tiles
+// themselves are not checked, as LevelTile reads unknown values as NONE.
+// Every const member may be called from any thread.
+// Files are little endian, as are all the platforms the game runs on.
+class DungeonFile
+{
+public:
+
+    static constexpr uint32_t MAGIC = 'D' | ('G' << 8) | ('N' << 16) | (0x1A << 24);
+    static constexpr uint32_t VERSION = 4;
+
+    // Tiles along each side of a full block of a compressed file.
+    static constexpr int BLOCK_SIZE = 64;
+
+    // Furthest a room may reach from the origin, in tiles, so that the cell
+    // maths of the dungeon it is loaded into can not overflow.
+    static constexpr int MAX_EXTENT = 1 << 24;
+
+    // Most cells the bounds of the rooms may cover, as the dungeon they are
+    // loaded into keeps a grid over them.
+    static constexpr uint64_t MAX_CELLS = 1 << 26;
+
+    enum Flags : uint32_t
+    {
+        COMPRESSED = 1,
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t roomCount;
+        uint32_t blockCount; // 0 in an uncompressed file.
+        uint32_t reserved;
+    };
+
+    struct RoomHeader
+    {
+        float    x, y;          // Position of the room in the dungeon.
+        int32_t  width, height; // Size of the room in tiles.
+        uint32_t firstBlock;    // Index of the room's first block if compressed.
+        uint32_t reserved;
+        uint64_t tileOffset;    // Offset of the room's tiles if not compressed.
+    };
+
+    struct BlockHeader
+    {
+        uint64_t offset;     // Offset of the block in the file.
+        uint32_t storedSize; // Size of the block in the file.
+        uint32_t size;       // Size of the tiles once decompressed.
+    };
+
+    static_assert( sizeof( Header ) == 24 && sizeof( RoomHeader ) == 32 && sizeof( BlockHeader ) == 16,
+                   "DungeonFile: unexpected header padding" );
+    static_assert( std::is_trivially_copyable_v< LevelTile >, "DungeonFile: LevelTile must be trivially copyable" );
+
+private:
+
+    // Shared with the rooms load() makes from an uncompressed file, which
+    // keep it mapped.
+    std::shared_ptr< MappedFile > _file;
+    Header _header {};
+
+    const RoomHeader* _rooms() const
+    {
+        return (const RoomHeader*) (_file->data() + sizeof( Header ));
+    }
+
+    const BlockHeader* _blocks() const
+    {
+        return (const BlockHeader*) (_rooms() + _header.roomCount);
+    }
+
+    static int _blocksAlong( int tiles )
+    {
+        return (tiles + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    // Returns true if the tables lie within the file, the rooms lie within
+    // bounds and the tiles of every room, or each of its blocks, lie within
+    // the file and have the size the room needs.
+    bool _validate() const
+    {
+        uint64_t tables = sizeof( Header )
+            + uint64_t( _header.roomCount ) * sizeof( RoomHeader )
+            + uint64_t( _header.blockCount ) * sizeof( BlockHeader );
+        if ( tables > _file->size() )
+            return false;
+
+        ivec2 lo { MAX_EXTENT }, hi { -MAX_EXTENT };
+        for ( int i = 0; i < roomCount(); ++i )
+        {
+            const RoomHeader& rh = room( i );
+            if ( rh.width < 0 || rh.height < 0
+                 || !(std::abs( rh.x ) <= MAX_EXTENT - rh.width)
+                 || !(std::abs( rh.y ) <= MAX_EXTENT - rh.height) )
+                return false;
+
+            // The same cells as Dungeon's grid.
+            vec2 pos { rh.x, rh.y };
+            lo = glm::min( lo, ivec2( glm::ceil( pos ) ) );
+            hi = glm::max( hi, ivec2( glm::ceil( pos + vec2( rh.width, rh.height ) ) ) );
+            if ( uint64_t( std::max( hi.x - lo.x, 0 ) ) * std::max( hi.y - lo.y, 0 ) > MAX_CELLS )
+                return false;
+
+            if ( !compressed() )
+            {
+                uint64_t size = uint64_t( rh.width ) * rh.height * sizeof( LevelTile );
+                if ( rh.tileOffset < tables || rh.tileOffset > _file->size()
+                     || size > _file->size() - rh.tileOffset )
+                    return false;
+                continue;
+            }
+
+            ivec2 blocks = blockCount( i );
+            if ( rh.firstBlock > _header.blockCount
+                 || uint64_t( blocks.x ) * blocks.y > _header.blockCount - rh.firstBlock )
+                return false;
+
+            for ( int b = 0; b < blocks.x * blocks.y; ++b )
+            {
+                const BlockHeader& bh = _blocks()[ rh.firstBlock + b ];
+                ivec4 rect = blockRect( i, b );
+
+                if ( bh.size != uint64_t( rect.z ) * rect.w * sizeof( LevelTile )
+                     || bh.offset < tables || bh.offset > _file->size()
+                     || bh.storedSize > _file->size() - bh.offset )
+                    return false;
+
+                // Each compressed byte expands to at most 255 bytes.
+                if ( bh.size / 255 > bh.storedSize )
+                    return false;
+            }
+        }
+        return true;
+    }
+
+public:
+
+    DungeonFile() = default;
+
+    // Writes dungeon to the file at path, compressed unless told not to be.
+    // Returns false if the file could not be written.
+    static bool save( const char* path, const Dungeon& dungeon, bool compress = true )
+    {
+        std::vector< RoomHeader > rooms;
+        std::vector< BlockHeader > blocks;
+        std::vector< byte > data;
+        std::vector< LevelTile > tiles;
+        std::vector< byte > compressed;
+
+        dungeon.eachRoom( [&]( const Room& room, vec2 pos )
+        {
+            rooms.push_back( { pos.x, pos.y, room.width(), room.height(), uint32_t( blocks.size() ), 0, data.size() } );
+
+            if ( !compress )
+            {
+                const byte* pTiles = (const byte*) room.data();
+                data.insert( data.end(), pTiles, pTiles + room.numTiles() * sizeof( LevelTile ) );
+                return;
+            }
+
+            for ( int by = 0; by < room.height(); by += BLOCK_SIZE )
+                for ( int bx = 0; bx < room.width(); bx += BLOCK_SIZE )
+                {
+                    int w = std::min( BLOCK_SIZE, room.width() - bx );
+                    int h = std::min( BLOCK_SIZE, room.height() - by );
+
+                    tiles.clear();
+                    for ( int y = by; y < by + h; ++y )
+                        tiles.insert( tiles.end(), room.data() + bx + y * room.width(),
+                                      room.data() + bx + w + y * room.width() );
+
+                    size_t size = tiles.size() * sizeof( LevelTile );
+                    compressed.resize( lz_compress_bound( size ) );
+                    size_t storedSize = lz_compress( tiles.data(), size, compressed.data() );
+
+                    blocks.push_back( { data.size(), uint32_t( storedSize ), uint32_t( size ) } );
+                    data.insert( data.end(), compressed.data(), compressed.data() + storedSize );
+                }
+        } );
+
+        Header header { MAGIC, VERSION, compress ? COMPRESSED : 0u,
+                        uint32_t( rooms.size() ), uint32_t( blocks.size() ), 0 };
+
+        // Tile and block offsets were relative to the data; make them file
+        // offsets.
+        uint64_t dataOffset = sizeof( Header ) + rooms.size() * sizeof( RoomHeader )
+            + blocks.size() * sizeof( BlockHeader );
+        for ( RoomHeader& rh : rooms )
+            rh.tileOffset = compress ? 0 : rh.tileOffset + dataOffset;
+        for ( BlockHeader& bh : blocks )
+            bh.offset += dataOffset;
+
+        std::ofstream file( path, std::ios_base::binary | std::ios_base::trunc );
+        file.write( (const char*) &header, sizeof( header ) );
+        file.write( (const char*) rooms.data(), rooms.size() * sizeof( RoomHeader ) );
+        file.write( (const char*) blocks.data(), blocks.size() * sizeof( BlockHeader ) );
+        file.write( (const char*) data.data(), data.size() );
+        return bool( file );
+    }
+
+    // Maps the file at path. Returns false if it could not be read or is not
+    // a valid dungeon file of this version.
+    bool open( const char* path )
+    {
+        close();
+
+        _file = std::make_shared< MappedFile >();
+        if ( !_file->open( path ) || _file->size() < sizeof( Header ) )
+        {
+            close();
+            return false;
+        }
+
+        std::memcpy( &_header, _file->data(), sizeof( Header ) );
+
+        if ( _header.magic != MAGIC || _header.version != VERSION || !_validate() )
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // Lets go of the file. Rooms loaded from it in place keep it mapped.
+    void close()
+    {
+        _file.reset();
+        _header = {};
+    }
+
+    bool compressed() const
+    {
+        return (_header.flags & COMPRESSED) != 0;
+    }
+
+    int roomCount() const
+    {
+        return int( _header.roomCount );
+    }
+
+    const RoomHeader& room( int index ) const
+    {
+        return _rooms()[ index ];
+    }
+
+    // Returns the tiles of a room, row by row, in place; or null if the file
+    // is compressed.
+    const LevelTile* tiles( int index ) const
+    {
+        return compressed() ? nullptr : (const LevelTile*) (_file->data() + room( index ).tileOffset);
+    }
+
+    // Returns the number of blocks across and down a room.
+    ivec2 blockCount( int index ) const
+    {
+        const RoomHeader& rh = room( index );
+        return { _blocksAlong( rh.width ), _blocksAlong( rh.height ) };
+    }
+
+    // Returns the tiles a block of a room covers as { x, y, w, h } in the
+    // room. Blocks are numbered row by row.
+    ivec4 blockRect( int index, int block ) const
+    {
+        const RoomHeader& rh = room( index );
+        int across = _blocksAlong( rh.width );
+        ivec2 pos = ivec2( block % across, block / across ) * BLOCK_SIZE;
+        return ivec4( pos, glm::min( ivec2( BLOCK_SIZE ), ivec2( rh.width, rh.height ) - pos ) );
+    }
+
+    // Reads the tiles of a block of a room into pTiles, row by row, w * h
+    // tiles as given by blockRect(). Returns false if the block is corrupt.
+    // Blocks of an uncompressed file are copied out of tiles().
+    bool readBlock( int index, int block, LevelTile* pTiles ) const
+    {
+        if ( const LevelTile* pRoom = tiles( index ) )
+        {
+            ivec4 rect = blockRect( index, block );
+            for ( int y = 0; y < rect.w; ++y )
+                std::memcpy( pTiles + y * rect.z, pRoom + rect.x + (rect.y + y) * room( index ).width,
+                             rect.z * sizeof( LevelTile ) );
+            return true;
+        }
+
+        const BlockHeader& bh = _blocks()[ room( index ).firstBlock + block ];
+        return lz_decompress( _file->data() + bh.offset, bh.storedSize, pTiles, bh.size );
+    }
+
+    // Reads every tile of a room into pTiles, row by row. Returns false if
+    // any of its blocks is corrupt.
+    bool readRoom( int index, LevelTile* pTiles ) const
+    {
+        const RoomHeader& rh = room( index );
+        if ( const LevelTile* pRoom = tiles( index ) )
+        {
+            std::memcpy( pTiles, pRoom, size_t( rh.width ) * rh.height * sizeof( LevelTile ) );
+            return true;
+        }
+
+        ivec2 blocks = blockCount( index );
+        std::vector< LevelTile > tiles( BLOCK_SIZE * BLOCK_SIZE );
+
+        for ( int b = 0; b < blocks.x * blocks.y; ++b )
+        {
+            if ( !readBlock( index, b, tiles.data() ) )
+                return false;
+
+            ivec4 rect = blockRect( index, b );
+            for ( int y = 0; y < rect.w; ++y )
+                std::memcpy( pTiles + rect.x + (rect.y + y) * rh.width, &tiles[ y * rect.z ],
+                             rect.z * sizeof( LevelTile ) );
+        }
+        return true;
+    }
+
+    // Makes a dungeon of the rooms. Rooms of an uncompressed file borrow
+    // their tiles from the mapping, which stays mapped until the last of
+    // them has been changed or destroyed, so the file must not be written
+    // meanwhile; rooms of a compressed one are decompressed. Throws if a
+    // block is corrupt.
+    Dungeon load() const
+    {
+        std::vector< std::pair< Room, vec2 > > rooms;
+        rooms.reserve( roomCount() );
+
+        for ( int i = 0; i < roomCount(); ++i )
+        {
+            const RoomHeader& rh = room( i );
+            if ( const LevelTile* pTiles = tiles( i ) )
+            {
+                rooms.emplace_back( Room::borrow( rh.width, rh.height, pTiles, _file ), vec2( rh.x, rh.y ) );
+                continue;
+            }
+
+            Room room( rh.width, rh.height );
+            if ( !readRoom( i, room.data() ) )
+                throw "Corrupt dungeon file";
+            rooms.emplace_back( std::move( room ), vec2( rh.x, rh.y ) );
+        }
+
+        Dungeon dungeon;
+        dungeon.addRooms( std::move( rooms ) );
+        return dungeon;
+    }
+};
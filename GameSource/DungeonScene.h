@@ -15,6 +15,8 @@
 
 #include "Util.h"
 #include "Dungeon.h"
+#include "DungeonTiles.h"
+#include "EntityGrid.h"
 #include "random.h"
 #include "Astar.h"
 
@@ -79,20 +81,15 @@ class DungeonScene
     , protected RenderContext
     , protected InputReceiver
     , protected AudioEngine
+    , public DungeonTiles
     , protected DungeonComponentManager
 {
 public:
     
     static constexpr float RENDER_SCALE = 3;
-    static constexpr float TILE_SIZE = 16;
-    static constexpr float CORNER_SIZE = 4;
 
     static constexpr unsigned ENEMY_ACTION_DELAY = 200;
 
-    static constexpr LevelTile::Floor FLOOR_TILE = LevelTile::Floor::TILE3;
-    static constexpr LevelTile::Wall WALL_TILE = LevelTile::Wall::BRICK3;
-    static constexpr LevelTile::Pit PIT_TILE = LevelTile::Pit::WATER1;
-
     struct AI
     {
         DungeonScene& ds;
@@ -118,16 +115,13 @@ public:
 
 public:
 
-    Dungeon dungeon;
-    Eid     playerId;
+    Eid playerId;
 
 protected:
 
-    struct BlackSquare { vec2 pos; vec2 size; };
-    std::vector< BlackSquare > blackSquares;
-
-    struct FloorCorner { vec2 pos; vec2 off; };
-    std::vector< FloorCorner > floorCorners;
+    // Entities with a Position by the tile nearest to it. Kept up to date
+    // by positionChanged().
+    EntityGrid entityGrid;
 
     std::vector< PositionTween > posTweens;
 
@@ -149,6 +143,7 @@ public:
         attach( playerId, Stats {} );
         attach( playerId, Animation {} );
         attach( playerId, Action {} );
+        positionChanged( playerId );
     }
 
 protected:
@@ -165,25 +160,34 @@ protected:
             ? characters[ currCharacterIndex ] : -1;*/
     }
 
-    generator< Eid > entitiesOnTile( LevelTile* pTile )
+    // Returns the tile nearest to a position.
+    static ivec2 tileOf( Position pos )
     {
-        Position tilePos = glm::round( dungeon.tilePos( pTile ) );
+        return ivec2( glm::round( flip_y( pos ) / TILE_SIZE ) );
+    }
 
-#if _MSC_VER < 1911
-        for ( auto ntt : subset< Position >() ) {
-            auto eid = std::get< 0 >( ntt );
-            auto pos = std::get< 1 >( ntt );
-#else
-        for ( auto[ eid, pos ] : entities< Position >() ) {
-#endif
-            if ( round( pos ) == flip_y( tilePos * TILE_SIZE ) )
+    // Files an entity in entityGrid after its Position was attached or
+    // changed.
+    void positionChanged( Eid eid )
+    {
+        entityGrid.place( eid, tileOf( get< Position >( eid ) ) );
+    }
+
+    // Yields the entities standing on a tile; those moving onto or off it
+    // are not on it yet.
+    generator< Eid > entitiesOnTile( const TileState* pTile )
+    {
+        ivec2 cell( glm::round( dungeon.tilePos( pTile ) ) );
+        Position tilePos = flip_y( vec2( cell ) * TILE_SIZE );
+
+        for ( Eid eid : entityGrid.at( cell ) )
+            if ( round( get< Position >( eid ) ) == tilePos )
                 co_yield eid;
-        }
     }
 
-    ActionResult moveEntity( Eid eid, LevelTile* pTile )
+    ActionResult moveEntity( Eid eid, const TileState* pTile )
     {
-        if ( pTile == nullptr || pTile->tileType != Tile::FLOOR
+        if ( pTile == nullptr || dungeon.tileOf( *pTile ).type() != Tile::FLOOR
             || !hasAttached< Position >( eid ) )
             return false;
 
@@ -206,19 +210,19 @@ protected:
         auto sum = (playerPos + delta) / TILE_SIZE;
         changePlayerDir( delta );
 
-        if ( LevelTile* pTile = dungeon.findTile( sum.x, -sum.y ) )
+        if ( const TileState* pTile = dungeon.findState( sum.x, -sum.y ) )
         {
-            bool blockMove = pTile->tileType != Tile::FLOOR;
+            bool blockMove = dungeon.tileOf( *pTile ).type() != Tile::FLOOR;
 
-            invokeSystem( [&]( Eid eid, Position pos, Stats& stats )
+            for ( Eid eid : entitiesOnTile( pTile ) )
             {
-                if ( pos / TILE_SIZE == sum
-                    && (get< Stats >( playerId ).blocks & stats.blocks) != 0 )
+                if ( hasAttached< Stats >( eid )
+                    && (get< Stats >( playerId ).blocks & get< Stats >( eid ).blocks) != 0 )
                 {
                     blockMove = true;
                     basicAttack( playerId, eid );
                 }
-            } );
+            }
 
             if ( !blockMove )
             {
@@ -275,141 +279,6 @@ protected:
         #undef CHECK
     }
 
-    void initExtras()
-    {
-        blackSquares.clear();
-        floorCorners.clear();
-
-        dungeon.eachRoom( [&]( Room& room, vec2 rpos )
-        {
-            room.eachTile( [&]( LevelTile& tile, vec2 tpos )
-            {
-                vec2 pos = flip_y( rpos + tpos ) * TILE_SIZE;
-
-                switch ( tile.tileType )
-                {
-                case Tile::FLOOR :
-                {
-                    // Checks that a floor tile should draw a specific corner.
-                    #define CHECK_TILE( A, B ) \
-                    (!tile[ A##_##B ] && tile[ A ] && tile[ B ])
-
-                    static constexpr float CORNER_OFF = TILE_SIZE - CORNER_SIZE;
-                    vec2 off = vec2( tile.offset + ivec2( 4, 0 ) ) * TILE_SIZE;
-
-                    if ( CHECK_TILE( NORTH, EAST ) )
-                        floorCorners.push_back( {
-                            pos + vec2( 0, 0 ),
-                            off + vec2( CORNER_OFF, 0 )
-                    } );
-                    if ( CHECK_TILE( NORTH, WEST ) )
-                        floorCorners.push_back( {
-                            pos + vec2( CORNER_SIZE - TILE_SIZE, 0 ),
-                            off + vec2( 0, 0 )
-                    } );
-                    if ( CHECK_TILE( SOUTH, EAST ) )
-                        floorCorners.push_back( {
-                            pos + vec2( 0, CORNER_SIZE - TILE_SIZE ),
-                            off + vec2( CORNER_OFF )
-                    } );
-                    if ( CHECK_TILE( SOUTH, WEST ) )
-                        floorCorners.push_back( {
-                            pos + vec2( CORNER_SIZE - TILE_SIZE ),
-                            off + vec2( 0, CORNER_OFF )
-                    } );
-                    #undef CHECK_TILE
-                    break;
-                }
-                case Tile::WALL :
-                {
-                    float edgeOff = TILE_SIZE / 8;
-                    vec2 halfTile( TILE_SIZE * 0.5, TILE_SIZE - edgeOff );
-                    vec2 edgeTile( TILE_SIZE * 0.5, edgeOff );
-
-                    if ( tile[ SOUTH ] )
-                    {
-                        if ( tile[ EAST ] && tile[ SOUTH_EAST ] )
-                            blackSquares.push_back( {
-                                pos + vec2( 0, -edgeOff ),
-                                halfTile
-                        } );
-                        if ( tile[ WEST ] && tile[ SOUTH_WEST ] )
-                            blackSquares.push_back( {
-                                pos + vec2( -TILE_SIZE * 0.5, -edgeOff ),
-                                halfTile
-                        } );
-                    }
-                    if ( tile[ NORTH ] )
-                    {
-                        if ( tile[ EAST ] && tile[ NORTH_EAST ] )
-                            blackSquares.push_back( {
-                                pos + vec2( 0, 0 ),
-                                edgeTile
-                        } );
-                        if ( tile[ WEST ] && tile[ NORTH_WEST ] )
-                            blackSquares.push_back( {
-                                pos + vec2( -TILE_SIZE * 0.5, 0 ),
-                                edgeTile
-                        } );
-                    }
-                    break;
-                }
-                default:
-                    break;
-                }
-            } );
-        } );
-    }
-
-    void updateConnections()
-    {
-        dungeon.eachRoom( [&]( Room& room, vec2 rpos )
-        {
-            room.eachTile( [&]( LevelTile& tile, vec2 tpos )
-            {
-                ivec2 pos = rpos + tpos;
-                LevelTile nullTile( Tile::NONE );
-
-                #define TILE( X, Y ) \
-                    COALESCE_NULL( dungeon.findTile( X, Y ), nullTile )
-
-                RefArray< LevelTile, 8 > adjs
-                {
-                    TILE( pos.x - 1, pos.y + 0 ),
-                    TILE( pos.x + 0, pos.y + 1 ),
-                    TILE( pos.x + 1, pos.y + 0 ),
-                    TILE( pos.x + 0, pos.y - 1 ),
-                    TILE( pos.x - 1, pos.y - 1 ),
-                    TILE( pos.x + 1, pos.y - 1 ),
-                    TILE( pos.x + 1, pos.y + 1 ),
-                    TILE( pos.x - 1, pos.y + 1 ),
-                };
-
-                tile.updateConnections( adjs );
-                #undef TILE
-            } );
-        } );
-    }
-
-    void eliminateSingleWalls()
-    {
-        dungeon.eachRoom( [&]( Room& room, vec2 rpos )
-        {
-            room.eachTile( [&]( LevelTile& tile, vec2 tpos )
-            {
-                if ( tile.tileType == Tile::WALL )
-                    if ( tile.noneConnects( { NORTH, EAST, SOUTH, WEST } ) )
-                        tile = FLOOR_TILE;
-
-                //if ( tile.tileType == Tile::FLOOR )
-                //    if ( tile.noneConnects( { NORTH, EAST, SOUTH, WEST } ) )
-                //        tile = LevelTile::Wall::BRICK3;
-            } );
-        } );
-
-        updateConnections();
-    }
-
     void useTexture( TextureId texture )
     {
         useTextureUnit( texture );
@@ -419,23 +288,28 @@ protected:
     Eid spawnEnemy( Position pos, Stats stats, Texture tex, Behavior bhvr )
     {
         Eid eid = newEntity( pos, stats, tex, stats.maxHealth, bhvr );
+        positionChanged( eid );
         return eid;
     }
 
     Position randTilePos( Tile tile ) const
     {
-        ivec4 d = dungeon.rect();
-        int x, y;
-        const LevelTile* pTile;
-
-        do {
-            x = rand_int( d.x, d.z );
-            y = rand_int( d.y, d.w );
-            pTile = dungeon.findTile( x, y );
-        }
-        while ( !pTile || pTile->tileType != tile );
+        ivec2 cell;
+        if ( !tileIndex.randomCell( tile, cell ) )
+            throw "randTilePos: the dungeon has no tile of that type";
+
+        return Position { cell.x, -cell.y } * TILE_SIZE;
+    }
+
+    // Returns the position of a random floor tile which can be walked to
+    // from pos; or of any floor tile if pos is not on the floor.
+    Position randReachablePos( Position pos )
+    {
+        ivec2 cell;
+        if ( !tileIndex.randomReachable( tileOf( pos ), cell ) )
+            return randTilePos( Tile::FLOOR );
 
-        return Position { x, -y } * TILE_SIZE;
+        return Position { cell.x, -cell.y } * TILE_SIZE;
     }
 
 public:
@@ -477,14 +351,14 @@ public:
 
         for ( int x = 0; x < room.width() * 3; ++x )
         {
-            dungeon.getTile( x, 0 ) = WALL_TILE;
-            //dungeon.getTile( x, room.bottom() * 2 - 1 ) = WALL_TILE;
+            dungeon.setTile( x, 0, WALL_TILE );
+            //dungeon.setTile( x, room.bottom() * 2 - 1, WALL_TILE );
         }
 
         for ( int y = 0; y < room.height() * 2; ++y )
         {
-            dungeon.getTile( 0, y ) = WALL_TILE;
-            dungeon.getTile( room.width() * 3 - 1, y ) = WALL_TILE;
+            dungeon.setTile( 0, y, WALL_TILE );
+            dungeon.setTile( room.width() * 3 - 1, y, WALL_TILE );
         }
 
         updateConnections();
@@ -499,20 +373,22 @@ public:
             pos = randTilePos( Tile::FLOOR );
             tex = WARRIOR_TEX;
         } );
+        positionChanged( playerId );
 
         characters.push_back( playerId );
 
         static constexpr Stats ENEMY_STATS { 10, 3, 3, 2, Obstruction::GROUND };
+        Position playerPos = get< Position >( playerId );
 
         for ( int i = 0; i < 4; ++i )
             characters.push_back( spawnEnemy(
-                randTilePos( Tile::FLOOR ),
+                randReachablePos( playerPos ),
                 ENEMY_STATS, BEHOLDER_TEX,
                 WanderBehavior( rand_int( 3 ) )
                 ) );
 
         characters.push_back( spawnEnemy(
-            randTilePos( Tile::FLOOR ),
+            randReachablePos( playerPos ),
             ENEMY_STATS, SAURON_TEX,
             PathBehavior( playerId )
         ) );
@@ -652,7 +528,12 @@ private:
         remove_elements( characters, MEMFN( flag< IS_DEAD > ) );
         currCharacterIndex %= characters.size();
 
-        deleteEntities( MEMFN( flag< IS_DEAD > ) );
+        deleteEntities( [&]( Eid eid ) {
+            if ( !flag< IS_DEAD >( eid ) )
+                return false;
+            entityGrid.remove( eid );
+            return true;
+        } );
     }
 
 public:
@@ -670,7 +551,10 @@ public:
 
         // Perform tweens.
         for ( auto& tween : posTweens )
+        {
             tween( ticks, get< Position >( tween.eid ) );
+            positionChanged( tween.eid );
+        }
 
         deathSystem( ticks );
     }
@@ -684,32 +568,15 @@ public:
         useColor( { 1, 1, 1, 1 } );
 
         // Draw rooms.
-#if _MSC_VER >= 1911
-        for ( auto[ room, rpos ] : dungeon.enumerate() )
-        {
-            for ( auto[ tile, tpos ] : room.enumerate() )
-            {
-                useTexture( tile.getTexture() );
-                useSprite( tile.getSprite() );
-
-                vec2 pos = flip_y( rpos + (vec2) tpos ) * TILE_SIZE;
-                fillRect( pos, vec2( TILE_SIZE ) );
-            }
-        }
-#else
-        dungeon.eachRoom( [&]( Room& room, vec2 rpos )
+        std::as_const( dungeon ).eachTile(
+            [&]( const LevelTile& tile, const TileState& state, vec2 tpos )
         {
-            // Draw tiles.
-            room.eachTile( [&]( LevelTile& tile, vec2 tpos )
-            {
-                useTexture( tile.getTexture() );
-                useSprite( tile.getSprite() );
+            useTexture( tile.getTexture() );
+            useSprite( tile.getSprite( state.connections() ) );
 
-                vec2 pos = flip_y( rpos + tpos ) * TILE_SIZE;
-                fillRect( pos, vec2( TILE_SIZE ) );
-            } );
+            vec2 pos = flip_y( tpos ) * TILE_SIZE;
+            fillRect( pos, vec2( TILE_SIZE ) );
         } );
-#endif
 
         // Black out area between walls.
         {
@@ -846,10 +713,10 @@ inline Action DungeonScene::AI::operator ()( WanderBehavior& bhvr )
             vec2 delta = VECTORS[ bhvr.heading ];
             vec2 pos = std::get< 0 >( *ntt ) / TILE_SIZE + delta;
 
-            LevelTile* pTile = ds.dungeon.findTile( pos.x, -pos.y );
-            if ( pTile && pTile->tileType == Tile::FLOOR )
+            const LevelTile* pTile = ds.dungeon.findTile( pos.x, -pos.y );
+            if ( pTile && pTile->type() == Tile::FLOOR )
             {
-                ActionResult result = ds.moveEntity( eid, pTile );
+                ActionResult result = ds.moveEntity( eid, ds.dungeon.findState( pos.x, -pos.y ) );
 
                 if ( result.succeeded )
                     bhvr.delay.set( ENEMY_ACTION_DELAY, ticks );
@@ -889,8 +756,8 @@ inline Action DungeonScene::AI::operator ()( PathBehavior& bhvr )
                 vec2 tgtpos = ds.get< Position >( tgt ) / TILE_SIZE;
 
                 bhvr.path = find_path(
-                    ds.dungeon.getTile( pos.x, -pos.y ),
-                    ds.dungeon.getTile( tgtpos.x, -tgtpos.y ),
+                    ds.dungeon.getState( pos.x, -pos.y ),
+                    ds.dungeon.getState( tgtpos.x, -tgtpos.y ),
                     ds.dungeon.distanceEstimateFunc(),
                     ds.dungeon.tileCostFunc(),
                     ds.dungeon.neighborsFunc()
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Dungeon.h"
+
+#include <istream>
+#include <ostream>
+
+// Text dungeon format, which can be read and diffed: the number of rooms,
+// then for each room its position, its size and the type and texture
+// offset of each of its tiles, row by row.
+inline void save_dungeon_text( std::ostream& file, const Dungeon& dungeon )
+{
+    using std::endl;
+
+    file << dungeon.roomCount() << endl;
+
+    dungeon.eachRoom( [&]( const Room& room, vec2 pos )
+    {
+        file << pos.x << ' ' << pos.y << endl;
+        file << room.width() << ' ' << room.height() << endl;
+
+        room.eachTile( [&]( const LevelTile& tile, ivec2 )
+        {
+            ivec2 offset = tile.offset();
+            file << (int) tile.type() << ' '
+                << offset.x << ' '
+                << offset.y << ' ';
+        } );
+
+        file << endl;
+    } );
+}
+
+inline Dungeon load_dungeon_text( std::istream& file )
+{
+    int numRooms;
+    file >> numRooms;
+
+    Dungeon dungeon;
+
+    for ( int i = 0; i < numRooms; ++i )
+    {
+        vec2 pos;
+        file >> pos.x >> pos.y;
+
+        ivec2 size;
+        file >> size.x >> size.y;
+        Room room( size.x, size.y );
+
+        room.eachTile( [&]( LevelTile& tile, ivec2 )
+        {
+            Tile type;
+            ivec2 off;
+            file >> (int&) type >> off.x >> off.y;
+
+            tile = LevelTile( type, off );
+        } );
+
+        dungeon.addRoom( move( room ), pos );
+    }
+
+    return dungeon;
+}
@@ -0,0 +1,314 @@
+#pragma once
+
+#include "Util.h"
+#include "Dungeon.h"
+#include "TileBitboard.h"
+#include "TileIndex.h"
+
+#include <vector>
+
+// A dungeon and what is worked out from its tiles: their connections, the
+// extras (black squares and floor corners) drawn over them and the index
+// of their types. Holds no rendering state, so DungeonScene draws it and
+// the bookkeeping can be tested without a window.
+class DungeonTiles
+{
+public:
+
+    static constexpr float TILE_SIZE = 16;
+    static constexpr float CORNER_SIZE = 4;
+
+    static constexpr LevelTile::Floor FLOOR_TILE = LevelTile::Floor::TILE3;
+    static constexpr LevelTile::Wall WALL_TILE = LevelTile::Wall::BRICK3;
+    static constexpr LevelTile::Pit PIT_TILE = LevelTile::Pit::WATER1;
+
+    Dungeon dungeon;
+
+    // Extras are drawn at the position of the tile which produced them and
+    // remember its cell (see Dungeon::tileCell) so that they can be rebuilt
+    // for part of the dungeon.
+    struct BlackSquare { vec2 pos; vec2 size; ivec2 tile; };
+    std::vector< BlackSquare > blackSquares;
+
+    struct FloorCorner { vec2 pos; vec2 off; ivec2 tile; };
+    std::vector< FloorCorner > floorCorners;
+
+    // Cells changed since the last updateDirtyTiles(), as inclusive
+    // { x0, y0, x1, y1 }. Empty while x0 > x1.
+    ivec4 dirtyTiles { 0, 0, -1, -1 };
+
+    // Tiles and connections as of the last updateConnections().
+    TileBitboard tileBoard;
+
+    // Tile positions by type and floor regions, for placing things.
+    TileIndex tileIndex;
+
+    void initExtras()
+    {
+        blackSquares.clear();
+        floorCorners.clear();
+
+        // Only visit the tiles whose connections call for an extra.
+        const TileBitboard& board = tileBoard;
+        for ( int row = board.firstRow(); row <= board.lastRow(); ++row )
+        {
+            for ( int w = 0; w < board.rowWords(); ++w )
+            {
+                #define CONN( DIR ) board.connections( DIR, row, w )
+                auto n = CONN( NORTH ), e = CONN( EAST ), s = CONN( SOUTH ), wst = CONN( WEST );
+                auto ne = CONN( NORTH_EAST ), nw = CONN( NORTH_WEST );
+                auto se = CONN( SOUTH_EAST ), sw = CONN( SOUTH_WEST );
+                #undef CONN
+
+                auto corners = board.tiles( Tile::FLOOR, row, w )
+                    & ((n & e & ~ne) | (n & wst & ~nw) | (s & e & ~se) | (s & wst & ~sw));
+                auto squares = board.tiles( Tile::WALL, row, w )
+                    & ((s & ((e & se) | (wst & sw))) | (n & ((e & ne) | (wst & nw))));
+
+                board.eachBit( corners | squares, row, w, [&]( ivec2 cell )
+                {
+                    const TileState& state = dungeon.getState( cell.x, cell.y );
+                    addExtras( dungeon.getTile( cell.x, cell.y ), state, dungeon.tilePos( &state ) );
+                } );
+            }
+        }
+
+        eachHiddenTile( [&]( const LevelTile& tile, TileState& state, vec2 pos )
+        {
+            addExtras( tile, state, pos );
+        } );
+    }
+
+    // Calls func( tile, state, pos ) for every room tile hidden under
+    // another room, which the bitboards do not see.
+    template< typename Func >
+    void eachHiddenTile( Func&& func )
+    {
+        if ( dungeon.hiddenTileCount() == 0 )
+            return;
+
+        dungeon.eachTile( [&]( const LevelTile& tile, TileState& state, vec2 tpos )
+        {
+            ivec2 cell = Dungeon::tileCell( tpos );
+            if ( dungeon.findState( cell.x, cell.y ) != &state )
+                func( tile, state, tpos );
+        } );
+    }
+
+    // Rebuilds the extras of the tiles in area, given as inclusive
+    // { x0, y0, x1, y1 }.
+    void updateExtras( ivec4 area )
+    {
+        auto inArea = [&]( ivec2 cell ) {
+            return cell.x >= area.x && cell.x <= area.z
+                && cell.y >= area.y && cell.y <= area.w;
+        };
+
+        remove_elements( blackSquares, [&]( const BlackSquare& sq ) { return inArea( sq.tile ); } );
+        remove_elements( floorCorners, [&]( const FloorCorner& fc ) { return inArea( fc.tile ); } );
+
+        dungeon.eachTileIn( area, [&]( const LevelTile& tile, TileState& state, vec2 tpos )
+        {
+            addExtras( tile, state, tpos );
+        } );
+    }
+
+    // Adds the black squares and floor corners drawn for a tile at tpos.
+    void addExtras( const LevelTile& tile, const TileState& state, vec2 tpos )
+    {
+        ivec2 cell = Dungeon::tileCell( tpos );
+        vec2 pos = flip_y( tpos ) * TILE_SIZE;
+
+        switch ( tile.type() )
+        {
+        case Tile::FLOOR :
+        {
+            // Checks that a floor tile should draw a specific corner.
+            #define CHECK_TILE( A, B ) \
+            (!state[ A##_##B ] && state[ A ] && state[ B ])
+
+            static constexpr float CORNER_OFF = TILE_SIZE - CORNER_SIZE;
+            vec2 off = vec2( tile.offset() + ivec2( 4, 0 ) ) * TILE_SIZE;
+
+            if ( CHECK_TILE( NORTH, EAST ) )
+                floorCorners.push_back( {
+                    pos + vec2( 0, 0 ),
+                    off + vec2( CORNER_OFF, 0 ),
+                    cell
+            } );
+            if ( CHECK_TILE( NORTH, WEST ) )
+                floorCorners.push_back( {
+                    pos + vec2( CORNER_SIZE - TILE_SIZE, 0 ),
+                    off + vec2( 0, 0 ),
+                    cell
+            } );
+            if ( CHECK_TILE( SOUTH, EAST ) )
+                floorCorners.push_back( {
+                    pos + vec2( 0, CORNER_SIZE - TILE_SIZE ),
+                    off + vec2( CORNER_OFF ),
+                    cell
+            } );
+            if ( CHECK_TILE( SOUTH, WEST ) )
+                floorCorners.push_back( {
+                    pos + vec2( CORNER_SIZE - TILE_SIZE ),
+                    off + vec2( 0, CORNER_OFF ),
+                    cell
+            } );
+            #undef CHECK_TILE
+            break;
+        }
+        case Tile::WALL :
+        {
+            float edgeOff = TILE_SIZE / 8;
+            vec2 halfTile( TILE_SIZE * 0.5, TILE_SIZE - edgeOff );
+            vec2 edgeTile( TILE_SIZE * 0.5, edgeOff );
+
+            if ( state[ SOUTH ] )
+            {
+                if ( state[ EAST ] && state[ SOUTH_EAST ] )
+                    blackSquares.push_back( {
+                        pos + vec2( 0, -edgeOff ),
+                        halfTile,
+                        cell
+                } );
+                if ( state[ WEST ] && state[ SOUTH_WEST ] )
+                    blackSquares.push_back( {
+                        pos + vec2( -TILE_SIZE * 0.5, -edgeOff ),
+                        halfTile,
+                        cell
+                } );
+            }
+            if ( state[ NORTH ] )
+            {
+                if ( state[ EAST ] && state[ NORTH_EAST ] )
+                    blackSquares.push_back( {
+                        pos + vec2( 0, 0 ),
+                        edgeTile,
+                        cell
+                } );
+                if ( state[ WEST ] && state[ NORTH_WEST ] )
+                    blackSquares.push_back( {
+                        pos + vec2( -TILE_SIZE * 0.5, 0 ),
+                        edgeTile,
+                        cell
+                } );
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void updateConnections()
+    {
+        tileBoard = TileBitboard( dungeon );
+        tileBoard.applyConnections( dungeon );
+        tileIndex.assign( dungeon );
+
+        eachHiddenTile( [&]( const LevelTile& tile, TileState& state, vec2 tpos )
+        {
+            updateConnections( tile, state, Dungeon::tileCell( tpos ) );
+        } );
+    }
+
+    // Relinks the tiles in area, given as inclusive { x0, y0, x1, y1 }.
+    void updateConnections( ivec4 area )
+    {
+        dungeon.eachTileIn( area, [&]( const LevelTile& tile, TileState& state, vec2 tpos )
+        {
+            updateConnections( tile, state, Dungeon::tileCell( tpos ) );
+        } );
+    }
+
+    // Links a tile in cell pos to the tiles findTile finds around it.
+    void updateConnections( const LevelTile& tile, TileState& state, ivec2 pos )
+    {
+        static const LevelTile nullTile( Tile::NONE );
+
+        #define TILE( X, Y ) \
+            COALESCE_NULL( dungeon.findTile( X, Y ), nullTile )
+
+        RefArray< const LevelTile, 8 > adjs
+        {
+            TILE( pos.x - 1, pos.y + 0 ),
+            TILE( pos.x + 0, pos.y + 1 ),
+            TILE( pos.x + 1, pos.y + 0 ),
+            TILE( pos.x + 0, pos.y - 1 ),
+            TILE( pos.x - 1, pos.y - 1 ),
+            TILE( pos.x + 1, pos.y - 1 ),
+            TILE( pos.x + 1, pos.y + 1 ),
+            TILE( pos.x - 1, pos.y + 1 ),
+        };
+
+        state.updateConnections( tile, adjs );
+        #undef TILE
+    }
+
+    // Records that the tile at cell has changed.
+    void markDirty( ivec2 cell )
+    {
+        if ( dirtyTiles.x > dirtyTiles.z )
+        {
+            dirtyTiles = ivec4( cell, cell );
+        }
+        else
+        {
+            dirtyTiles.x = std::min( dirtyTiles.x, cell.x );
+            dirtyTiles.y = std::min( dirtyTiles.y, cell.y );
+            dirtyTiles.z = std::max( dirtyTiles.z, cell.x );
+            dirtyTiles.w = std::max( dirtyTiles.w, cell.y );
+        }
+    }
+
+    // Relinks and rebuilds the extras of the changed tiles and their
+    // neighbours, which gives the same result as updateConnections()
+    // followed by initExtras().
+    void updateDirtyTiles()
+    {
+        if ( dirtyTiles.x > dirtyTiles.z )
+            return;
+
+        for ( int y = dirtyTiles.y; y <= dirtyTiles.w; ++y )
+            for ( int x = dirtyTiles.x; x <= dirtyTiles.z; ++x )
+                if ( const LevelTile* pTile = dungeon.findTile( x, y ) )
+                    tileIndex.set( { x, y }, pTile->type() );
+
+        ivec4 area = dirtyTiles + ivec4( -1, -1, 1, 1 );
+        updateConnections( area );
+        updateExtras( area );
+        dirtyTiles = { 0, 0, -1, -1 };
+    }
+
+    void eliminateSingleWalls()
+    {
+        eachHiddenTile( [&]( const LevelTile& tile, TileState& state, vec2 )
+        {
+            if ( tile.type() == Tile::WALL )
+                if ( state.noneConnects( { NORTH, EAST, SOUTH, WEST } ) )
+                    dungeon.setTile( state, FLOOR_TILE );
+        } );
+
+        const TileBitboard& board = tileBoard;
+        for ( int row = board.firstRow(); row <= board.lastRow(); ++row )
+        {
+            for ( int w = 0; w < board.rowWords(); ++w )
+            {
+                auto single = board.tiles( Tile::WALL, row, w )
+                    & ~(board.connections( NORTH, row, w ) | board.connections( EAST, row, w )
+                        | board.connections( SOUTH, row, w ) | board.connections( WEST, row, w ));
+
+                board.eachBit( single, row, w, [&]( ivec2 cell )
+                {
+                    dungeon.setTile( cell.x, cell.y, FLOOR_TILE );
+                } );
+            }
+        }
+
+        //if ( tile.type() == Tile::FLOOR )
+        //    if ( tile.noneConnects( { NORTH, EAST, SOUTH, WEST } ) )
+        //        tile = LevelTile::Wall::BRICK3;
+
+        updateConnections();
+    }
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "Dungeon.h"
+#include "StatsAllocator.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Entities filed by the tile cell they stand on, in a hash of cells so the
+// grid has no bounds. Ids are small non-negative integers (an Eid or an
+// entity index) and each is in at most one cell. Whoever moves an entity
+// must place() it again; the grid does not watch components itself.
+// Looking up a cell is one hash probe, and the rect and radius queries visit
+// whichever is fewer of the cells they cover and the occupied cells, so they
+// cost about the size of their result rather than the number of entities.
+class EntityGrid
+{
+public:
+
+    // Memory of the grid is counted as ECS memory.
+    template< typename T >
+    using Alloc = StatsStdAllocator< T, AllocTag::Ecs >;
+
+    using IdList = std::vector< int, Alloc< int > >;
+
+private:
+
+    using CellMap = std::unordered_map< uint64_t, IdList, std::hash< uint64_t >, std::equal_to< uint64_t >,
+                                        Alloc< std::pair< const uint64_t, IdList > > >;
+
+    CellMap _cells; // Ids in each occupied cell.
+    std::vector< ivec2, Alloc< ivec2 > > _cellOf; // Cell of each id.
+    std::vector< int, Alloc< int > > _slots;      // Index of each id in its cell; -1 if absent.
+    int _count = 0;
+
+    static uint64_t _key( ivec2 cell )
+    {
+        return uint64_t( uint32_t( cell.x ) ) | uint64_t( uint32_t( cell.y ) ) << 32;
+    }
+
+    static ivec2 _cell( uint64_t key )
+    {
+        return ivec2( int32_t( uint32_t( key ) ), int32_t( uint32_t( key >> 32 ) ) );
+    }
+
+    // Calls func( id, cell ) for the ids in cells of rect which pass keep( cell ).
+    template< typename Keep, typename Func >
+    void _eachIn( ivec4 rect, Keep&& keep, Func&& func ) const
+    {
+        if ( rect.z <= 0 || rect.w <= 0 )
+            return;
+
+        // A big rect over a sparse grid is cheaper to answer from the cells.
+        if ( int64_t( rect.z ) * rect.w > int64_t( _cells.size() ) )
+        {
+            for ( auto& [ key, ids ] : _cells )
+            {
+                ivec2 cell = _cell( key );
+                if ( cell.x >= rect.x && cell.x < rect.x + rect.z
+                    && cell.y >= rect.y && cell.y < rect.y + rect.w
+                    && keep( cell ) )
+                    for ( int id : ids )
+                        func( id, cell );
+            }
+            return;
+        }
+
+        for ( int y = rect.y; y < rect.y + rect.w; ++y )
+        {
+            for ( int x = rect.x; x < rect.x + rect.z; ++x )
+            {
+                auto it = _cells.find( _key( { x, y } ) );
+                if ( it != _cells.end() && keep( ivec2( x, y ) ) )
+                    for ( int id : it->second )
+                        func( id, ivec2( x, y ) );
+            }
+        }
+    }
+
+public:
+
+    // Files id under cell, moving it if it is already in the grid.
+    void place( int id, ivec2 cell )
+    {
+        if ( id >= (int) _slots.size() )
+        {
+            _slots.resize( id + 1, -1 );
+            _cellOf.resize( id + 1 );
+        }
+
+        if ( _slots[ id ] >= 0 )
+        {
+            if ( _cellOf[ id ] == cell )
+                return;
+            remove( id );
+        }
+
+        auto& ids = _cells[ _key( cell ) ];
+        _slots[ id ] = (int) ids.size();
+        _cellOf[ id ] = cell;
+        ids.push_back( id );
+        ++_count;
+    }
+
+    // Takes id out of the grid. Ids not in the grid are ignored.
+    void remove( int id )
+    {
+        if ( !contains( id ) )
+            return;
+
+        auto it = _cells.find( _key( _cellOf[ id ] ) );
+        auto& ids = it->second;
+
+        // Swap the last id of the cell into the hole.
+        int last = ids.back();
+        ids[ _slots[ id ] ] = last;
+        _slots[ last ] = _slots[ id ];
+        ids.pop_back();
+        _slots[ id ] = -1;
+        --_count;
+
+        if ( ids.empty() )
+            _cells.erase( it );
+    }
+
+    // Empties the grid.
+    void clear()
+    {
+        _cells.clear();
+        _cellOf.clear();
+        _slots.clear();
+        _count = 0;
+    }
+
+    bool contains( int id ) const
+    {
+        return id >= 0 && id < (int) _slots.size() && _slots[ id ] >= 0;
+    }
+
+    // Returns the cell id was last placed in. id must be in the grid.
+    ivec2 cellOf( int id ) const
+    {
+        return _cellOf[ id ];
+    }
+
+    // Returns the number of ids in the grid.
+    int size() const
+    {
+        return _count;
+    }
+
+    // Returns the ids in cell, in no particular order. The list is
+    // invalidated by the next place() or remove().
+    const IdList& at( ivec2 cell ) const
+    {
+        static const IdList EMPTY;
+        auto it = _cells.find( _key( cell ) );
+        return it != _cells.end() ? it->second : EMPTY;
+    }
+
+    // Calls func( id, cell ) for every id in rect, given as { x, y, w, h }.
+    // func must not place() or remove().
+    template< typename Func >
+    void eachInRect( ivec4 rect, Func&& func ) const
+    {
+        _eachIn( rect, []( ivec2 ) { return true; }, func );
+    }
+
+    // Calls func( id, cell ) for every id in a cell no further than radius
+    // cells from center. func must not place() or remove().
+    template< typename Func >
+    void eachInRadius( vec2 center, float radius, Func&& func ) const
+    {
+        if ( radius < 0 )
+            return;
+
+        ivec2 lo = ivec2( glm::floor( center - radius ) );
+        ivec2 hi = ivec2( glm::ceil( center + radius ) );
+
+        _eachIn( ivec4( lo, hi - lo + 1 ), [&]( ivec2 cell )
+        {
+            vec2 d = vec2( cell ) - center;
+            return glm::dot( d, d ) <= radius * radius;
+        }, func );
+    }
+
+    // Appends the ids in rect to out and returns how many there were.
+    int inRect( ivec4 rect, std::vector< int >& out ) const
+    {
+        size_t size = out.size();
+        eachInRect( rect, [&]( int id, ivec2 ) { out.push_back( id ); } );
+        return int( out.size() - size );
+    }
+
+    // Appends the ids within radius cells of center to out and returns how
+    // many there were.
+    int inRadius( vec2 center, float radius, std::vector< int >& out ) const
+    {
+        size_t size = out.size();
+        eachInRadius( center, radius, [&]( int id, ivec2 ) { out.push_back( id ); } );
+        return int( out.size() - size );
+    }
+};
@@ -14,6 +14,8 @@
 
 #include "Rubiks.h"
 #include "LevelFacelet.h"
+#include "TileIndex.h"
+#include "EntityGrid.h"
 
 #include <glm/gtx/transform.hpp>
 #include <vector>
@@ -111,10 +113,6 @@ public:
 
     PlayerView playerEntity { "player", this };
 
-private:
-
-    bool _dirtyTiles;
-
 public:
 
     static constexpr int FACELET_W = 7;
@@ -138,6 +136,23 @@ public:
 
     std::array< std::array< LevelFace, FACELET_Y >, FACELET_X > facelets;
 
+private:
+
+    // Facelets whose tile textures need to be relinked, indexed x * FACELET_Y + y.
+    std::bitset< FACELET_X * FACELET_Y > _dirtyFaces;
+
+    // Tile positions by type and floor regions, in findTile coordinates.
+    TileIndex _tileIndex;
+
+    // Collectibles by the tile they lie on, so the pickup only looks at
+    // the ones under the player.
+    EntityGrid _itemGrid;
+
+    // Id of each collectible in _itemGrid, by entity index.
+    std::vector< EntityId > _itemIds;
+
+public:
+
     LevelScene( SDL_Window* pWindow )
         : Scene( pWindow )
 
@@ -147,6 +162,10 @@ public:
         , uTexture( glGetUniformLocation( programId, "uTexture" ) )
         , uColor( glGetUniformLocation( programId, "uColor" ) )
     {
+        _tileIndex.reset( { 0, 0, TILE_COL_COUNT, TILE_ROW_COUNT } );
+        for ( int x = 0; x < FACELET_X; ++x )
+            for ( int y = 0; y < FACELET_Y; ++y )
+                indexFace( x, y );
     }
 
     static glm::vec2 random_position()
@@ -159,11 +178,11 @@ public:
 
     glm::vec2 randomPos( Tile mustBe )
     {
-        glm::vec2 pos;
-        do {
-            pos = random_position();
-        } while ( getTile( pos ) != mustBe );
-        return pos;
+        ivec2 cell;
+        if ( !_tileIndex.randomCell( mustBe, cell ) )
+            throw "randomPos: the level has no tile of that type";
+
+        return glm::vec2( cell - ivec2( TILE_OFF_X, TILE_OFF_Y ) );
     }
 
     void init( unsigned ticks ) override
@@ -232,16 +251,24 @@ public:
             Drawable&& id = Drawable::make_rect( 1, 1 );
             id.texture = 7;
 
+            glm::vec2 itemPos = randomPos( Tile::FLOOR );
+
             attach( item, move( id ) );
-            attach( item, randomPos( Tile::FLOOR ) );
+            attach( item, itemPos );
             attach( item, SpriteInfo( 4, 3, 8, 22 ) );
             attach( item, Collectible {
                 [&]( Entity& ntt, glm::vec2 pos ) {
                     printf( "Collected!\n" );
                     playSound( "Audio/item_pickup_1.wav", { pos.x, 0, 0 } );
+                    _itemGrid.remove( ntt.index );
                     deleteEntity( getId( ntt ) );
                 }
             } );
+            _itemGrid.place( item.index, ivec2( itemPos ) );
+
+            if ( item.index >= (int) _itemIds.size() )
+                _itemIds.resize( item.index + 1 );
+            _itemIds[ item.index ] = getId( item );
         }
 
         for ( int x = 0; x < FACELET_X; ++x )
@@ -296,6 +323,74 @@ protected:
                 face.updateAdj();
     }
 
+    // Marks a facelet as needing its textures relinked.
+    void markFaceDirty( int x, int y )
+    {
+        if ( x >= 0 && x < FACELET_X && y >= 0 && y < FACELET_Y )
+            _dirtyFaces.set( x * FACELET_Y + y );
+    }
+
+    // Marks a facelet and its neighbours, whose edge tiles link to it.
+    void markFaceAndAdjDirty( int x, int y )
+    {
+        markFaceDirty( x, y );
+        markFaceDirty( x - 1, y );
+        markFaceDirty( x + 1, y );
+        markFaceDirty( x, y - 1 );
+        markFaceDirty( x, y + 1 );
+    }
+
+    void markFaceAndAdjDirty( const LevelFace& face )
+    {
+        int i = int( &face - &facelets[ 0 ][ 0 ] );
+        markFaceAndAdjDirty( i / FACELET_Y, i % FACELET_Y );
+    }
+
+    // Relinks the faces and updates the textures of the dirty facelets.
+    void updateDirtyFaces()
+    {
+        if ( _dirtyFaces.none() )
+            return;
+
+        linkFaces();
+        for ( int x = 0; x < FACELET_X; ++x )
+            for ( int y = 0; y < FACELET_Y; ++y )
+                if ( _dirtyFaces.test( x * FACELET_Y + y ) )
+                    facelets[ x ][ y ].updateAdj();
+
+        _dirtyFaces.reset();
+    }
+
+    // Records the tiles of a facelet in the tile index.
+    void indexFace( int x, int y )
+    {
+        facelets[ x ][ y ].eachTile( [&]( Tile tile, SmartTexture&, int tx, int ty )
+        {
+            _tileIndex.set( { x * FACELET_W + tx, y * FACELET_H + ty }, tile );
+        } );
+    }
+
+    void indexFace( const LevelFace& face )
+    {
+        int i = int( &face - &facelets[ 0 ][ 0 ] );
+        indexFace( i / FACELET_Y, i % FACELET_Y );
+    }
+
+    // Cycles the contents of the facelets and marks them dirty.
+    template< typename... Faces >
+    void rotateFaces( Faces&... faces )
+    {
+        rotate( faces... );
+        auto _ = { (markFaceAndAdjDirty( faces ), indexFace( faces ), 0)..., 0 };
+    }
+
+    template< typename... Faces >
+    void unrotateFaces( Faces&... faces )
+    {
+        unrotate( faces... );
+        auto _ = { (markFaceAndAdjDirty( faces ), indexFace( faces ), 0)..., 0 };
+    }
+
 public:
 
     LevelCoord levelCoords( int x, int y )
@@ -344,8 +439,23 @@ public:
     {
         if ( Tile* pTile = findTile( x, y ) )
         {
-            _dirtyTiles = *pTile != type;
+            if ( *pTile == type )
+                return;
+
             *pTile = type;
+            _tileIndex.set( { x, y }, type );
+
+            // Tiles on the edge of a facelet also link to its neighbours.
+            LevelCoord coord = levelCoords( x, y );
+            markFaceDirty( coord.face.x, coord.face.y );
+            if ( coord.tile.x == 0 )
+                markFaceDirty( coord.face.x - 1, coord.face.y );
+            if ( coord.tile.x == FACELET_W - 1 )
+                markFaceDirty( coord.face.x + 1, coord.face.y );
+            if ( coord.tile.y == 0 )
+                markFaceDirty( coord.face.x, coord.face.y - 1 );
+            if ( coord.tile.y == FACELET_H - 1 )
+                markFaceDirty( coord.face.x, coord.face.y + 1 );
         }
     }
 
@@ -389,11 +499,15 @@ public:
         {
             auto playerPos = get< glm::vec2 >( *player );
 
-            invokeSystem(
-                [&]( Entity& ntt, glm::vec2 pos, Collectible& item ) {
-                    if ( pos == playerPos )
-                        item.onCollect( ntt, pos );
-                } );
+            // Copied, as onCollect takes the item out of the grid.
+            EntityGrid::IdList items = _itemGrid.at( ivec2( playerPos ) );
+            for ( int index : items )
+            {
+                Entity& ntt = getEntity( _itemIds[ index ] );
+                glm::vec2 pos = get< glm::vec2 >( ntt );
+                if ( pos == playerPos )
+                    get< Collectible >( ntt ).onCollect( ntt, pos );
+            }
         }
 
         // @Verbose. This should be much nicer.
@@ -454,12 +568,7 @@ public:
             }
         }
 
-        if ( _dirtyTiles )
-        {
-            linkFaces();
-            updateTileTextures();
-            _dirtyTiles = false;
-        }
+        updateDirtyFaces();
     }
 
     void draw() override
@@ -574,32 +683,29 @@ public:
 
         if ( wasKeyPressed( SDLK_1 ) )
         {
-            rotate(
+            rotateFaces(
                 facelets[ 0 ][ 0 ],
                 facelets[ 1 ][ 1 ],
                 facelets[ 2 ][ 2 ] );
-            _dirtyTiles = true;
         }
         if ( wasKeyPressed( SDLK_2 ) )
         {
-            unrotate(
+            unrotateFaces(
                 facelets[ 2 ][ 0 ],
                 facelets[ 1 ][ 1 ],
                 facelets[ 0 ][ 2 ] );
-            _dirtyTiles = true;
         }
         if ( wasKeyPressed( SDLK_3 ) )
         {
-            rotate(
+            rotateFaces(
                 facelets[ 1 ][ 0 ],
                 facelets[ 2 ][ 1 ],
                 facelets[ 1 ][ 2 ],
                 facelets[ 0 ][ 1 ] );
-            _dirtyTiles = true;
         }
         if ( wasKeyPressed( SDLK_4 ) )
         {
-            rotate(
+            rotateFaces(
                 facelets[ 0 ][ 0 ],
                 facelets[ 1 ][ 0 ],
                 facelets[ 2 ][ 0 ],
@@ -608,23 +714,20 @@ public:
                 facelets[ 1 ][ 2 ],
                 facelets[ 0 ][ 2 ],
                 facelets[ 0 ][ 1 ] );
-            _dirtyTiles = true;
         }
         if ( wasKeyPressed( SDLK_5 ) )
         {
-            rotate(
+            rotateFaces(
                 facelets[ 1 ][ 0 ],
                 facelets[ 1 ][ 1 ],
                 facelets[ 1 ][ 2 ] );
-            _dirtyTiles = true;
         }
         if ( wasKeyPressed( SDLK_6 ) )
         {
-            rotate(
+            rotateFaces(
                 facelets[ 0 ][ 1 ],
                 facelets[ 1 ][ 1 ],
                 facelets[ 2 ][ 1 ] );
-            _dirtyTiles = true;
         }
 
         if ( requiresRemap )
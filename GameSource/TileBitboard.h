@@ -0,0 +1,234 @@
+#pragma once
+
+#include "Dungeon.h"
+#include "Bits.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Occupancy of a rectangle of tiles stored as bitboards: one bit per cell,
+// 64 cells per word, one row of words per row of tiles and one plane per
+// tile type. The connection bits of every cell (as LevelTile::shouldConnect
+// would compute them for the tile occupying it) are derived a whole word at
+// a time with shifts and ANDs, so a 1024x1024 map takes a few milliseconds.
+// Cells outside the rectangle count as Tile::NONE.
+class TileBitboard
+{
+public:
+
+    using Word = uint64_t;
+
+    static constexpr int BITS_PER_WORD = 64;
+    static constexpr int TYPE_COUNT = 4; // Tile::NONE to Tile::PIT.
+
+private:
+
+    ivec2 _origin { 0, 0 }; // Cell at bit 1 of row 1; row and column 0 are padding.
+    ivec2 _size { 0, 0 };   // Size of the rectangle in cells.
+    int   _rowWords = 0;    // Words per padded row.
+
+    // Planes of (_size.y + 2) rows. One per tile type, then one per
+    // AdjDirection holding the connection bits.
+    std::vector< Word > _types[ TYPE_COUNT ];
+    std::vector< Word > _connections[ 8 ];
+
+    size_t _index( int x, int y ) const
+    {
+        return size_t( y ) * _rowWords + x / BITS_PER_WORD;
+    }
+
+    // Returns word w of the row of plane shifted so that bit i holds the
+    // cell dx columns to the right of cell i.
+    Word _shifted( const std::vector< Word >& plane, int row, int w, int dx ) const
+    {
+        const Word* pRow = &plane[ size_t( row ) * _rowWords ];
+        switch ( dx )
+        {
+        case -1:
+            return (pRow[ w ] << 1) | (w > 0 ? pRow[ w - 1 ] >> 63 : 0);
+        case 1:
+            return (pRow[ w ] >> 1) | (w + 1 < _rowWords ? pRow[ w + 1 ] << 63 : 0);
+        default:
+            return pRow[ w ];
+        }
+    }
+
+    // Fills in the connection planes from the type planes.
+    void _connect()
+    {
+        // Neighbour offsets in AdjDirection order.
+        static constexpr int DX[ 8 ] { -1, 0, 1, 0, -1, 1, 1, -1 };
+        static constexpr int DY[ 8 ] { 0, 1, 0, -1, -1, -1, 1, 1 };
+
+        const auto& none = _types[ (int) Tile::NONE ];
+        const auto& floor = _types[ (int) Tile::FLOOR ];
+
+        for ( auto& plane : _connections )
+            plane.assign( _types[ 0 ].size(), 0 );
+
+        for ( int row = 1; row <= _size.y; ++row )
+        {
+            for ( int w = 0; w < _rowWords; ++w )
+            {
+                size_t i = size_t( row ) * _rowWords + w;
+
+                for ( int dir = 0; dir < 8; ++dir )
+                {
+                    // A tile connects to a neighbour of the same type, and
+                    // anything but a floor also connects to nothing.
+                    Word same = 0;
+                    for ( int type = 0; type < TYPE_COUNT; ++type )
+                        same |= _types[ type ][ i ] & _shifted( _types[ type ], row + DY[ dir ], w, DX[ dir ] );
+
+                    Word open = ~floor[ i ] & _shifted( none, row + DY[ dir ], w, DX[ dir ] );
+                    _connections[ dir ][ i ] = same | open;
+                }
+            }
+        }
+    }
+
+public:
+
+    // Creates an empty bitboard.
+    TileBitboard() = default;
+
+    // Records the tile found at every cell of the dungeon's index and
+    // computes the connections.
+    explicit TileBitboard( const Dungeon& dungeon )
+    {
+        ivec4 rect = dungeon.indexRect();
+        _origin = ivec2( rect.x, rect.y ) - 1;
+        _size = ivec2( rect.z, rect.w );
+        _rowWords = (_size.x + 2 + BITS_PER_WORD - 1) / BITS_PER_WORD;
+
+        for ( auto& plane : _types )
+            plane.assign( size_t( _size.y + 2 ) * _rowWords, 0 );
+
+        auto& none = _types[ (int) Tile::NONE ];
+        for ( Word& word : none )
+            word = ~Word( 0 );
+
+        dungeon.eachTileRun(
+            [&]( int x, int y, const LevelTile* pTiles, const TileState*, int count )
+        {
+            x -= _origin.x;
+            y -= _origin.y;
+            for ( int i = 0; i < count; ++i, ++x )
+            {
+                Word bit = Word( 1 ) << (x % BITS_PER_WORD);
+                size_t idx = _index( x, y );
+                none[ idx ] &= ~bit;
+                _types[ (int) pTiles[ i ].type() ][ idx ] |= bit;
+            }
+        } );
+
+        _connect();
+    }
+
+    // Returns the number of words in each row.
+    int rowWords() const
+    {
+        return _rowWords;
+    }
+
+    // Returns the range of rows holding cells, as [first, last].
+    int firstRow() const { return 1; }
+    int lastRow() const { return _size.y; }
+
+    // Returns the cell held by bit of word w of row.
+    ivec2 cell( int row, int w, int bit ) const
+    {
+        return _origin + ivec2( w * BITS_PER_WORD + bit, row );
+    }
+
+    // Returns word w of row of the plane of tiles of type.
+    Word tiles( Tile type, int row, int w ) const
+    {
+        Word word = _types[ (int) type ][ _index( w * BITS_PER_WORD, row ) ];
+
+        // Keep the padding out of the result.
+        if ( w == 0 )
+            word &= ~Word( 1 );
+        int end = _size.x + 1 - w * BITS_PER_WORD;
+        if ( end < BITS_PER_WORD )
+            word &= low_bits( unsigned( std::max( end, 0 ) ) );
+        return word;
+    }
+
+    // Returns word w of row of the plane of connections toward dir.
+    Word connections( AdjDirection dir, int row, int w ) const
+    {
+        return _connections[ dir ][ _index( w * BITS_PER_WORD, row ) ];
+    }
+
+    // Returns the connection bits of the tile at x, y as in TileState.
+    uint8_t connections( int x, int y ) const
+    {
+        x -= _origin.x;
+        y -= _origin.y;
+
+        uint8_t bits = 0;
+        for ( int dir = 0; dir < 8; ++dir )
+            bits |= ((_connections[ dir ][ _index( x, y ) ] >> (x % BITS_PER_WORD)) & 1) << dir;
+        return bits;
+    }
+
+    // Writes the connection bits of every cell of row into out, which
+    // holds rowWords() * 64 bytes; the byte for a cell is at its bit index.
+    // Transposes 8 cells at a time.
+    void connectionRow( int row, uint8_t* out ) const
+    {
+        for ( int w = 0; w < _rowWords; ++w )
+        {
+            Word planes[ 8 ];
+            for ( int dir = 0; dir < 8; ++dir )
+                planes[ dir ] = _connections[ dir ][ _index( w * BITS_PER_WORD, row ) ];
+
+            for ( int b = 0; b < 8; ++b )
+            {
+                // Byte k of m holds 8 cells of direction k; transpose so
+                // that byte i holds the 8 directions of cell i.
+                Word m = 0;
+                for ( int dir = 0; dir < 8; ++dir )
+                    m |= ((planes[ dir ] >> (8 * b)) & 0xFF) << (8 * dir);
+
+                m = (m & 0xAA55AA55AA55AA55) | ((m & 0x00AA00AA00AA00AA) << 7) | ((m >> 7) & 0x00AA00AA00AA00AA);
+                m = (m & 0xCCCC3333CCCC3333) | ((m & 0x0000CCCC0000CCCC) << 14) | ((m >> 14) & 0x0000CCCC0000CCCC);
+                m = (m & 0xF0F0F0F00F0F0F0F) | ((m & 0x00000000F0F0F0F0) << 28) | ((m >> 28) & 0x00000000F0F0F0F0);
+
+                std::memcpy( out + w * BITS_PER_WORD + 8 * b, &m, 8 );
+            }
+        }
+    }
+
+    // Copies the connection bits into the state of every tile findTile can
+    // reach.
+    void applyConnections( Dungeon& dungeon ) const
+    {
+        std::vector< uint8_t > bytes( size_t( _rowWords ) * BITS_PER_WORD );
+        int lastRow = -1;
+
+        dungeon.eachTileRun( [&]( int x, int y, const LevelTile*, TileState* pStates, int count )
+        {
+            x -= _origin.x;
+            y -= _origin.y;
+            if ( y != lastRow )
+                connectionRow( lastRow = y, bytes.data() );
+
+            for ( int i = 0; i < count; ++i )
+                pStates[ i ].setConnections( bytes[ x + i ] );
+        } );
+    }
+
+    // Calls func( cell ) for every set bit of a word of row w.
+    template< typename Func >
+    void eachBit( Word word, int row, int w, Func&& func ) const
+    {
+        while ( word != 0 )
+        {
+            func( cell( row, w, count_trailing_zeros( word ) ) );
+            word &= word - 1;
+        }
+    }
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "Dungeon.h"
+#include "random.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Positions of the tiles of each type within a rectangle of cells, and the
+// regions of floor connected through their four sides (the moves A* makes),
+// kept up to date one cell at a time. Picking a random tile of a type, or
+// a random floor tile reachable from a given one, is then a single random
+// index however rare such tiles are, and fails rather than searching
+// forever if there is none.
+// Floor regions are a union-find whose members are listed per root. Adding
+// floor merges regions in place; removing floor may split one, so the
+// regions are rebuilt on the next query which needs them.
+class TileIndex
+{
+public:
+
+    static constexpr int TYPE_COUNT = 4; // Tile::NONE to Tile::PIT.
+
+private:
+
+    ivec2 _origin { 0, 0 };
+    ivec2 _size { 0, 0 };
+
+    std::vector< uint8_t > _types;             // Type of each cell.
+    std::vector< int > _slots;                 // Index of each cell in the list of its type.
+    std::vector< int > _cells[ TYPE_COUNT ];   // Cells of each type.
+
+    std::vector< int > _parents;                          // Union-find parent of each floor cell.
+    std::unordered_map< int, std::vector< int > > _regions; // Cells of each region, by root.
+    bool _regionsDirty = false;
+
+    int _index( ivec2 cell ) const
+    {
+        cell -= _origin;
+        if ( unsigned( cell.x ) >= unsigned( _size.x ) || unsigned( cell.y ) >= unsigned( _size.y ) )
+            return -1;
+        return cell.x + cell.y * _size.x;
+    }
+
+    ivec2 _cell( int index ) const
+    {
+        return _origin + ivec2( index % _size.x, index / _size.x );
+    }
+
+    int _find( int i )
+    {
+        while ( _parents[ i ] != i )
+            i = _parents[ i ] = _parents[ _parents[ i ] ];
+        return i;
+    }
+
+    // Merges the regions of two floor cells, moving the members of the
+    // smaller one into the larger.
+    void _union( int a, int b )
+    {
+        a = _find( a );
+        b = _find( b );
+        if ( a == b )
+            return;
+
+        if ( _regions[ a ].size() < _regions[ b ].size() )
+            std::swap( a, b );
+
+        auto it = _regions.find( b );
+        auto& cells = _regions[ a ];
+        cells.insert( cells.end(), it->second.begin(), it->second.end() );
+        _regions.erase( it );
+        _parents[ b ] = a;
+    }
+
+    // Makes a floor cell a region of its own and merges it with its
+    // floor neighbours.
+    void _addFloor( int i )
+    {
+        _parents[ i ] = i;
+        _regions[ i ] = { i };
+
+        int x = i % _size.x;
+        int y = i / _size.x;
+        const uint8_t FLOOR = uint8_t( Tile::FLOOR );
+
+        if ( x > 0 && _types[ i - 1 ] == FLOOR )
+            _union( i, i - 1 );
+        if ( x + 1 < _size.x && _types[ i + 1 ] == FLOOR )
+            _union( i, i + 1 );
+        if ( y > 0 && _types[ i - _size.x ] == FLOOR )
+            _union( i, i - _size.x );
+        if ( y + 1 < _size.y && _types[ i + _size.x ] == FLOOR )
+            _union( i, i + _size.x );
+    }
+
+    void _rebuildRegions()
+    {
+        const uint8_t FLOOR = uint8_t( Tile::FLOOR );
+
+        // Link each floor cell to the floor before it on its row and above
+        // it, then list the cells by root.
+        for ( int i = 0; i < (int) _types.size(); ++i )
+        {
+            if ( _types[ i ] != FLOOR )
+                continue;
+
+            _parents[ i ] = i;
+            if ( i % _size.x > 0 && _types[ i - 1 ] == FLOOR )
+                _parents[ i ] = _find( i - 1 );
+            if ( i >= _size.x && _types[ i - _size.x ] == FLOOR )
+            {
+                int a = _find( i );
+                int b = _find( i - _size.x );
+                _parents[ std::max( a, b ) ] = std::min( a, b );
+            }
+        }
+
+        _regions.clear();
+        for ( int i = 0; i < (int) _types.size(); ++i )
+            if ( _types[ i ] == FLOOR )
+                _regions[ _find( i ) ].push_back( i );
+
+        _regionsDirty = false;
+    }
+
+    // Returns the root of the region of a cell; or -1 if it is not floor.
+    int _root( int i )
+    {
+        if ( i < 0 || _types[ i ] != uint8_t( Tile::FLOOR ) )
+            return -1;
+        if ( _regionsDirty )
+            _rebuildRegions();
+        return _find( i );
+    }
+
+public:
+
+    TileIndex() = default;
+
+    // Covers the cells of rect, given as { x, y, width, height }, all of
+    // them Tile::NONE.
+    void reset( ivec4 rect )
+    {
+        _origin = { rect.x, rect.y };
+        _size = glm::max( ivec2( rect.z, rect.w ), ivec2( 0 ) );
+
+        int count = _size.x * _size.y;
+        _types.assign( count, uint8_t( Tile::NONE ) );
+        _slots.resize( count );
+        _parents.assign( count, -1 );
+        _regions.clear();
+        _regionsDirty = false;
+
+        for ( auto& cells : _cells )
+            cells.clear();
+
+        auto& none = _cells[ (int) Tile::NONE ];
+        none.resize( count );
+        for ( int i = 0; i < count; ++i )
+            none[ i ] = _slots[ i ] = i;
+    }
+
+    // Records the type of the tile at cell. Cells outside the rectangle
+    // are ignored.
+    void set( ivec2 cell, Tile type )
+    {
+        int i = _index( cell );
+        if ( i < 0 || _types[ i ] == uint8_t( type ) )
+            return;
+
+        // Swap the cell out of the list of its old type.
+        Tile old = Tile( _types[ i ] );
+        auto& oldCells = _cells[ (int) old ];
+        int last = oldCells.back();
+        oldCells[ _slots[ i ] ] = last;
+        _slots[ last ] = _slots[ i ];
+        oldCells.pop_back();
+
+        auto& cells = _cells[ (int) type ];
+        _slots[ i ] = int( cells.size() );
+        cells.push_back( i );
+        _types[ i ] = uint8_t( type );
+
+        if ( old == Tile::FLOOR )
+            _regionsDirty = true;
+        else if ( type == Tile::FLOOR && !_regionsDirty )
+            _addFloor( i );
+    }
+
+    // Records every tile findTile can reach in dungeon, over its index.
+    void assign( const Dungeon& dungeon )
+    {
+        reset( dungeon.indexRect() );
+
+        // Regions are built in one pass when first needed.
+        _regionsDirty = true;
+
+        dungeon.eachTileRun( [&]( int x, int y, const LevelTile* pTiles, const TileState*, int count )
+        {
+            for ( int i = 0; i < count; ++i )
+                set( { x + i, y }, pTiles[ i ].type() );
+        } );
+    }
+
+    // Returns the type recorded for cell, or Tile::NONE outside the rectangle.
+    Tile type( ivec2 cell ) const
+    {
+        int i = _index( cell );
+        return i < 0 ? Tile::NONE : Tile( _types[ i ] );
+    }
+
+    // Returns the number of cells of a type.
+    size_t count( Tile type ) const
+    {
+        return _cells[ (int) type ].size();
+    }
+
+    // Picks a cell of a type uniformly at random. Returns false if there
+    // is none.
+    bool randomCell( Tile type, ivec2& cell ) const
+    {
+        const auto& cells = _cells[ (int) type ];
+        if ( cells.empty() )
+            return false;
+
+        cell = _cell( cells[ rand_int( 0, int( cells.size() ) - 1 ) ] );
+        return true;
+    }
+
+    // Returns true if both cells are floor in the same region.
+    bool reachable( ivec2 from, ivec2 to )
+    {
+        int a = _root( _index( from ) );
+        return a >= 0 && a == _root( _index( to ) );
+    }
+
+    // Returns the number of floor cells reachable from a cell, itself
+    // included; 0 if it is not floor.
+    size_t reachableCount( ivec2 from )
+    {
+        int root = _root( _index( from ) );
+        return root < 0 ? 0 : _regions[ root ].size();
+    }
+
+    // Picks a floor cell reachable from a cell uniformly at random (which
+    // may be the cell itself). Returns false if the cell is not floor.
+    bool randomReachable( ivec2 from, ivec2& cell )
+    {
+        int root = _root( _index( from ) );
+        if ( root < 0 )
+            return false;
+
+        const auto& cells = _regions[ root ];
+        cell = _cell( cells[ rand_int( 0, int( cells.size() ) - 1 ) ] );
+        return true;
+    }
+};
@@ -8,6 +8,7 @@
 #include "SceneManager.h"
 #include "InputManager.h"
 #include "AudioEngine.h"
+#include "StatsAllocator.h"
 
 #include <SDL/SDL.h>
 #include <GL/glew.h>
@@ -125,6 +126,8 @@ int main( int argc, char* argv[] )
     AudioEngine::shutdown();
     SDL_DestroyWindow( pWindow );
 
+    AllocationStats::dumpAll( "allocations.txt" );
+
     return 0;
 }
 
@@ -0,0 +1,188 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "AabbTree.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using Tree = AabbTree< int >;
+    using Handle = Tree::Handle;
+
+    const float WORLD = 1000;
+
+    Rect randomRect( std::mt19937& rng )
+    {
+        std::uniform_real_distribution< float > pos( 0, WORLD );
+        std::uniform_real_distribution< float > size( 0, 40 );
+        return { pos( rng ), pos( rng ), size( rng ), size( rng ) };
+    }
+
+    // Returns true if the segment from from by delta meets box, by the slab
+    // test.
+    bool segmentHits( const AabbBox& box, glm::vec2 from, glm::vec2 delta )
+    {
+        float tMin = 0;
+        float tMax = 1;
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( delta[ i ] == 0 )
+            {
+                if ( from[ i ] < box.lo[ i ] || from[ i ] > box.hi[ i ] )
+                    return false;
+                continue;
+            }
+
+            float t0 = (box.lo[ i ] - from[ i ]) * (1 / delta[ i ]);
+            float t1 = (box.hi[ i ] - from[ i ]) * (1 / delta[ i ]);
+            tMin = std::max( tMin, std::min( t0, t1 ) );
+            tMax = std::min( tMax, std::max( t0, t1 ) );
+        }
+        return tMin <= tMax;
+    }
+
+    // A tree of n leaves in which no node's children differ in height by
+    // more than one has at least Fibonacci( height + 2 ) leaves.
+    bool heightBounded( const Tree& tree )
+    {
+        if ( tree.empty() )
+            return tree.height() == -1;
+
+        long long a = 1, b = 2; // Fewest leaves for heights 0 and 1.
+        for ( int h = 0; h < tree.height(); ++h )
+            a = std::exchange( b, a + b );
+        return tree.size() >= a;
+    }
+
+    // Compares the tree's queries, pairs and raycasts with brute force over
+    // the boxes it was given.
+    bool matches( const Tree& tree, const std::map< Handle, Rect >& rects, std::mt19937& rng )
+    {
+        bool ok = TEST_CHECK( tree.size() == int( rects.size() ) );
+        ok &= TEST_CHECK( heightBounded( tree ) );
+
+        bool loads = true;
+        for ( auto& [ h, rect ] : rects )
+            loads &= tree.get( h ) == int( rect.x * 1000 );
+        ok &= TEST_CHECK( loads );
+
+        for ( int q = 0; q < 20; ++q )
+        {
+            Rect range = randomRect( rng );
+            range.width *= 4;
+            range.height *= 4;
+
+            std::vector< Handle > want, got;
+            for ( auto& [ h, rect ] : rects )
+                if ( AabbBox( rect ).overlaps( AabbBox( range ) ) )
+                    want.push_back( h );
+            tree.query( range, [&]( Handle h ) { got.push_back( h ); return true; } );
+            std::sort( got.begin(), got.end() );
+            ok &= TEST_CHECK( got == want );
+
+            glm::vec2 from( range.x, range.y );
+            glm::vec2 to( randomRect( rng ).x, randomRect( rng ).y );
+            want.clear();
+            got.clear();
+            for ( auto& [ h, rect ] : rects )
+                if ( segmentHits( AabbBox( rect ), from, to - from ) )
+                    want.push_back( h );
+            tree.raycast( from, to, [&]( Handle h, float ) { got.push_back( h ); return 1.0f; } );
+            std::sort( got.begin(), got.end() );
+            ok &= TEST_CHECK( got == want );
+        }
+
+        std::vector< std::pair< Handle, Handle > > want, got;
+        for ( auto a = rects.begin(); a != rects.end(); ++a )
+            for ( auto b = std::next( a ); b != rects.end(); ++b )
+                if ( AabbBox( a->second ).overlaps( AabbBox( b->second ) ) )
+                    want.emplace_back( a->first, b->first );
+        tree.eachPair( [&]( Handle a, Handle b ) { got.emplace_back( a, b ); } );
+        std::sort( got.begin(), got.end() );
+        ok &= TEST_CHECK( got == want );
+
+        return ok;
+    }
+
+    // Random inserts, moves (small steps and jumps across the world) and
+    // removes, checked against brute force as they go.
+    void testRandom()
+    {
+        std::mt19937 rng( 1 );
+        Tree tree;
+        std::map< Handle, Rect > rects;
+
+        for ( int step = 0; step < 10000; ++step )
+        {
+            int op = rng() % 10;
+            if ( rects.empty() || op < 3 )
+            {
+                Rect rect = randomRect( rng );
+                Handle h = tree.insert( rect, int( rect.x * 1000 ) );
+                TEST_CHECK( rects.count( h ) == 0 );
+                rects[ h ] = rect;
+            }
+            else
+            {
+                auto it = rects.begin();
+                std::advance( it, rng() % rects.size() );
+
+                if ( op < 8 )
+                {
+                    Rect rect = it->second;
+                    glm::vec2 step = rng() % 4 == 0
+                        ? glm::vec2( randomRect( rng ).x, randomRect( rng ).y ) - glm::vec2( rect.x, rect.y )
+                        : glm::vec2( float( rng() % 5 ) - 2, float( rng() % 5 ) - 2 );
+                    rect.x += step.x;
+                    rect.y += step.y;
+                    tree.move( it->first, rect, step );
+                    tree.get( it->first ) = int( rect.x * 1000 );
+                    it->second = rect;
+                }
+                else
+                {
+                    tree.remove( it->first );
+                    rects.erase( it );
+                }
+            }
+
+            if ( step % 500 == 0 && !matches( tree, rects, rng ) )
+            {
+                printf( "  step %d\n", step );
+                return;
+            }
+        }
+
+        for ( auto& [ h, rect ] : rects )
+            tree.remove( h );
+        rects.clear();
+        matches( tree, rects, rng );
+    }
+
+    // Identical and nested boxes give the insert cost nothing to choose
+    // between, so only the balancing keeps the tree short.
+    void testDegenerate()
+    {
+        std::mt19937 rng( 2 );
+        Tree tree;
+        std::map< Handle, Rect > rects;
+
+        for ( int i = 0; i < 1000; ++i )
+        {
+            Rect rect = i % 2 ? Rect { 5, 5, 1, 1 } : Rect { 0, 0, float( i ), float( i ) };
+            rects[ tree.insert( rect, int( rect.x * 1000 ) ) ] = rect;
+        }
+        matches( tree, rects, rng );
+    }
+}
+
+void test_aabb_tree()
+{
+    testRandom();
+    testDegenerate();
+}
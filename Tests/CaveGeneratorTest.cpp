@@ -0,0 +1,101 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "CaveGenerator.h"
+
+#include <vector>
+
+namespace
+{
+    // Tile types, flavors and connections, room by room and row by row.
+    std::vector< int > contents( const Dungeon& dungeon )
+    {
+        std::vector< int > tiles;
+        dungeon.eachTile( [&]( const LevelTile& tile, const TileState& state, vec2 )
+        {
+            tiles.push_back( int( tile.type() ) | tile.flavor() << 8 | state.connections() << 16 );
+        } );
+        return tiles;
+    }
+
+    // Returns true if every floor tile can be walked to from every other,
+    // moving across and down.
+    bool connected( const Dungeon& dungeon )
+    {
+        ivec4 rect = dungeon.indexRect();
+        auto isFloor = [&]( ivec2 cell )
+        {
+            const LevelTile* pTile = dungeon.findTile( cell.x, cell.y );
+            return pTile && pTile->type() == Tile::FLOOR;
+        };
+
+        std::vector< bool > seen( size_t( rect.z ) * rect.w );
+        auto visit = [&]( ivec2 cell ) -> bool
+        {
+            size_t i = size_t( cell.x - rect.x ) + size_t( cell.y - rect.y ) * rect.z;
+            if ( cell.x < rect.x || cell.y < rect.y || cell.x >= rect.x + rect.z || cell.y >= rect.y + rect.w
+                 || seen[ i ] || !isFloor( cell ) )
+                return false;
+            seen[ i ] = true;
+            return true;
+        };
+
+        int floors = 0;
+        std::vector< ivec2 > stack;
+        for ( int y = rect.y; y < rect.y + rect.w; ++y )
+            for ( int x = rect.x; x < rect.x + rect.z; ++x )
+                if ( isFloor( { x, y } ) && floors++ == 0 )
+                {
+                    visit( { x, y } );
+                    stack.push_back( { x, y } );
+                }
+
+        int reached = 0;
+        while ( !stack.empty() )
+        {
+            ivec2 cell = stack.back();
+            stack.pop_back();
+            ++reached;
+
+            for ( ivec2 step : { ivec2( 1, 0 ), ivec2( -1, 0 ), ivec2( 0, 1 ), ivec2( 0, -1 ) } )
+                if ( visit( cell + step ) )
+                    stack.push_back( cell + step );
+        }
+        return floors > 0 && reached == floors;
+    }
+}
+
+// The dungeon is the same whatever the number of threads, matches the
+// regions generated on their own, and is connected.
+void test_cave_generator()
+{
+    for ( uint64_t seed = 0; seed < 4; ++seed )
+    {
+        CaveGenerator::Params params;
+        params.seed = seed;
+        params.regions = { 5, 4 };
+        params.regionSize = 24 + 8 * int( seed );
+
+        CaveGenerator generator( params );
+        Dungeon single = generator.generate( 1 );
+        std::vector< int > expected = contents( single );
+
+        for ( int threads : { 2, 3, 8, 0 } )
+            TEST_CHECK( contents( generator.generate( threads ) ) == expected );
+
+        int size = params.regionSize;
+        std::vector< LevelTile > tiles( size * size );
+        bool same = true;
+        int index = 0;
+        single.eachRoom( [&]( const Room& room, vec2 )
+        {
+            generator.generateRegion( { index % params.regions.x, index / params.regions.x }, tiles.data() );
+            for ( int i = 0; i < size * size; ++i )
+                same &= tiles[ i ].type() == room.data()[ i ].type()
+                     && tiles[ i ].flavor() == room.data()[ i ].flavor();
+            ++index;
+        } );
+        TEST_CHECK( same );
+        TEST_CHECK( connected( single ) );
+    }
+}
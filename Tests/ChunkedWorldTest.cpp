@@ -0,0 +1,150 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "ChunkedWorld.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace
+{
+    const char* const PATH = "test_chunked_world.dgn";
+
+    // Chunks around the focus number at most 3 x 3, so a budget of 12
+    // leaves room for the home chunk and forces the rest out as the focus
+    // moves on.
+    const int RADIUS = 40;
+    const size_t MAX_CHUNKS = 12;
+
+    // Overlapping rooms of random tiles at quarter tile positions, spread
+    // over several chunks either side of the origin.
+    Dungeon randomDungeon( std::mt19937& rng )
+    {
+        Dungeon dungeon;
+        for ( int i = 0; i < 60; ++i )
+        {
+            Room room( 1 + rng() % 70, 1 + rng() % 70 );
+            room.eachTile( [&]( LevelTile& tile, ivec2 )
+            {
+                Tile type = Tile( rng() % 4 );
+                int flavor = rng() % LevelTile::flavor_count( type );
+                tile = LevelTile( type, LevelTile::flavor_offset( type, flavor ) );
+            } );
+
+            vec2 pos( int( rng() % 600 ) - 200, int( rng() % 600 ) - 200 );
+            dungeon.addRoom( std::move( room ), pos + vec2( rng() % 4, rng() % 4 ) * 0.25f );
+        }
+        return dungeon;
+    }
+
+    // Updates the world until the loader has delivered every chunk asked
+    // for. Returns false if it takes too long.
+    bool settle( ChunkedWorld& world )
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( 10 );
+        do
+        {
+            if ( std::chrono::steady_clock::now() > deadline )
+                return false;
+            std::this_thread::yield();
+            world.update();
+        } while ( world.pendingCount() > 0 );
+        return true;
+    }
+
+    // Returns true if the world knows every tile within RADIUS of pos and
+    // each is the tile of the dungeon there, or Tile::NONE where it has none.
+    bool matches( ChunkedWorld& world, const Dungeon& dungeon, ivec2 pos )
+    {
+        for ( int y = pos.y - RADIUS; y <= pos.y + RADIUS; ++y )
+            for ( int x = pos.x - RADIUS; x <= pos.x + RADIUS; ++x )
+            {
+                const LevelTile* pTile = world.findTile( x, y );
+                if ( !pTile || world.tilePos( pTile ) != ivec2( x, y ) )
+                    return false;
+
+                const LevelTile* pWant = dungeon.findTile( x, y );
+                LevelTile want = pWant ? *pWant : LevelTile();
+                if ( pTile->type() != want.type() || pTile->flavor() != want.flavor() )
+                    return false;
+            }
+        return true;
+    }
+
+    // Walks the focus across the map so that chunks are loaded and evicted,
+    // while a home tile used every frame stays resident.
+    void testWalk( ChunkedWorld::Source source, const Dungeon& dungeon )
+    {
+        ChunkedWorld world( std::move( source ), MAX_CHUNKS );
+
+        const ivec2 home { 380, -150 };
+        const ivec2 start { -150, -150 };
+
+        // Nothing is known until it is asked for.
+        TEST_CHECK( world.findTile( start.x, start.y ) == nullptr );
+        TEST_CHECK( !world.isKnown( home.x, home.y ) );
+
+        world.setFocus( home, 0 );
+        if ( !TEST_CHECK( settle( world ) ) )
+            return;
+
+        bool resident = true;
+        bool within = true;
+        bool same = true;
+        for ( ivec2 pos = start; pos.x <= 400; pos += ivec2( 16, 12 ) )
+        {
+            world.setFocus( pos, RADIUS );
+            resident &= world.findTile( home.x, home.y ) != nullptr;
+            if ( !TEST_CHECK( settle( world ) ) )
+                return;
+
+            within &= world.residentCount() <= MAX_CHUNKS;
+            same &= matches( world, dungeon, pos );
+        }
+        TEST_CHECK( resident );
+        TEST_CHECK( within );
+        TEST_CHECK( same );
+
+        // The first chunks walked over were evicted, and are unknown again;
+        // the home chunk was kept as it was used every frame.
+        TEST_CHECK( !world.isKnown( start.x, start.y ) );
+        TEST_CHECK( world.findTile( start.x, start.y ) == nullptr );
+        TEST_CHECK( world.isKnown( home.x, home.y ) );
+        TEST_CHECK( world.findTile( 100000, -100000 ) == nullptr );
+
+        // Coming back loads them again.
+        world.setFocus( start, RADIUS );
+        TEST_CHECK( settle( world ) && matches( world, dungeon, start ) );
+    }
+}
+
+// Streams a dungeon through a ChunkedWorld from a function reading the
+// dungeon itself and from raw and compressed dungeon files, under a chunk
+// budget small enough that walking across it evicts chunks.
+void test_chunked_world()
+{
+    std::mt19937 rng( 1 );
+    Dungeon dungeon = randomDungeon( rng );
+
+    testWalk( [&dungeon]( ivec2 chunk, LevelTile* pTiles )
+    {
+        ivec2 origin = chunk * ChunkedWorld::CHUNK_SIZE;
+        for ( int y = 0; y < ChunkedWorld::CHUNK_SIZE; ++y )
+            for ( int x = 0; x < ChunkedWorld::CHUNK_SIZE; ++x )
+                if ( const LevelTile* pTile = dungeon.findTile( origin.x + x, origin.y + y ) )
+                    pTiles[ x + y * ChunkedWorld::CHUNK_SIZE ] = *pTile;
+    }, dungeon );
+
+    for ( bool compress : { false, true } )
+    {
+        TEST_CHECK( DungeonFile::save( PATH, dungeon, compress ) );
+        auto pFile = std::make_shared< DungeonFile >();
+        if ( !TEST_CHECK( pFile->open( PATH ) ) )
+            continue;
+        testWalk( ChunkedWorld::fileSource( pFile ), dungeon );
+    }
+    std::remove( PATH );
+}
@@ -0,0 +1,148 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "ConcurrentQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const int PRODUCERS = 4;
+    const int CONSUMERS = 4;
+    const uint64_t ITEMS = 100000; // Per producer.
+    const size_t BATCH = 8;
+
+    // Items carry their producer in the high bits and their number in the
+    // low bits.
+    uint64_t item( int producer, uint64_t n )
+    {
+        return (uint64_t( producer ) << 32) | n;
+    }
+
+    // Pushes ITEMS items, some one at a time and some in batches.
+    template< typename Queue >
+    void produce( Queue& queue, int producer )
+    {
+        uint64_t n = 0;
+        uint64_t batch[ BATCH ];
+        while ( n < ITEMS )
+        {
+            if ( n % 3 == 0 )
+            {
+                size_t count = size_t( std::min< uint64_t >( BATCH, ITEMS - n ) );
+                for ( size_t i = 0; i < count; ++i )
+                    batch[ i ] = item( producer, n + i );
+
+                size_t pushed = queue.pushN( batch, count );
+                n += pushed;
+                if ( pushed == 0 )
+                    std::this_thread::yield();
+            }
+            else if ( queue.tryPush( item( producer, n ) ) )
+                ++n;
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Pops items into out, some one at a time and some in batches, until
+    // remaining says that every item has been popped.
+    template< typename Queue >
+    void consume( Queue& queue, std::atomic< uint64_t >& remaining, std::vector< uint64_t >& out )
+    {
+        uint64_t batch[ BATCH ];
+        for ( int turn = 0; remaining.load( std::memory_order_relaxed ) > 0; ++turn )
+        {
+            size_t popped = turn % 3 == 0
+                ? queue.popN( batch, BATCH )
+                : size_t( queue.tryPop( batch[ 0 ] ) );
+
+            out.insert( out.end(), batch, batch + popped );
+            remaining.fetch_sub( popped, std::memory_order_relaxed );
+            if ( popped == 0 )
+                std::this_thread::yield();
+        }
+    }
+
+    // Checks that every item was popped exactly once and that each consumer
+    // saw the items of each producer in the order they were pushed.
+    void checkItems( const std::vector< std::vector< uint64_t > >& popped, int producers )
+    {
+        std::vector< uint8_t > seen( producers * ITEMS );
+        bool ordered = true;
+
+        for ( const std::vector< uint64_t >& items : popped )
+        {
+            std::vector< int64_t > last( producers, -1 );
+            for ( uint64_t it : items )
+            {
+                int producer = int( it >> 32 );
+                int64_t n = int64_t( it & 0xFFFFFFFF );
+                if ( !TEST_CHECK( producer < producers && n < int64_t( ITEMS ) ) )
+                    return;
+
+                ordered &= n > last[ producer ];
+                last[ producer ] = n;
+                ++seen[ producer * ITEMS + n ];
+            }
+        }
+
+        TEST_CHECK( ordered );
+        TEST_CHECK( std::all_of( seen.begin(), seen.end(), []( uint8_t count ) { return count == 1; } ) );
+    }
+
+    template< typename Queue >
+    void stress( int producers, int consumers )
+    {
+        // Small, so that it is often full and often empty.
+        auto pQueue = std::make_unique< Queue >();
+        std::atomic< uint64_t > remaining { producers * ITEMS };
+        std::vector< std::vector< uint64_t > > popped( consumers );
+        std::vector< std::thread > threads;
+
+        for ( int p = 0; p < producers; ++p )
+            threads.emplace_back( [&, p] { produce( *pQueue, p ); } );
+        for ( int c = 0; c < consumers; ++c )
+            threads.emplace_back( [&, c] { consume( *pQueue, remaining, popped[ c ] ); } );
+        for ( std::thread& thread : threads )
+            thread.join();
+
+        TEST_CHECK( pQueue->empty() );
+        checkItems( popped, producers );
+    }
+
+    // Elements still queued are destroyed with the queue.
+    template< typename Queue >
+    void leftovers()
+    {
+        auto shared = std::make_shared< int >( 0 );
+        {
+            Queue queue;
+            for ( int i = 0; i < 5; ++i )
+                queue.tryPush( shared );
+
+            std::shared_ptr< int > out;
+            queue.tryPop( out );
+        }
+        TEST_CHECK( shared.use_count() == 1 );
+    }
+}
+
+// Runs producers and consumers flat out against small queues and checks
+// that every item comes out exactly once. Build with a thread sanitizer
+// (-fsanitize=thread) to check the memory ordering too.
+void test_concurrent_queue()
+{
+    stress< SpscQueue< uint64_t, 64 > >( 1, 1 );
+    stress< MpmcQueue< uint64_t, 64 > >( 1, 1 );
+    stress< MpmcQueue< uint64_t, 64 > >( PRODUCERS, CONSUMERS );
+    stress< MpmcQueue< uint64_t, 64 > >( 1, CONSUMERS );
+    stress< MpmcQueue< uint64_t, 64 > >( PRODUCERS, 1 );
+
+    leftovers< SpscQueue< std::shared_ptr< int >, 8 > >();
+    leftovers< MpmcQueue< std::shared_ptr< int >, 8 > >();
+}
@@ -0,0 +1,279 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "DungeonFile.h"
+#include "DungeonText.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const char* const PATH = "test_dungeon.dgn";
+
+    std::string toText( const Dungeon& dungeon )
+    {
+        std::ostringstream text;
+        save_dungeon_text( text, dungeon );
+        return text.str();
+    }
+
+    LevelTile randomTile( std::mt19937& rng )
+    {
+        Tile type = Tile( rng() % 4 );
+        int flavor = rng() % LevelTile::flavor_count( type );
+        return LevelTile( type, LevelTile::flavor_offset( type, flavor ) );
+    }
+
+    // Rooms of random tiles at whole and half tile positions, some larger
+    // than a block and some empty.
+    Dungeon randomDungeon( std::mt19937& rng )
+    {
+        Dungeon dungeon;
+        int rooms = rng() % 8;
+        for ( int i = 0; i < rooms; ++i )
+        {
+            int maxSize = rng() % 4 == 0 ? 3 * DungeonFile::BLOCK_SIZE : 20;
+            Room room( rng() % maxSize, rng() % maxSize );
+            room.eachTile( [&]( LevelTile& tile, ivec2 )
+            {
+                tile = randomTile( rng );
+            } );
+
+            vec2 pos( int( rng() % 400 ) - 200, int( rng() % 400 ) - 200 );
+            if ( rng() % 2 )
+                pos.x += 0.5f;
+            dungeon.addRoom( std::move( room ), pos );
+        }
+        return dungeon;
+    }
+
+    void writeFile( const std::vector< char >& data )
+    {
+        std::ofstream file( PATH, std::ios_base::binary | std::ios_base::trunc );
+        file.write( data.data(), data.size() );
+    }
+
+    std::vector< char > readFile()
+    {
+        std::ifstream file( PATH, std::ios_base::binary );
+        return std::vector< char >( std::istreambuf_iterator< char >( file ), {} );
+    }
+
+    // Opens and loads the file, which may be corrupt, and reads every tile.
+    // Returns false if it was rejected, which is all a corrupt file may do.
+    bool tryLoad()
+    {
+        DungeonFile file;
+        if ( !file.open( PATH ) )
+            return false;
+
+        try
+        {
+            int sum = 0;
+            file.load().eachTile( [&]( const LevelTile& tile, const TileState& state, vec2 )
+            {
+                sum += tile.flavor() + int( tile.getSprite( state.connections() ).x );
+            } );
+            return sum >= 0;
+        }
+        catch ( const char* )
+        {
+            return false;
+        }
+    }
+
+    // Saves dungeon and checks that loading it back, whole and block by
+    // block, gives the same dungeon, and that rooms of an uncompressed file
+    // are read in place. Then checks that a damaged copy of the file is
+    // rejected or loads without reading out of bounds.
+    void testFile( const Dungeon& dungeon, const std::string& text, bool compress, std::mt19937& rng )
+    {
+        TEST_CHECK( DungeonFile::save( PATH, dungeon, compress ) );
+
+        {
+            DungeonFile file;
+            if ( !TEST_CHECK( file.open( PATH ) ) )
+                return;
+
+            TEST_CHECK( file.compressed() == compress );
+            TEST_CHECK( toText( file.load() ) == text );
+
+            // Rooms of an uncompressed file borrow their tiles from the
+            // mapping, which outlives the file.
+            Dungeon loaded = file.load();
+            int index = 0;
+            bool inPlace = true;
+            loaded.eachRoom( [&]( const Room& room, vec2 )
+            {
+                inPlace &= compress ? file.tiles( index ) == nullptr : room.data() == file.tiles( index );
+                ++index;
+            } );
+            TEST_CHECK( inPlace );
+
+            file.close();
+            TEST_CHECK( toText( loaded ) == text );
+            TEST_CHECK( file.open( PATH ) );
+
+            // Blocks hold the tiles of the rooms they cover.
+            index = 0;
+            dungeon.eachRoom( [&]( const Room& room, vec2 )
+            {
+                ivec2 blocks = file.blockCount( index );
+                std::vector< LevelTile > tiles( DungeonFile::BLOCK_SIZE * DungeonFile::BLOCK_SIZE );
+                for ( int b = 0; b < blocks.x * blocks.y; ++b )
+                {
+                    ivec4 rect = file.blockRect( index, b );
+                    TEST_CHECK( file.readBlock( index, b, tiles.data() ) );
+
+                    bool same = true;
+                    for ( int y = 0; y < rect.w; ++y )
+                        for ( int x = 0; x < rect.z; ++x )
+                        {
+                            const LevelTile& got = tiles[ x + y * rect.z ];
+                            const LevelTile& want = room.data()[ rect.x + x + (rect.y + y) * room.width() ];
+                            same &= got.type() == want.type() && got.flavor() == want.flavor();
+                        }
+                    TEST_CHECK( same );
+                }
+                ++index;
+            } );
+        }
+
+        std::vector< char > data = readFile();
+
+        // Cut short.
+        for ( size_t size : { size_t( 0 ), sizeof( DungeonFile::Header ) - 1, data.size() / 2, data.size() - 1 } )
+        {
+            if ( size >= data.size() )
+                continue;
+            writeFile( std::vector< char >( data.begin(), data.begin() + size ) );
+            TEST_CHECK( !tryLoad() );
+        }
+
+        // Bytes changed anywhere.
+        for ( int i = 0; i < 20; ++i )
+        {
+            std::vector< char > bad = data;
+            int changes = 1 + rng() % 4;
+            for ( int c = 0; c < changes; ++c )
+                bad[ rng() % bad.size() ] ^= char( 1 + rng() % 255 );
+            writeFile( bad );
+            tryLoad();
+        }
+    }
+
+    // A room borrowing its tiles from a closed file, and so holding the only
+    // reference to the read-only mapping, copies them before it changes.
+    void testInPlace()
+    {
+        Room room( 2, 2 );
+        room.getTile( 0, 0 ) = LevelTile( LevelTile::TILE1 );
+        Dungeon dungeon;
+        dungeon.addRoom( std::move( room ), { 0, 0 } );
+        TEST_CHECK( DungeonFile::save( PATH, dungeon, false ) );
+
+        Dungeon loaded;
+        {
+            DungeonFile file;
+            if ( !TEST_CHECK( file.open( PATH ) ) )
+                return;
+            loaded = file.load();
+        }
+
+        loaded.setTile( 0, 0, LevelTile( LevelTile::WOOD1 ) );
+        TEST_CHECK( loaded.findTile( 0, 0 )->flavor() == LevelTile::WOOD1 );
+
+        DungeonFile file;
+        TEST_CHECK( file.open( PATH ) && file.tiles( 0 )->flavor() == LevelTile::TILE1 );
+    }
+
+    std::vector< char > randomData( std::mt19937& rng )
+    {
+        std::vector< char > data( rng() % 5000 );
+        int alphabet = 1 + rng() % 256;
+        int run = 1 + rng() % 100;
+
+        // Runs of repeated bytes, so there is something to compress.
+        char c = 0;
+        for ( size_t i = 0; i < data.size(); ++i )
+        {
+            if ( rng() % run == 0 )
+                c = char( rng() % alphabet );
+            data[ i ] = c;
+        }
+        return data;
+    }
+
+    // Returns the result of decompressing src into exactly dstSize bytes.
+    // The buffer is sized exactly so that overruns are caught by checked
+    // builds.
+    bool decompress( const std::vector< char >& src, size_t dstSize )
+    {
+        std::vector< char > dst( dstSize );
+        return lz_decompress( src.data(), src.size(), dst.data(), dstSize );
+    }
+
+    void testCompression( std::mt19937& rng )
+    {
+        std::vector< char > data = randomData( rng );
+        std::vector< char > packed( lz_compress_bound( data.size() ) );
+        packed.resize( lz_compress( data.data(), data.size(), packed.data() ) );
+
+        std::vector< char > unpacked( data.size() );
+        TEST_CHECK( lz_decompress( packed.data(), packed.size(), unpacked.data(), unpacked.size() ) );
+        TEST_CHECK( unpacked == data );
+
+        // The wrong size.
+        TEST_CHECK( !decompress( packed, data.size() + 1 ) );
+        if ( !data.empty() )
+            TEST_CHECK( !decompress( packed, data.size() - 1 ) );
+
+        // Cut short.
+        if ( !packed.empty() )
+            TEST_CHECK( !decompress( std::vector< char >( packed.begin(), packed.end() - 1 - rng() % packed.size() ),
+                                     data.size() ) );
+
+        // Bytes changed anywhere, or garbage.
+        for ( int i = 0; i < 20 && !packed.empty(); ++i )
+        {
+            std::vector< char > bad = packed;
+            bad[ rng() % bad.size() ] ^= char( 1 + rng() % 255 );
+            decompress( bad, data.size() );
+        }
+        decompress( randomData( rng ), rng() % 10000 );
+    }
+}
+
+// Round trips random dungeons from text through raw and compressed files
+// and back, and feeds damaged files and compressed data to the loaders.
+void test_dungeon_file()
+{
+    const int DUNGEONS = 50;
+    const int COMPRESSIONS = 1000;
+
+    std::mt19937 rng( 1 );
+
+    for ( int d = 0; d < DUNGEONS; ++d )
+    {
+        std::string text = toText( randomDungeon( rng ) );
+
+        std::istringstream in( text );
+        Dungeon dungeon = load_dungeon_text( in );
+        if ( !TEST_CHECK( toText( dungeon ) == text ) )
+            break;
+
+        testFile( dungeon, text, false, rng );
+        testFile( dungeon, text, true, rng );
+    }
+    testInPlace();
+    std::remove( PATH );
+
+    for ( int i = 0; i < COMPRESSIONS; ++i )
+        testCompression( rng );
+}
@@ -0,0 +1,135 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "DungeonTiles.h"
+
+#include <algorithm>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+    auto key( const DungeonTiles::BlackSquare& sq )
+    {
+        return std::make_tuple( sq.tile.x, sq.tile.y, sq.pos.x, sq.pos.y, sq.size.x, sq.size.y );
+    }
+
+    auto key( const DungeonTiles::FloorCorner& fc )
+    {
+        return std::make_tuple( fc.tile.x, fc.tile.y, fc.pos.x, fc.pos.y, fc.off.x, fc.off.y );
+    }
+
+    // Returns the extras in a fixed order, as updateDirtyTiles() leaves
+    // them in a different order to initExtras().
+    template< typename T >
+    std::vector< decltype( key( T() ) ) > sorted( const std::vector< T >& extras )
+    {
+        std::vector< decltype( key( T() ) ) > keys;
+        for ( const T& extra : extras )
+            keys.push_back( key( extra ) );
+        std::sort( keys.begin(), keys.end() );
+        return keys;
+    }
+
+    std::vector< uint8_t > connections( const Dungeon& dungeon )
+    {
+        std::vector< uint8_t > conns;
+        dungeon.eachTile( [&]( const LevelTile&, const TileState& state, vec2 )
+        {
+            conns.push_back( state.connections() );
+        } );
+        return conns;
+    }
+
+    // Returns true if both indexes record the same type and floor region
+    // size for every cell of rect, given as { x, y, width, height }.
+    bool sameIndex( TileIndex& lhs, TileIndex& rhs, ivec4 rect )
+    {
+        for ( int y = rect.y - 1; y <= rect.y + rect.w; ++y )
+            for ( int x = rect.x - 1; x <= rect.x + rect.z; ++x )
+                if ( lhs.type( { x, y } ) != rhs.type( { x, y } )
+                     || lhs.reachableCount( { x, y } ) != rhs.reachableCount( { x, y } ) )
+                    return false;
+        return true;
+    }
+
+    LevelTile randomTile( std::mt19937& rng )
+    {
+        switch ( rng() % 3 )
+        {
+        case 0:  return DungeonTiles::FLOOR_TILE;
+        case 1:  return DungeonTiles::WALL_TILE;
+        default: return DungeonTiles::PIT_TILE;
+        }
+    }
+
+    // Overlapping rooms of random tiles at quarter tile positions, so that
+    // some tiles are hidden and some rooms sit off the grid.
+    Dungeon randomDungeon( std::mt19937& rng )
+    {
+        Dungeon dungeon;
+        int rooms = 1 + rng() % 5;
+        for ( int i = 0; i < rooms; ++i )
+        {
+            Room room( 1 + rng() % 16, 1 + rng() % 16 );
+            room.eachTile( [&]( LevelTile& tile, ivec2 )
+            {
+                tile = randomTile( rng );
+            } );
+            vec2 pos( int( rng() % 24 ) - 8, int( rng() % 24 ) - 8 );
+            dungeon.addRoom( std::move( room ), pos + vec2( rng() % 4, rng() % 4 ) * 0.25f );
+        }
+        return dungeon;
+    }
+}
+
+// Edits random dungeons a few tiles at a time and checks that what
+// updateDirtyTiles() leaves matches rebuilding everything from scratch.
+void test_dungeon_tiles()
+{
+    const int DUNGEONS = 200;
+    const int UPDATES = 20;
+
+    std::mt19937 rng( 1 );
+
+    for ( int d = 0; d < DUNGEONS; ++d )
+    {
+        DungeonTiles tiles;
+        tiles.dungeon = randomDungeon( rng );
+        tiles.updateConnections();
+        tiles.initExtras();
+
+        ivec4 rect = tiles.dungeon.indexRect();
+
+        for ( int u = 0; u < UPDATES; ++u )
+        {
+            int edits = 1 + rng() % 4;
+            for ( int e = 0; e < edits; ++e )
+            {
+                ivec2 cell( rect.x + int( rng() % rect.z ), rect.y + int( rng() % rect.w ) );
+                if ( tiles.dungeon.findTile( cell.x, cell.y ) == nullptr )
+                    continue;
+
+                tiles.dungeon.setTile( cell.x, cell.y, randomTile( rng ) );
+                tiles.markDirty( cell );
+            }
+            tiles.updateDirtyTiles();
+
+            DungeonTiles fresh;
+            fresh.dungeon = tiles.dungeon;
+            fresh.updateConnections();
+            fresh.initExtras();
+
+            bool ok = TEST_CHECK( connections( tiles.dungeon ) == connections( fresh.dungeon ) );
+            ok &= TEST_CHECK( sorted( tiles.blackSquares ) == sorted( fresh.blackSquares ) );
+            ok &= TEST_CHECK( sorted( tiles.floorCorners ) == sorted( fresh.floorCorners ) );
+            ok &= TEST_CHECK( sameIndex( tiles.tileIndex, fresh.tileIndex, rect ) );
+            if ( !ok )
+            {
+                printf( "  dungeon %d, update %d\n", d, u );
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,114 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "FrameArena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    bool aligned( const Blk& blk )
+    {
+        return uintptr_t( blk.ptr ) % FrameArena::ALIGNMENT == 0;
+    }
+
+    // Allocations are aligned bumps, and only the most recent one can be
+    // freed or grown.
+    void testAllocate()
+    {
+        FrameArena arena( 1024 );
+
+        Blk a = arena.allocate( 10 );
+        Blk b = arena.allocate( 20 );
+        TEST_CHECK( a.ptr && b.ptr && a.size == 10 && b.size == 20 );
+        TEST_CHECK( aligned( a ) && aligned( b ) );
+        TEST_CHECK( (byte*) b.ptr == (byte*) a.ptr + FrameArena::ALIGNMENT );
+        TEST_CHECK( arena.owns( a.ptr ) && arena.owns( b.ptr ) );
+        TEST_CHECK( arena.used() == 3 * FrameArena::ALIGNMENT );
+
+        // a is not the most recent allocation.
+        TEST_CHECK( !arena.expand( a, 100 ) );
+        arena.deallocate( a );
+        TEST_CHECK( arena.used() == 3 * FrameArena::ALIGNMENT );
+
+        TEST_CHECK( arena.expand( b, 100 ) && b.size == 120 );
+        TEST_CHECK( !arena.expand( b, 1024 ) && b.size == 120 );
+        TEST_CHECK( arena.used() == FrameArena::ALIGNMENT + 128 );
+
+        arena.deallocate( b );
+        TEST_CHECK( arena.used() == FrameArena::ALIGNMENT );
+        TEST_CHECK( arena.allocate( 1 ).ptr == b.ptr );
+    }
+
+    // A frame which outgrows its buffer spills to the heap, and the buffer
+    // grows to fit the frame when it next comes round.
+    void testOverflow()
+    {
+        FrameArena arena( 256 );
+        std::vector< Blk > blks;
+
+        for ( int i = 0; i < 32; ++i )
+        {
+            Blk blk = arena.allocate( 100 );
+            TEST_CHECK( blk.ptr && blk.size == 100 && aligned( blk ) );
+            std::memset( blk.ptr, i, blk.size );
+            blks.push_back( blk );
+        }
+        TEST_CHECK( !arena.owns( blks.back().ptr ) );
+        TEST_CHECK( arena.used() == 32 * 112 );
+
+        // Nothing overlaps.
+        bool intact = true;
+        for ( int i = 0; i < 32; ++i )
+            for ( size_t j = 0; j < blks[ i ].size; ++j )
+                intact &= ((byte*) blks[ i ].ptr)[ j ] == byte( i );
+        TEST_CHECK( intact );
+
+        // The next frame uses the other buffer, which is still small; the
+        // one after reuses this one, which has grown to fit.
+        arena.nextFrame();
+        TEST_CHECK( arena.used() == 0 );
+        arena.nextFrame();
+        TEST_CHECK( arena.frame() == 2 );
+
+        bool owned = true;
+        for ( int i = 0; i < 32; ++i )
+            owned &= arena.owns( arena.allocate( 100 ).ptr );
+        TEST_CHECK( owned );
+    }
+
+    // Memory from one frame stays valid through the next and is reused in
+    // the one after.
+    void testFrames()
+    {
+        FrameArena arena( 1024 );
+
+        Blk first = arena.allocate( 64 );
+        std::memset( first.ptr, 0xAB, first.size );
+
+        arena.nextFrame();
+        Blk second = arena.allocate( 64 );
+        std::memset( second.ptr, 0xCD, second.size );
+        TEST_CHECK( second.ptr != first.ptr );
+        TEST_CHECK( ((byte*) first.ptr)[ 63 ] == byte( 0xAB ) );
+
+        arena.nextFrame();
+        TEST_CHECK( arena.used() == 0 );
+        TEST_CHECK( arena.allocate( 64 ).ptr == first.ptr );
+        TEST_CHECK( ((byte*) second.ptr)[ 63 ] == byte( 0xCD ) );
+
+        FrameVector< int > ints { StdAllocator< int, FrameArena >( arena ) };
+        for ( int i = 0; i < 1000; ++i )
+            ints.push_back( i );
+        TEST_CHECK( ints.size() == 1000 && ints[ 999 ] == 999 );
+    }
+}
+
+void test_frame_arena()
+{
+    testAllocate();
+    testOverflow();
+    testFrames();
+}
@@ -0,0 +1,35 @@
+// Andrew Meckling
+#pragma once
+
+#include <cstdio>
+
+// Number of failed checks so far; main() fails if it is not zero.
+inline int& test_failures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+// Prints and counts a failed check. Returns ok so that a test can stop
+// early on a failure which would make the rest meaningless.
+inline bool test_check( bool ok, const char* expr, const char* file, int line )
+{
+    if ( !ok )
+    {
+        printf( "%s(%d): check failed: %s\n", file, line, expr );
+        ++test_failures();
+    }
+    return ok;
+}
+
+#define TEST_CHECK( EXPR ) test_check( bool( EXPR ), #EXPR, __FILE__, __LINE__ )
+
+// Each test checks its results with TEST_CHECK.
+void test_dungeon_tiles();
+void test_dungeon_file();
+void test_concurrent_queue();
+void test_frame_arena();
+void test_aabb_tree();
+void test_thread_caching_allocator();
+void test_cave_generator();
+void test_chunked_world();
@@ -0,0 +1,186 @@
+// Andrew Meckling
+
+#include "Test.h"
+#include "ThreadCachingAllocator.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Alloc = ThreadCachingAllocator< 16, 32, 64, 128, 256 >;
+
+    const int THREADS = 4;
+    const int ROUNDS = 4;
+    const int ITERATIONS = 20000; // Per thread per round.
+
+    // A block and the byte it was filled with when it was handed out.
+    struct Item
+    {
+        Blk  blk;
+        byte stamp;
+    };
+
+    using Queue = MpmcQueue< Item, 256 >;
+
+    Item allocate( Alloc& alloc, std::mt19937& rng )
+    {
+        Item item { alloc.allocate( 1 + rng() % Alloc::MAX_SIZE ), byte( 1 + rng() % 255 ) };
+        if ( item.blk.ptr )
+            std::memset( item.blk.ptr, item.stamp, item.blk.size );
+        return item;
+    }
+
+    // Returns true if the block still holds its stamp, so no one else was
+    // given the same memory while it was live.
+    bool intact( const Item& item )
+    {
+        for ( size_t i = 0; i < item.blk.size; ++i )
+            if ( ((byte*) item.blk.ptr)[ i ] != item.stamp )
+                return false;
+        return true;
+    }
+
+    // Allocates blocks and hands them to the other threads through queue,
+    // and frees blocks which other threads handed to it, so most frees are
+    // remote. Counts blocks which were not intact or owned into *pBad.
+    void work( Queue& queue, int seed, std::atomic< int >* pBad )
+    {
+        Alloc alloc;
+        std::mt19937 rng( seed );
+        std::vector< Item > mine;
+        int bad = 0;
+
+        for ( int i = 0; i < ITERATIONS; ++i )
+        {
+            Item item = allocate( alloc, rng );
+            bad += !item.blk.ptr || !alloc.owns( item.blk.ptr );
+
+            // Keep a few blocks to free locally, and give the rest away.
+            if ( rng() % 4 == 0 )
+                mine.push_back( item );
+            else if ( !queue.tryPush( item ) )
+            {
+                bad += !intact( item );
+                alloc.deallocate( item.blk );
+            }
+
+            if ( mine.size() > 32 )
+            {
+                bad += !intact( mine.back() );
+                alloc.deallocate( mine.back().blk );
+                mine.pop_back();
+            }
+
+            Item other;
+            if ( queue.tryPop( other ) )
+            {
+                bad += !intact( other );
+                alloc.deallocate( other.blk );
+            }
+        }
+
+        // Exit holding nothing of our own; the queue may still hold blocks
+        // of ours, which outlive this thread's cache.
+        for ( Item& item : mine )
+        {
+            bad += !intact( item );
+            alloc.deallocate( item.blk );
+        }
+        *pBad += bad;
+    }
+
+    // Rounds of threads which exit with their blocks still in the queue
+    // and whose caches are adopted by the next round.
+    void testRemoteFree()
+    {
+        Queue queue;
+        std::atomic< int > bad { 0 };
+
+        for ( int round = 0; round < ROUNDS; ++round )
+        {
+            std::vector< std::thread > threads;
+            for ( int t = 0; t < THREADS; ++t )
+                threads.emplace_back( work, std::ref( queue ), round * THREADS + t, &bad );
+            for ( std::thread& thread : threads )
+                thread.join();
+        }
+
+        // Blocks of threads which have exited are freed from here.
+        Alloc alloc;
+        Item item;
+        while ( queue.tryPop( item ) )
+        {
+            bad += !intact( item );
+            alloc.deallocate( item.blk );
+        }
+        TEST_CHECK( bad == 0 );
+    }
+
+    // A dead thread's cache, including a block freed to it after it died,
+    // is adopted by the next thread to need one.
+    void testAdoption()
+    {
+        // Its own size classes, so no other test's caches are orphaned.
+        using Alloc2 = ThreadCachingAllocator< 48 >;
+        Alloc2 alloc;
+
+        Blk fromDead = nullptr;
+        std::thread( [&]
+        {
+            Blk blk = alloc.allocate( 40 );
+            alloc.deallocate( blk );
+            fromDead = alloc.allocate( 40 );
+            TEST_CHECK( fromDead.ptr == blk.ptr );
+        } ).join();
+
+        // Pushed onto the orphaned cache's remote-free stack.
+        alloc.deallocate( fromDead );
+
+        std::thread( [&]
+        {
+            Blk blk = alloc.allocate( 40 );
+            TEST_CHECK( blk.ptr == fromDead.ptr );
+            alloc.deallocate( blk );
+        } ).join();
+    }
+
+    void testOwns()
+    {
+        Alloc alloc;
+        Blk blk = alloc.allocate( 100 );
+        void* pMalloc = std::malloc( 100 );
+        int local = 0;
+
+        TEST_CHECK( alloc.owns( blk.ptr ) );
+        TEST_CHECK( !alloc.owns( pMalloc ) );
+        TEST_CHECK( !alloc.owns( &local ) );
+        TEST_CHECK( !alloc.owns( nullptr ) );
+        TEST_CHECK( alloc.allocate( Alloc::MAX_SIZE + 1 ).ptr == nullptr );
+
+        // Anything too large falls back to Mallocator.
+        FallbackAllocator< Alloc, Mallocator > fallback;
+        Blk small = fallback.allocate( 64 );
+        Blk large = fallback.allocate( 1000 );
+        TEST_CHECK( alloc.owns( small.ptr ) && !alloc.owns( large.ptr ) );
+        fallback.deallocate( small );
+        fallback.deallocate( large );
+
+        std::free( pMalloc );
+        alloc.deallocate( blk );
+    }
+}
+
+// Build with a thread sanitizer (-fsanitize=thread) to check the memory
+// ordering of the remote-free stacks too.
+void test_thread_caching_allocator()
+{
+    testOwns();
+    testAdoption();
+    testRemoteFree();
+}
@@ -0,0 +1,43 @@
+// Andrew Meckling
+
+#include "Test.h"
+
+#include <cstring>
+
+struct Test
+{
+    const char* name;
+    void (*run)();
+};
+
+static const Test TESTS[] = {
+    { "dungeontiles", test_dungeon_tiles },
+    { "dungeonfile", test_dungeon_file },
+    { "concurrentqueue", test_concurrent_queue },
+    { "framearena", test_frame_arena },
+    { "aabbtree", test_aabb_tree },
+    { "threadcachingallocator", test_thread_caching_allocator },
+    { "cavegenerator", test_cave_generator },
+    { "chunkedworld", test_chunked_world },
+};
+
+// Runs every test, or only those named on the command line. Returns the
+// number of failed checks, so zero on success.
+int main( int argc, char* argv[] )
+{
+    for ( const Test& test : TESTS )
+    {
+        bool run = argc < 2;
+        for ( int i = 1; i < argc; ++i )
+            run |= strcmp( argv[ i ], test.name ) == 0;
+
+        if ( !run )
+            continue;
+
+        int failures = test_failures();
+        test.run();
+        printf( "%-40s %s\n", test.name, test_failures() == failures ? "ok" : "FAILED" );
+    }
+
+    return test_failures();
+}